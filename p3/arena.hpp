@@ -0,0 +1,117 @@
+#ifndef __arena_hpp__
+#define __arena_hpp__
+
+#include <cstddef>
+#include <new>
+#include <utility>
+#include "mem.h"
+
+/*
+ * C++ wrappers for the arenas of mem.h
+ *
+ *   mem::Arena arena;
+ *   {
+ *       mem::ArenaScope scope(arena);
+ *       Node *n = arena.make<Node>(1, 2);
+ *       ...
+ *   } // everything allocated in the scope is freed here
+ *
+ * Objects made in an arena are never destroyed, only their memory is
+ * freed, so they should not own anything outside of the arena.
+ */
+namespace mem {
+
+class Arena {
+ public:
+    explicit Arena(size_t chunk_size = 0) : arena_(Arena_Create(chunk_size)) {
+        if (arena_ == NULL) {
+            throw std::bad_alloc();
+        }
+    }
+
+    ~Arena() {
+        Arena_Destroy(arena_);
+    }
+
+    Arena(Arena &&other) : arena_(other.arena_) {
+        other.arena_ = NULL;
+    }
+
+    Arena& operator=(Arena &&other) {
+        std::swap(arena_, other.arena_);
+        return *this;
+    }
+
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    // Returns 'size' bytes aligned to 'alignment', throws std::bad_alloc
+    void* alloc(size_t size, size_t alignment = alignof(std::max_align_t)) {
+        void *ptr = Arena_Alloc_Aligned(arena_, size, alignment);
+        if (ptr == NULL) {
+            throw std::bad_alloc();
+        }
+        return ptr;
+    }
+
+    // Constructs a T in the arena
+    template <class T, class... Args>
+    T* make(Args&&... args) {
+        return new (alloc(sizeof(T), alignof(T))) T(std::forward<Args>(args)...);
+    }
+
+    // Returns room for n default constructed Ts in the arena
+    template <class T>
+    T* make_array(size_t n) {
+        if (n > (size_t)-1 / sizeof(T)) {
+            throw std::bad_alloc();
+        }
+        T *array = static_cast<T*>(alloc(sizeof(T) * n, alignof(T)));
+        for (size_t i = 0; i < n; i++) {
+            new (array + i) T();
+        }
+        return array;
+    }
+
+    arena_marker save() const {
+        return Arena_Save(arena_);
+    }
+
+    void restore(arena_marker marker) {
+        Arena_Restore(arena_, marker);
+    }
+
+    void reset() {
+        Arena_Reset(arena_);
+    }
+
+    mem_arena* get() const {
+        return arena_;
+    }
+
+ private:
+    mem_arena *arena_;
+};
+
+/*
+ * Frees everything allocated from an arena during its lifetime
+ */
+class ArenaScope {
+ public:
+    explicit ArenaScope(Arena &arena) : arena_(arena), marker_(arena.save()) {}
+
+    ~ArenaScope() {
+        arena_.restore(marker_);
+    }
+
+    ArenaScope(const ArenaScope&) = delete;
+    ArenaScope& operator=(const ArenaScope&) = delete;
+
+ private:
+    Arena &arena_;
+    arena_marker marker_;
+};
+
+}  // namespace mem
+
+#endif  // __arena_hpp__
@@ -0,0 +1,93 @@
+/*
+ * Request-scoped allocation, an arena against Alloc_Mem/Free_Mem
+ *
+ * Each request allocates 'per_req' objects of random size and then frees
+ * all of them: one by one with Free_Mem or free, or at once with
+ * Arena_Reset. The average time per request is reported, split into the
+ * allocations and the final release.
+ *
+ * Usage: arena [requests] [per_req]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "mem.h"
+#include "bench.h"
+
+#define REGION (256 << 20)
+
+enum { ARENA, ALLOC_MEM, MALLOC, MODES };
+static const char *mode_names[] = { "Arena_Alloc", "Alloc_Mem", "malloc" };
+
+/* Runs one mode, must be in a fresh process */
+static int run(int mode, int requests, int per_req) {
+    mem_arena *arena = NULL;
+    uint32_t seed = 777;
+    uint64_t alloc_ns = 0, release_ns = 0;
+
+    if (Init_Mem(REGION) != 0) {
+        return 1;
+    }
+    if (mode == ARENA && (arena = Arena_Create(0)) == NULL) {
+        return 1;
+    }
+    void **ptr = malloc(sizeof(void*) * per_req);
+    if (ptr == NULL) {
+        return 1;
+    }
+
+    for (int r = 0; r < requests; r++) {
+        uint64_t start = now_ns();
+        for (int i = 0; i < per_req; i++) {
+            int size = rng_range(&seed, 16, 256);
+            ptr[i] = (mode == ARENA) ? Arena_Alloc(arena, size)
+                   : (mode == MALLOC) ? malloc(size) : Alloc_Mem(size);
+            if (ptr[i] == NULL) {
+                fprintf(stderr, "arena: out of memory\n");
+                return 1;
+            }
+            *(char*)ptr[i] = (char)i;
+        }
+        uint64_t mid = now_ns();
+        if (mode == ARENA) {
+            Arena_Reset(arena);
+        } else {
+            for (int i = 0; i < per_req; i++) {
+                if (mode == MALLOC) {
+                    free(ptr[i]);
+                } else {
+                    Free_Mem(ptr[i]);
+                }
+            }
+        }
+        alloc_ns += mid - start;
+        release_ns += now_ns() - mid;
+    }
+
+    printf("%-12s %8d %12.2f %12.2f\n", mode_names[mode], per_req,
+           alloc_ns / 1e3 / requests, release_ns / 1e3 / requests);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int requests = (argc > 1) ? atoi(argv[1]) : 20000;
+    int per_req = (argc > 2) ? atoi(argv[2]) : 500;
+
+    printf("%-12s %8s %12s %12s\n", "mode", "objects", "alloc us", "release us");
+    fflush(stdout);
+    for (int mode = 0; mode < MODES; mode++) {
+        // Init_Mem only works once per process, so fork for each run
+        pid_t pid = fork();
+        if (pid == 0) {
+            exit(run(mode, requests, per_req));
+        }
+        int status;
+        if (pid < 0 || waitpid(pid, &status, 0) < 0 ||
+            !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "arena: run failed\n");
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,51 @@
+#ifndef __bench_h__
+#define __bench_h__
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <time.h>
+
+/*
+ * Helpers shared by the benchmark programs
+ */
+
+/* Returns a monotonic timestamp in nanoseconds */
+static inline uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+/* xorshift32 - cheap and deterministic for a given seed */
+static inline uint32_t rng_next(uint32_t *state) {
+    uint32_t x = *state;
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+/* Returns a random number in [lo, hi] */
+static inline int rng_range(uint32_t *state, int lo, int hi) {
+    return lo + (int)(rng_next(state) % (uint32_t)(hi - lo + 1));
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t*)a;
+    uint64_t y = *(const uint64_t*)b;
+    return (x > y) - (x < y);
+}
+
+/* Sorts n samples in place so percentile() can be used */
+static inline void sort_samples(uint64_t *samples, int n) {
+    qsort(samples, n, sizeof(uint64_t), cmp_u64);
+}
+
+/* Returns the p-th percentile (0 <= p <= 100) of n sorted samples */
+static inline uint64_t percentile(const uint64_t *samples, int n, double p) {
+    int idx = (int)(p / 100.0 * (n - 1) + 0.5);
+    return samples[idx];
+}
+
+#endif // __bench_h__
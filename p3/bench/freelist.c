@@ -0,0 +1,124 @@
+/*
+ * Fragmentation and throughput of the free list policies, above all the
+ * single address ordered list against the single LIFO list
+ *
+ * A fixed region is churned: a random slot is freed and allocated again,
+ * mostly with a small size and sometimes with a larger one, while the live
+ * bytes are kept under a target. Once they reach it a failed allocation
+ * means the free space is too fragmented to hold the request. Reported per
+ * policy: the average time of a free/allocate pair, the failed requests,
+ * the live bytes when the first request failed (as a percentage of the
+ * region, 100% means no fragmentation) and the largest free block left at
+ * the end, also as a percentage of the region.
+ *
+ * Usage: freelist [ops] [target %]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "mem.h"
+#include "bench.h"
+
+#define REGION (32 << 20)
+#define SLOTS 16384
+
+static const struct { int policy; const char *name; } policies[] = {
+    { MEM_POLICY_ADDR, "addr" },
+    { MEM_POLICY_LIFO, "lifo" },
+    { MEM_POLICY_SEGLIST, "seglist" },
+    { MEM_POLICY_TLSF, "tlsf" },
+};
+
+/* Returns the size of the largest block Alloc_Mem can hand out now */
+static size_t largest_free(void) {
+    size_t lo = 0, hi = REGION;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo + 1) / 2;
+        void *ptr = Alloc_Mem(mid);
+        if (ptr != NULL) {
+            Free_Mem(ptr);
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return lo;
+}
+
+/* Runs one policy, must be in a fresh process */
+static int run(int policy, const char *name, long ops, int target_pct) {
+    static char *slots[SLOTS];
+    static size_t sizes[SLOTS];
+    mem_opts opts = { policy };
+    uint32_t rng = 31337;
+    size_t live = 0, live_at_fail = 0;
+    size_t target = (size_t)REGION / 100 * target_pct;
+    long failed = 0;
+
+    if (Init_Mem_Opts(REGION, &opts) != 0) {
+        return 1;
+    }
+    uint64_t start = now_ns();
+    for (long i = 0; i < ops; i++) {
+        int s = rng_next(&rng) % SLOTS;
+        if (slots[s] != NULL) {
+            Free_Mem(slots[s]);
+            live -= sizes[s];
+            slots[s] = NULL;
+        }
+        size_t size = (rng_next(&rng) % 10 == 0)
+                      ? (size_t)rng_range(&rng, 1 << 10, 32 << 10)
+                      : (size_t)rng_range(&rng, 16, 512);
+        if (live + size > target) {
+            continue; //keep the live set bounded
+        }
+        slots[s] = Alloc_Mem(size);
+        if (slots[s] == NULL) {
+            if (failed++ == 0) {
+                live_at_fail = live;
+            }
+            continue;
+        }
+        *slots[s] = (char)i;
+        sizes[s] = size;
+        live += size;
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    char first_fail[16] = "-";
+    if (failed > 0) {
+        snprintf(first_fail, sizeof(first_fail), "%.1f%%",
+                 100.0 * live_at_fail / REGION);
+    }
+    printf("%-8s %10.1f %8ld %12s %12.1f%%\n", name, (double)elapsed / ops,
+           failed, first_fail, 100.0 * largest_free() / REGION);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    long ops = (argc > 1) ? atol(argv[1]) : 1000000;
+    int target_pct = (argc > 2) ? atoi(argv[2]) : 70;
+
+    printf("%d%% of a %d MB region live at most, %ld operations per row\n",
+           target_pct, REGION >> 20, ops);
+    printf("%-8s %10s %8s %12s %13s\n", "policy", "ns/pair", "failed",
+           "live at fail", "largest free");
+    fflush(stdout);
+    for (int p = 0; p < (int)(sizeof(policies) / sizeof(policies[0])); p++) {
+        // Init_Mem only works once per process, so fork for each run
+        pid_t pid = fork();
+        if (pid == 0) {
+            exit(run(policies[p].policy, policies[p].name, ops, target_pct));
+        }
+        int status;
+        if (pid < 0 || waitpid(pid, &status, 0) < 0 ||
+            !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "freelist: run failed\n");
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,168 @@
+/*
+ * Throughput and fragmentation of the mem::Heap policy combinations, with
+ * the SEGLIST and TLSF heaps of mem.c for reference
+ *
+ * Two traces are generated up front and replayed on every heap: each step
+ * frees a slot if it is taken and allocates a new size into it, keeping
+ * the live bytes under 70% of the heap. 'small' only has sizes up to 512
+ * bytes, 'mixed' has one in ten between 1 and 32 KiB. Reported per heap:
+ * the average time of a step, the requests that failed and the largest
+ * free block left at the end as a percentage of the heap. A Deferred heap
+ * is measured as it stands, with the blocks freed since its last miss
+ * not merged yet.
+ *
+ * Usage: heap [steps]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <vector>
+#include "heap.hpp"
+#include "mem.h"
+#include "bench.h"
+
+#define REGION (8 << 20)
+
+struct Step {
+    int slot;
+    int size;
+};
+
+struct Trace {
+    const char *name;
+    int slots;
+    std::vector<Step> steps;
+};
+
+/* Builds a trace of n steps, one in 'large_in' sizes are large (0 never) */
+static Trace make_trace(const char *name, int slots, int large_in, long n) {
+    Trace t;
+    std::vector<int> sizes(slots, 0);
+    uint32_t rng = 4711;
+    size_t live = 0;
+
+    t.name = name;
+    t.slots = slots;
+    for (long i = 0; i < n; i++) {
+        Step s;
+        s.slot = rng_next(&rng) % slots;
+        s.size = (large_in > 0 && rng_next(&rng) % large_in == 0)
+                 ? rng_range(&rng, 1 << 10, 32 << 10)
+                 : rng_range(&rng, 16, 512);
+        live -= sizes[s.slot];
+        sizes[s.slot] = 0;
+        if (live + s.size > (size_t)REGION / 10 * 7) {
+            s.size = 0; //only free
+        }
+        live += s.size;
+        sizes[s.slot] = s.size;
+        t.steps.push_back(s);
+    }
+    return t;
+}
+
+static void report(const char *name, const Trace &t, uint64_t elapsed,
+                   long failed, size_t largest) {
+    printf("%-7s %-30s %10.1f %8ld %12.1f%%\n", t.name, name,
+           (double)elapsed / t.steps.size(), failed, 100.0 * largest / REGION);
+}
+
+/* Replays trace t on a fresh mem::Heap of type H */
+template <class H>
+static void run(const char *name, const Trace &t) {
+    H heap(REGION);
+    std::vector<void*> ptr(t.slots, (void*)NULL);
+    long failed = 0;
+
+    uint64_t start = now_ns();
+    for (size_t i = 0; i < t.steps.size(); i++) {
+        const Step &s = t.steps[i];
+        if (ptr[s.slot] != NULL) {
+            heap.free(ptr[s.slot]);
+            ptr[s.slot] = NULL;
+        }
+        if (s.size > 0 && (ptr[s.slot] = heap.alloc(s.size)) == NULL) {
+            failed++;
+        }
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    report(name, t, elapsed, failed, heap.largest_free());
+}
+
+/* Returns the size of the largest block Heap_Alloc can hand out now */
+static size_t largest_free(mem_heap *heap) {
+    size_t lo = 0, hi = REGION;
+
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo + 1) / 2;
+        void *ptr = Heap_Alloc(heap, mid);
+        if (ptr != NULL) {
+            Heap_Free(heap, ptr);
+            lo = mid;
+        } else {
+            hi = mid - 1;
+        }
+    }
+    return lo;
+}
+
+/* Replays trace t on a heap from Heap_Create */
+static void run_mem(const char *name, int policy, const Trace &t) {
+    mem_opts opts = { policy };
+    mem_heap *heap = Heap_Create(REGION, &opts);
+    std::vector<void*> ptr(t.slots, (void*)NULL);
+    long failed = 0;
+
+    if (heap == NULL) {
+        exit(1);
+    }
+    uint64_t start = now_ns();
+    for (size_t i = 0; i < t.steps.size(); i++) {
+        const Step &s = t.steps[i];
+        if (ptr[s.slot] != NULL) {
+            Heap_Free(heap, ptr[s.slot]);
+            ptr[s.slot] = NULL;
+        }
+        if (s.size > 0 && (ptr[s.slot] = Heap_Alloc(heap, s.size)) == NULL) {
+            failed++;
+        }
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    report(name, t, elapsed, failed, largest_free(heap));
+    Heap_Destroy(heap);
+}
+
+#define RUN(fit, coalesce, layout, t) \
+    run<mem::Heap<mem::fit, mem::coalesce, mem::layout> >( \
+        #fit "/" #coalesce "/" #layout, t)
+
+int main(int argc, char *argv[]) {
+    long n = (argc > 1) ? atol(argv[1]) : 200000;
+    Trace traces[] = {
+        make_trace("small", 32768, 0, n),
+        make_trace("mixed", 4096, 10, n),
+    };
+
+    printf("%-7s %-30s %10s %8s %13s\n", "trace", "heap", "ns/step",
+           "failed", "largest free");
+    for (int i = 0; i < 2; i++) {
+        const Trace &t = traces[i];
+        RUN(FirstFit, Immediate, BoundaryTag, t);
+        RUN(FirstFit, Immediate, FullTag, t);
+        RUN(FirstFit, Deferred, BoundaryTag, t);
+        RUN(FirstFit, Deferred, FullTag, t);
+        RUN(NextFit, Immediate, BoundaryTag, t);
+        RUN(NextFit, Immediate, FullTag, t);
+        RUN(NextFit, Deferred, BoundaryTag, t);
+        RUN(NextFit, Deferred, FullTag, t);
+        RUN(BestFit, Immediate, BoundaryTag, t);
+        RUN(BestFit, Immediate, FullTag, t);
+        RUN(BestFit, Deferred, BoundaryTag, t);
+        RUN(BestFit, Deferred, FullTag, t);
+        run_mem("Heap_Create SEGLIST", MEM_POLICY_SEGLIST, t);
+        run_mem("Heap_Create TLSF", MEM_POLICY_TLSF, t);
+        fflush(stdout);
+    }
+    return 0;
+}
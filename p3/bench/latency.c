@@ -0,0 +1,105 @@
+/*
+ * Allocation latency against heap occupancy, for each free list policy
+ *
+ * The heap is filled with 'live' blocks of random size, every other one is
+ * freed to leave holes behind, and then each measured operation frees a
+ * random live block and allocates a new one in its slot. The latency of
+ * every Alloc_Mem call is recorded and the percentiles are printed.
+ *
+ * Usage: latency [ops]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "mem.h"
+#include "bench.h"
+
+#define REGION (128 << 20)
+#define MIN_SIZE 16
+#define MAX_SIZE 512
+
+static const int occupancy[] = { 1000, 10000, 50000, 100000, 200000 };
+static const struct { int policy; const char *name; } policies[] = {
+    { MEM_POLICY_SEGLIST, "seglist" },
+    { MEM_POLICY_TLSF, "tlsf" },
+};
+
+/* Runs one policy/occupancy pair, must be in a fresh process */
+static int run(int policy, const char *name, int live, int ops) {
+    mem_opts opts = { policy };
+    uint32_t seed = 12345;
+
+    if (Init_Mem_Opts(REGION, &opts) != 0) {
+        return 1;
+    }
+
+    void **ptr = malloc(sizeof(void*) * live * 2);
+    uint64_t *lat = malloc(sizeof(uint64_t) * ops);
+    if (ptr == NULL || lat == NULL) {
+        return 1;
+    }
+
+    for (int i = 0; i < live * 2; i++) {
+        ptr[i] = Alloc_Mem(rng_range(&seed, MIN_SIZE, MAX_SIZE));
+        if (ptr[i] == NULL) {
+            fprintf(stderr, "latency: heap too small for %d blocks\n", live);
+            return 1;
+        }
+    }
+    for (int i = 0; i < live; i++) { //keep the odd ones, leaving holes
+        Free_Mem(ptr[2 * i]);
+        ptr[i] = ptr[2 * i + 1];
+    }
+
+    for (int i = 0; i < ops; i++) {
+        int victim = rng_next(&seed) % live;
+        int size = rng_range(&seed, MIN_SIZE, MAX_SIZE);
+
+        Free_Mem(ptr[victim]);
+        uint64_t start = now_ns();
+        ptr[victim] = Alloc_Mem(size);
+        lat[i] = now_ns() - start;
+        if (ptr[victim] == NULL) {
+            fprintf(stderr, "latency: out of memory\n");
+            return 1;
+        }
+    }
+
+    sort_samples(lat, ops);
+    printf("%-8s %8d %8lu %8lu %8lu %8lu %8lu\n", name, live,
+           (unsigned long)percentile(lat, ops, 50),
+           (unsigned long)percentile(lat, ops, 99),
+           (unsigned long)percentile(lat, ops, 99.9),
+           (unsigned long)percentile(lat, ops, 99.99),
+           (unsigned long)lat[ops - 1]);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int ops = (argc > 1) ? atoi(argv[1]) : 200000;
+
+    printf("Alloc_Mem latency in ns, %d operations per row\n", ops);
+    printf("%-8s %8s %8s %8s %8s %8s %8s\n",
+           "policy", "live", "p50", "p99", "p999", "p9999", "max");
+    fflush(stdout);
+
+    for (int p = 0; p < (int)(sizeof(policies) / sizeof(policies[0])); p++) {
+        for (int o = 0; o < (int)(sizeof(occupancy) / sizeof(occupancy[0]));
+             o++) {
+            // Init_Mem only works once per process, so fork for each run
+            pid_t pid = fork();
+            if (pid == 0) {
+                exit(run(policies[p].policy, policies[p].name,
+                         occupancy[o], ops));
+            }
+            int status;
+            if (pid < 0 || waitpid(pid, &status, 0) < 0 ||
+                !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                fprintf(stderr, "latency: run failed\n");
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
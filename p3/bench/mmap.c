@@ -0,0 +1,136 @@
+/*
+ * Fragmentation of the heap under a mixed small/large workload, with and
+ * without giving large requests a mapping of their own (mmap_threshold)
+ *
+ * A fixed region is churned: a random slot is freed and allocated again,
+ * most of the time with a small size and sometimes with a large one, so
+ * large blocks come and go between long lived small ones. Once the live
+ * bytes reach the target a failed allocation means the free space is too
+ * fragmented to hold the request. Reported per threshold: failed small and
+ * large requests, the live bytes in the heap when the first request failed
+ * (as a percentage of the region, 100% means no fragmentation), the peak
+ * resident set and what stays resident after every block is freed.
+ *
+ * Usage: mmap [ops]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "mem.h"
+#include "bench.h"
+
+#define REGION (64 << 20)
+#define SLOTS 4096
+#define TARGET (REGION / 10 * 7) //live bytes the churn keeps around
+
+static const size_t thresholds[] = { 0, 1 << 20, 256 << 10, 64 << 10 };
+
+/* Returns the value in kB of 'key' in /proc/self/status */
+static long status_kb(const char *key) {
+    char line[128];
+    long kb = -1;
+    size_t len = strlen(key);
+    FILE *f = fopen("/proc/self/status", "r");
+
+    while (f != NULL && fgets(line, sizeof(line), f) != NULL) {
+        if (strncmp(line, key, len) == 0) {
+            kb = atol(line + len + 1);
+            break;
+        }
+    }
+    if (f != NULL) {
+        fclose(f);
+    }
+    return kb;
+}
+
+/* Runs one threshold, must be in a fresh process */
+static int run(size_t threshold, long ops) {
+    static char *slots[SLOTS];
+    static size_t sizes[SLOTS];
+    mem_opts opts = { 0 };
+    uint32_t rng = 2024;
+    size_t live = 0, heap_live = 0, live_at_fail = 0;
+    long failed_small = 0, failed_large = 0;
+
+    opts.mmap_threshold = threshold;
+    if (Init_Mem_Opts(REGION, &opts) != 0) {
+        return 1;
+    }
+    for (long i = 0; i < ops; i++) {
+        int s = rng_next(&rng) % SLOTS;
+        if (slots[s] != NULL) {
+            Free_Mem(slots[s]);
+            live -= sizes[s];
+            if (threshold == 0 || sizes[s] < threshold) {
+                heap_live -= sizes[s];
+            }
+            slots[s] = NULL;
+        }
+        size_t size = (rng_next(&rng) % 20 == 0)
+                      ? (size_t)rng_range(&rng, 64 << 10, 4 << 20)
+                      : (size_t)rng_range(&rng, 16, 1024);
+        if (live + size > TARGET) {
+            continue; //keep the live set bounded
+        }
+        slots[s] = Alloc_Mem(size);
+        if (slots[s] == NULL) {
+            if (failed_small + failed_large == 0) {
+                live_at_fail = heap_live;
+            }
+            if (size >= (64 << 10)) {
+                failed_large++;
+            } else {
+                failed_small++;
+            }
+            continue;
+        }
+        memset(slots[s], 1, size);
+        sizes[s] = size;
+        live += size;
+        if (threshold == 0 || size < threshold) {
+            heap_live += size;
+        }
+    }
+    long peak_kb = status_kb("VmHWM:");
+    for (int s = 0; s < SLOTS; s++) {
+        if (slots[s] != NULL) {
+            Free_Mem(slots[s]);
+        }
+    }
+
+    char first_fail[16] = "-";
+    if (failed_small + failed_large > 0) {
+        snprintf(first_fail, sizeof(first_fail), "%.1f%%",
+                 100.0 * live_at_fail / REGION);
+    }
+    printf("%10zu %10ld %10ld %12s %10ld %10ld\n", threshold >> 10,
+           failed_small, failed_large, first_fail, peak_kb >> 10,
+           status_kb("VmRSS:") >> 10);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    long ops = (argc > 1) ? atol(argv[1]) : 200000;
+
+    printf("%10s %10s %10s %12s %10s %10s\n", "thresh KB", "fail small",
+           "fail large", "heap at fail", "peak MB", "after MB");
+    fflush(stdout);
+    for (int t = 0; t < (int)(sizeof(thresholds) / sizeof(thresholds[0]));
+         t++) {
+        // Init_Mem only works once per process, so fork for each run
+        pid_t pid = fork();
+        if (pid == 0) {
+            exit(run(thresholds[t], ops));
+        }
+        int status;
+        if (pid < 0 || waitpid(pid, &status, 0) < 0 ||
+            !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "mmap: run failed\n");
+            return 1;
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,368 @@
+/*
+ * Multithreaded stress: how libmem scales with the number of threads
+ *
+ * local  - every thread churns its own slots: free a random one, allocate
+ *          a new block of random size for it
+ * xfree  - the threads form a ring, each allocates blocks and hands them
+ *          to the next thread, which frees them: every free is a free of
+ *          a block another thread allocated
+ * larson - as in Larson and Krishnan's server benchmark: every thread
+ *          churns slots it took over from a thread that exited, churns
+ *          them for a while and hands them on to a new thread in turn,
+ *          so blocks are freed by threads other than the one that
+ *          allocated them and threads keep coming and going
+ *
+ * Each workload runs for a fixed time with 1, 2, 4, ... threads, each run
+ * in a fresh process. Reported: the calls per second of all threads, the
+ * speedup over one thread, fairness (the calls of the slowest thread, or
+ * chain of larson threads, over those of the fastest; 1 is fair), the
+ * peak resident memory the run added and the blowup: that peak per thread
+ * over the peak of the run with one thread, as every thread keeps as many
+ * blocks live.
+ *
+ * -a native  Alloc_Mem and Free_Mem, with -h heaps (one per thread by
+ *            default)
+ * -a malloc  malloc and free, to measure libmemmalloc.so:
+ *            LD_PRELOAD=../libmemmalloc.so ./mtstress -a malloc
+ *            and the C library's malloc without LD_PRELOAD
+ *
+ * Usage: mtstress [-a native|malloc] [-w workload] [-t max threads]
+ *                 [-s seconds] [-h heaps]
+ */
+#include <fcntl.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "mem.h"
+#include "bench.h"
+
+#define REGION (256 << 20)
+#define SLOTS 2000 //live blocks per thread
+#define RING 1024
+#define LARSON_ROUNDS 10000 //calls of a larson thread before it hands off
+#define MAX_THREADS 256
+
+typedef struct worker {
+    int idx;
+    pthread_t tid;
+    uint32_t rng;
+    void *slot[SLOTS];
+    // xfree: blocks from the thread before this one in the ring
+    void *inbox[RING];
+    unsigned int head __attribute__((aligned(64))); //written by this one
+    unsigned int tail __attribute__((aligned(64))); //by the one before
+    long calls __attribute__((aligned(64)));
+} worker;
+
+static int use_malloc = 0;
+static int num_threads;
+static int stop = 0;
+static int chains_done = 0; //larson chains that saw 'stop'
+static worker *workers;
+
+static void* alloc(size_t size) {
+    char *ptr = use_malloc ? malloc(size) : Alloc_Mem(size);
+
+    if (ptr == NULL) {
+        fprintf(stderr, "mtstress: out of memory\n");
+        exit(1);
+    }
+    ptr[0] = 1;
+    return ptr;
+}
+
+static void release(void *ptr) {
+    if (use_malloc) {
+        free(ptr);
+    } else if (Free_Mem(ptr) != 0) {
+        fprintf(stderr, "mtstress: bad free\n");
+        exit(1);
+    }
+}
+
+/* Mostly small requests, one in ten up to 4 KiB */
+static size_t next_size(uint32_t *rng) {
+    return (rng_next(rng) % 10 == 0) ? rng_range(rng, 512, 4096)
+                                     : rng_range(rng, 16, 512);
+}
+
+static int stopped(void) {
+    return __atomic_load_n(&stop, __ATOMIC_RELAXED);
+}
+
+/* Frees a random slot of w and allocates a new block for it */
+static void churn_one(worker *w) {
+    int s = rng_next(&w->rng) % SLOTS;
+
+    if (w->slot[s] != NULL) {
+        release(w->slot[s]);
+    }
+    w->slot[s] = alloc(next_size(&w->rng));
+    w->calls += 2;
+}
+
+static void* local(void *arg) {
+    worker *w = arg;
+
+    while (!stopped()) {
+        churn_one(w);
+    }
+    return NULL;
+}
+
+/* Frees the blocks in the inbox of w, returns how many */
+static int drain(worker *w) {
+    unsigned int tail = __atomic_load_n(&w->tail, __ATOMIC_ACQUIRE);
+    int n = 0;
+
+    for (; w->head != tail; w->head++, n++) {
+        release(w->inbox[w->head % RING]);
+    }
+    __atomic_store_n(&w->head, tail, __ATOMIC_RELEASE);
+    w->calls += n;
+    return n;
+}
+
+static void* xfree(void *arg) {
+    worker *w = arg;
+    worker *next = &workers[(w->idx + 1) % num_threads];
+
+    while (!stopped()) {
+        void *ptr = alloc(next_size(&w->rng));
+        w->calls++;
+        while (next->tail - __atomic_load_n(&next->head, __ATOMIC_ACQUIRE)
+               == RING) {
+            if (drain(w) == 0) { //both full or the next one is slow
+                if (stopped()) {
+                    release(ptr);
+                    return NULL;
+                }
+                sched_yield();
+            }
+        }
+        next->inbox[next->tail % RING] = ptr;
+        __atomic_store_n(&next->tail, next->tail + 1, __ATOMIC_RELEASE);
+        drain(w);
+    }
+    return NULL;
+}
+
+static void* larson(void *arg) {
+    worker *w = arg;
+
+    for (int i = 0; i < LARSON_ROUNDS && !stopped(); i++) {
+        churn_one(w);
+    }
+    if (stopped()) {
+        __atomic_fetch_add(&chains_done, 1, __ATOMIC_RELEASE);
+        return NULL;
+    }
+    // hand the slots to a new thread and exit
+    pthread_attr_t attr;
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    if (pthread_create(&w->tid, &attr, larson, w) != 0) {
+        fprintf(stderr, "mtstress: can't create a thread\n");
+        exit(1);
+    }
+    pthread_attr_destroy(&attr);
+    return NULL;
+}
+
+static const struct {
+    const char *name;
+    void* (*run)(void*);
+} workloads[] = {
+    { "local", local },
+    { "xfree", xfree },
+    { "larson", larson },
+};
+
+/* Returns the peak resident memory in bytes, 0 if the kernel can't tell */
+static size_t peak_rss(void) {
+    char line[128];
+    size_t kb = 0;
+    FILE *f = fopen("/proc/self/status", "r");
+
+    if (f != NULL) {
+        while (fgets(line, sizeof(line), f) != NULL) {
+            if (sscanf(line, "VmHWM: %zu kB", &kb) == 1) {
+                break;
+            }
+        }
+        fclose(f);
+    }
+    return kb << 10;
+}
+
+/* Returns the resident memory in bytes */
+static size_t rss(void) {
+    long pages = 0, resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+
+    if (f != NULL) {
+        if (fscanf(f, "%ld %ld", &pages, &resident) != 2) {
+            resident = 0;
+        }
+        fclose(f);
+    }
+    return (size_t)resident * getpagesize();
+}
+
+typedef struct result {
+    double mops;
+    double fairness;
+    double peak_mb;
+} result;
+
+/* Runs workload wl on n threads, must be in a fresh process */
+static int run(int wl, int n, int nheaps, double secs, result *r) {
+    num_threads = n;
+    workers = calloc(n, sizeof(worker));
+    if (workers == NULL) {
+        return 1;
+    }
+    if (!use_malloc) {
+        mem_opts opts = { MEM_POLICY_SEGLIST };
+        opts.nheaps = (nheaps > 0) ? nheaps : n;
+        opts.grow_chunk = REGION;
+        if (Init_Mem_Opts(REGION, &opts) != 0) {
+            return 1;
+        }
+    }
+    int fd = open("/proc/self/clear_refs", O_WRONLY);
+    int have_peak = (fd >= 0 && write(fd, "5", 1) == 1); //reset the peak
+    if (fd >= 0) {
+        close(fd);
+    }
+    size_t base = rss();
+
+    for (int i = 0; i < n; i++) {
+        workers[i].idx = i;
+        workers[i].rng = 2654435761u * (i + 1);
+    }
+    uint64_t start = now_ns();
+    for (int i = 0; i < n; i++) {
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        if (workloads[wl].run == larson) {
+            pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        }
+        if (pthread_create(&workers[i].tid, &attr, workloads[wl].run,
+                           &workers[i]) != 0) {
+            return 1;
+        }
+        pthread_attr_destroy(&attr);
+    }
+    usleep((useconds_t)(secs * 1e6));
+    __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+    if (workloads[wl].run == larson) {
+        while (__atomic_load_n(&chains_done, __ATOMIC_ACQUIRE) < n) {
+            usleep(1000);
+        }
+    } else {
+        for (int i = 0; i < n; i++) {
+            pthread_join(workers[i].tid, NULL);
+        }
+    }
+    double elapsed = (now_ns() - start) / 1e9;
+
+    long total = 0, least = -1, most = 0;
+    for (int i = 0; i < n; i++) {
+        long calls = workers[i].calls;
+        total += calls;
+        least = (least < 0 || calls < least) ? calls : least;
+        most = (calls > most) ? calls : most;
+    }
+    size_t peak = have_peak ? peak_rss() : rss();
+    r->mops = total / elapsed / 1e6;
+    r->fairness = (most > 0) ? (double)least / most : 0;
+    r->peak_mb = (peak > base) ? (peak - base) / 1048576.0 : 0;
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    int max_threads = (ncpu > 4) ? ncpu : 4;
+    const char *only = NULL;
+    double secs = 1;
+    int nheaps = 0;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "a:w:t:s:h:")) != -1) {
+        switch (opt) {
+        case 'a': use_malloc = (strcmp(optarg, "malloc") == 0); break;
+        case 'w': only = optarg; break;
+        case 't': max_threads = atoi(optarg); break;
+        case 's': secs = atof(optarg); break;
+        case 'h': nheaps = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: mtstress [-a native|malloc] [-w workload]"
+                    " [-t max threads] [-s seconds] [-h heaps]\n");
+            return 2;
+        }
+    }
+    if (max_threads < 1 || max_threads > MAX_THREADS) {
+        max_threads = MAX_THREADS;
+    }
+
+    const char *preload = getenv("LD_PRELOAD");
+    printf("%s, %.1f s per run\n", use_malloc
+           ? ((preload != NULL && *preload != '\0') ? preload : "malloc")
+           : "Alloc_Mem/Free_Mem", secs);
+    printf("%-8s %8s %10s %8s %9s %9s %7s\n", "workload", "threads",
+           "Mcalls/s", "speedup", "fairness", "peak MB", "blowup");
+    fflush(stdout);
+
+    for (int wl = 0; wl < (int)(sizeof(workloads) / sizeof(workloads[0]));
+         wl++) {
+        if (only != NULL && strcmp(only, workloads[wl].name) != 0) {
+            continue;
+        }
+        result one = { 0 };
+        for (int n = 1; n <= max_threads; n = (n * 2 <= max_threads ||
+                                               n == max_threads)
+                                              ? n * 2 : max_threads) {
+            result r;
+            int fds[2];
+            // Init_Mem only works once per process, so fork for each run;
+            // the result comes back through a pipe
+            if (pipe(fds) != 0) {
+                return 1;
+            }
+            fflush(NULL);
+            pid_t pid = fork();
+            if (pid == 0) {
+                close(fds[0]);
+                int ret = run(wl, n, nheaps, secs, &r);
+                if (ret == 0 && write(fds[1], &r, sizeof(r)) != sizeof(r)) {
+                    ret = 1;
+                }
+                _exit(ret); //larson threads may still be on their way out
+            }
+            close(fds[1]);
+            int status;
+            int got = (pid > 0) && read(fds[0], &r, sizeof(r)) == sizeof(r);
+            close(fds[0]);
+            if (pid < 0 || waitpid(pid, &status, 0) < 0 || !got ||
+                !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                fprintf(stderr, "mtstress: run failed\n");
+                return 1;
+            }
+            if (n == 1) {
+                one = r;
+            }
+            printf("%-8s %8d %10.2f %8.2f %9.2f %9.2f %7.2f\n",
+                   workloads[wl].name, n, r.mops,
+                   (one.mops > 0) ? r.mops / one.mops : 0, r.fairness,
+                   r.peak_mb, (one.peak_mb > 0) ? r.peak_mb / n / one.peak_mb
+                                                : 0);
+            fflush(stdout);
+        }
+    }
+    return 0;
+}
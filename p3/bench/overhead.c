@@ -0,0 +1,57 @@
+/*
+ * Memory overhead of the block layout, per request size
+ *
+ * A fresh heap is filled with blocks of one size until it is full, and the
+ * bytes each block took out of the heap are compared with the bytes asked
+ * for. Build with BITS=32 and BITS=64 to compare the 4 byte header and
+ * 8 byte alignment of a 32-bit build with the 8 byte header and 16 byte
+ * alignment of a 64-bit build. The same is done with slabs (mem_opts.slab)
+ * for the sizes they serve.
+ *
+ * Usage: overhead
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include "mem.h"
+
+#define REGION (4 << 20)
+
+static const int sizes[] = { 1, 8, 12, 16, 24, 32, 48, 64, 100, 128, 256,
+                             1000, 4096 };
+
+/* Returns how many blocks of 'size' bytes fit in a fresh heap */
+static long fill(int size, const mem_opts *opts) {
+    mem_heap *h = Heap_Create(REGION, opts);
+    long blocks = 0;
+
+    if (h == NULL) {
+        exit(1);
+    }
+    while (Heap_Alloc(h, size) != NULL) {
+        blocks++;
+    }
+    Heap_Destroy(h);
+    return blocks;
+}
+
+int main(void) {
+    mem_opts slab_opts = { 0 };
+    slab_opts.slab = 1;
+
+    printf("%d-bit build\n", (int)(8 * sizeof(size_t)));
+    printf("%8s %10s %12s %10s %12s %10s\n", "size", "blocks", "bytes/block",
+           "overhead", "slab b/blk", "slab ovh");
+
+    for (unsigned int i = 0; i < sizeof(sizes) / sizeof(sizes[0]); i++) {
+        double per_block = (double)REGION / fill(sizes[i], NULL);
+        printf("%8d %10ld %12.1f %9.1f%%", sizes[i], (long)(REGION / per_block),
+               per_block, 100.0 * (per_block - sizes[i]) / sizes[i]);
+        if (sizes[i] <= 64) {
+            double per_slot = (double)REGION / fill(sizes[i], &slab_opts);
+            printf(" %12.1f %9.1f%%", per_slot,
+                   100.0 * (per_slot - sizes[i]) / sizes[i]);
+        }
+        printf("\n");
+    }
+    return 0;
+}
@@ -0,0 +1,141 @@
+/*
+ * Page faults and allocation throughput for each way of mapping the region
+ *
+ * For each set of MEM_MAP_ flags a fresh process maps the region with
+ * Init_Mem_Opts, fills it with blocks of random sizes, writing the first
+ * word of each (first touch), and then churns: a random block is freed and
+ * allocated again and a word of it written, so the accesses hit pages all
+ * over the region and stress the TLB. The minor faults of Init_Mem_Opts,
+ * of the fill and of the churn are reported with the throughput of the
+ * last two, along with the transparent huge pages backing the process.
+ * Mappings the system refuses (no reserved huge pages, RLIMIT_MEMLOCK too
+ * low for MEM_MAP_LOCK) are reported as failed.
+ *
+ * Usage: pagefault [region MB] [churn ops]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "mem.h"
+#include "bench.h"
+
+#define MAX_BLOCKS (1 << 20)
+
+static const struct {
+    const char *name;
+    int flags;
+} configs[] = {
+    { "default", 0 },
+    { "thp", MEM_MAP_THP },
+    { "hugetlb", MEM_MAP_HUGETLB },
+    { "populate", MEM_MAP_POPULATE },
+    { "thp+populate", MEM_MAP_THP | MEM_MAP_POPULATE },
+    { "lock", MEM_MAP_LOCK },
+};
+
+/* Returns the minor faults the process took so far */
+static long minor_faults(void) {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_minflt;
+}
+
+/* Returns the kB of transparent huge pages the process has, -1 if unknown */
+static long thp_kb(void) {
+    char line[128];
+    long kb = -1;
+    FILE *f = fopen("/proc/self/smaps_rollup", "r");
+
+    while (f != NULL && fgets(line, sizeof(line), f) != NULL) {
+        if (sscanf(line, "AnonHugePages: %ld kB", &kb) == 1) {
+            break;
+        }
+    }
+    if (f != NULL) {
+        fclose(f);
+    }
+    return kb;
+}
+
+/* Runs one configuration, must be in a fresh process */
+static int run(int c, size_t region, long ops) {
+    static long *blocks[MAX_BLOCKS];
+    static int sizes[MAX_BLOCKS];
+    mem_opts opts = { 0 };
+    uint32_t rng = 12345;
+    int n = 0;
+
+    opts.map_flags = configs[c].flags;
+    long faults = minor_faults();
+    uint64_t start = now_ns();
+    if (Init_Mem_Opts(region, &opts) != 0) {
+        printf("%-13s %10s\n", configs[c].name, "failed");
+        return 0;
+    }
+    uint64_t init_ns = now_ns() - start;
+    long init_faults = minor_faults() - faults;
+
+    // fill three quarters of the region, each block touched once
+    faults = minor_faults();
+    start = now_ns();
+    for (size_t used = 0; n < MAX_BLOCKS && used < region / 4 * 3; n++) {
+        sizes[n] = rng_range(&rng, 16, 4096);
+        blocks[n] = Alloc_Mem(sizes[n]);
+        if (blocks[n] == NULL) {
+            break;
+        }
+        blocks[n][0] = n;
+        used += sizes[n];
+    }
+    uint64_t fill_ns = now_ns() - start;
+    long fill_faults = minor_faults() - faults;
+
+    faults = minor_faults();
+    start = now_ns();
+    for (long i = 0; i < ops; i++) {
+        int b = rng_next(&rng) % n;
+        Free_Mem(blocks[b]);
+        blocks[b] = Alloc_Mem(sizes[b]);
+        if (blocks[b] == NULL) {
+            fprintf(stderr, "pagefault: out of memory\n");
+            return 1;
+        }
+        blocks[b][sizes[b] / sizeof(long) / 2] = i;
+    }
+    uint64_t churn_ns = now_ns() - start;
+    long churn_faults = minor_faults() - faults;
+
+    printf("%-13s %8.1f %8ld %8ld %10.2f %8ld %10.2f %8ld\n",
+           configs[c].name, init_ns / 1e6, init_faults, fill_faults,
+           n / (fill_ns / 1e9) / 1e6, churn_faults,
+           ops / (churn_ns / 1e9) / 1e6, thp_kb() >> 10);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    size_t region = (size_t)((argc > 1) ? atoi(argv[1]) : 256) << 20;
+    long ops = (argc > 2) ? atol(argv[2]) : 2000000;
+
+    printf("%-13s %8s %8s %8s %10s %8s %10s %8s\n", "mapping", "init ms",
+           "init flt", "fill flt", "fill M/s", "churn flt", "churn M/s",
+           "THP MB");
+    fflush(stdout);
+    for (int c = 0; c < (int)(sizeof(configs) / sizeof(configs[0])); c++) {
+        // Init_Mem only works once per process, so fork for each run
+        pid_t pid = fork();
+        if (pid == 0) {
+            exit(run(c, region, ops));
+        }
+        int status;
+        if (pid < 0 || waitpid(pid, &status, 0) < 0 ||
+            !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "pagefault: run failed\n");
+            return 1;
+        }
+        fflush(stdout);
+    }
+    return 0;
+}
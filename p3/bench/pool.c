@@ -0,0 +1,96 @@
+/*
+ * Fixed-size churn, Pool_Alloc/Pool_Free against Alloc_Mem/Free_Mem
+ *
+ * For each object size 'live' objects are allocated, then every operation
+ * frees a random one and allocates a new one in its slot. The average time
+ * of such a pair is reported for a pool, for Alloc_Mem/Free_Mem with and
+ * without slabs (slabs only serve up to 64 bytes) and for glibc malloc.
+ *
+ * Usage: pool [live] [ops]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "mem.h"
+#include "bench.h"
+
+#define REGION (256 << 20)
+
+static const int sizes[] = { 16, 48, 64, 128, 256, 1024 };
+
+enum { POOL, ALLOC_MEM, ALLOC_MEM_SLAB, MALLOC, MODES };
+static const char *mode_names[] = { "Pool_Alloc", "Alloc_Mem", "Alloc_Mem+slab",
+                                    "malloc" };
+
+/* Runs one mode for one size, must be in a fresh process */
+static int run(int mode, int size, int live, long ops) {
+    mem_opts opts = { 0 };
+    mem_pool *pool = NULL;
+    uint32_t seed = 4242;
+
+    opts.slab = (mode == ALLOC_MEM_SLAB);
+    if (Init_Mem_Opts(REGION, &opts) != 0) {
+        return 1;
+    }
+    if (mode == POOL && (pool = Pool_Create(size, 0)) == NULL) {
+        return 1;
+    }
+    void **ptr = malloc(sizeof(void*) * live);
+    if (ptr == NULL) {
+        return 1;
+    }
+
+    for (int i = 0; i < live; i++) {
+        ptr[i] = (mode == POOL) ? Pool_Alloc(pool)
+               : (mode == MALLOC) ? malloc(size) : Alloc_Mem(size);
+        if (ptr[i] == NULL) {
+            fprintf(stderr, "pool: out of memory\n");
+            return 1;
+        }
+    }
+
+    uint64_t start = now_ns();
+    for (long i = 0; i < ops; i++) {
+        int victim = rng_next(&seed) % live;
+        if (mode == POOL) {
+            Pool_Free(pool, ptr[victim]);
+            ptr[victim] = Pool_Alloc(pool);
+        } else if (mode == MALLOC) {
+            free(ptr[victim]);
+            ptr[victim] = malloc(size);
+        } else {
+            Free_Mem(ptr[victim]);
+            ptr[victim] = Alloc_Mem(size);
+        }
+        *(char*)ptr[victim] = (char)i;
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    printf("%-15s %6d %10.1f\n", mode_names[mode], size, (double)elapsed / ops);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int live = (argc > 1) ? atoi(argv[1]) : 100000;
+    long ops = (argc > 2) ? atol(argv[2]) : 5000000;
+
+    printf("%-15s %6s %10s\n", "mode", "size", "ns/pair");
+    fflush(stdout);
+    for (int s = 0; s < (int)(sizeof(sizes) / sizeof(sizes[0])); s++) {
+        for (int mode = 0; mode < MODES; mode++) {
+            // Init_Mem only works once per process, so fork for each run
+            pid_t pid = fork();
+            if (pid == 0) {
+                exit(run(mode, sizes[s], live, ops));
+            }
+            int status;
+            if (pid < 0 || waitpid(pid, &status, 0) < 0 ||
+                !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                fprintf(stderr, "pool: run failed\n");
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
@@ -0,0 +1,119 @@
+/*
+ * Producer/consumer throughput: blocks allocated by one thread and freed
+ * by another
+ *
+ * Each producer allocates blocks and hands them to its consumer over a
+ * single producer single consumer ring, the consumer touches and frees
+ * them. With one heap every free goes to the heap the blocks came from
+ * under its lock (or the consumer's cache); with a heap per thread the
+ * consumer's frees are remote frees that the producer drains in batches.
+ *
+ * Usage: prodcons [pairs] [blocks per producer]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "mem.h"
+#include "bench.h"
+
+#define REGION (256 << 20)
+#define RING 1024
+
+typedef struct ring {
+    void *slot[RING];
+    unsigned int head __attribute__((aligned(64))); //written by consumer
+    unsigned int tail __attribute__((aligned(64))); //written by producer
+} ring;
+
+static long blocks;
+
+static void* producer(void *arg) {
+    ring *r = arg;
+    uint32_t seed = (uint32_t)(uintptr_t)arg | 1;
+
+    for (long i = 0; i < blocks; i++) {
+        char *p = Alloc_Mem(rng_range(&seed, 16, 256));
+        if (p == NULL) {
+            fprintf(stderr, "prodcons: out of memory\n");
+            exit(1);
+        }
+        p[0] = 1;
+        while (r->tail - __atomic_load_n(&r->head, __ATOMIC_ACQUIRE) == RING) {
+            sched_yield();
+        }
+        r->slot[r->tail % RING] = p;
+        __atomic_store_n(&r->tail, r->tail + 1, __ATOMIC_RELEASE);
+    }
+    return NULL;
+}
+
+static void* consumer(void *arg) {
+    ring *r = arg;
+
+    for (long i = 0; i < blocks; i++) {
+        while (__atomic_load_n(&r->tail, __ATOMIC_ACQUIRE) == r->head) {
+            sched_yield();
+        }
+        char *p = r->slot[r->head % RING];
+        __atomic_store_n(&r->head, r->head + 1, __ATOMIC_RELEASE);
+        if (p[0] != 1 || Free_Mem(p) != 0) {
+            fprintf(stderr, "prodcons: bad block\n");
+            exit(1);
+        }
+    }
+    return NULL;
+}
+
+/* Runs one configuration, must be in a fresh process */
+static int run(int pairs, int nheaps) {
+    mem_opts opts = { MEM_POLICY_SEGLIST, nheaps };
+    pthread_t *tid = malloc(sizeof(pthread_t) * pairs * 2);
+    ring *rings = calloc(pairs, sizeof(ring));
+
+    if (Init_Mem_Opts(REGION, &opts) != 0 || tid == NULL || rings == NULL) {
+        return 1;
+    }
+
+    uint64_t start = now_ns();
+    for (int i = 0; i < pairs; i++) {
+        pthread_create(&tid[2 * i], NULL, producer, &rings[i]);
+        pthread_create(&tid[2 * i + 1], NULL, consumer, &rings[i]);
+    }
+    for (int i = 0; i < pairs * 2; i++) {
+        pthread_join(tid[i], NULL);
+    }
+    double secs = (now_ns() - start) / 1e9;
+
+    printf("%6d %7d %12.2f %10.1f\n", pairs, nheaps,
+           pairs * blocks / secs / 1e6, secs * 1e9 / blocks);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int max_pairs = (argc > 1) ? atoi(argv[1]) : 4;
+    blocks = (argc > 2) ? atol(argv[2]) : 1000000;
+
+    printf("%ld blocks per producer\n", blocks);
+    printf("%6s %7s %12s %10s\n", "pairs", "heaps", "Mblocks/s", "ns/block");
+    fflush(stdout);
+
+    for (int pairs = 1; pairs <= max_pairs; pairs *= 2) {
+        int configs[2] = { 1, pairs * 2 };
+        for (int c = 0; c < 2; c++) {
+            // Init_Mem only works once per process, so fork for each run
+            pid_t pid = fork();
+            if (pid == 0) {
+                exit(run(pairs, configs[c]));
+            }
+            int status;
+            if (pid < 0 || waitpid(pid, &status, 0) < 0 ||
+                !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                fprintf(stderr, "prodcons: run failed\n");
+                return 1;
+            }
+        }
+    }
+    return 0;
+}
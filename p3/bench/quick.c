@@ -0,0 +1,102 @@
+/*
+ * Free/allocate ping-pong, coalescing at once against quick lists
+ *
+ * The heap is filled with blocks of random size, every other one is freed
+ * to leave holes behind, and then each operation frees a random live block
+ * and allocates one of the same size again. With eager coalescing the free
+ * merges the block with its free neighbours and the allocation splits it
+ * off again; with quick_max the block waits on its quick list and is taken
+ * straight back. Sizes stay above the thread cache so every operation goes
+ * to the heap. The average time of a pair is reported.
+ *
+ * Usage: quick [live] [ops]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "mem.h"
+#include "bench.h"
+
+#define REGION (256 << 20)
+
+static const int max_sizes[] = { 128, 512, 1024 };
+static const struct { int policy; const char *name; } policies[] = {
+    { MEM_POLICY_SEGLIST, "seglist" },
+    { MEM_POLICY_TLSF, "tlsf" },
+};
+
+/* Runs one configuration, must be in a fresh process */
+static int run(int policy, const char *name, size_t quick_max, int max_size,
+               int live, long ops) {
+    mem_opts opts = { policy };
+    uint32_t seed = 8086;
+
+    opts.quick_max = quick_max;
+    if (Init_Mem_Opts(REGION, &opts) != 0) {
+        return 1;
+    }
+    void **ptr = malloc(sizeof(void*) * live * 2);
+    int *size = malloc(sizeof(int) * live * 2);
+    if (ptr == NULL || size == NULL) {
+        return 1;
+    }
+
+    for (int i = 0; i < live * 2; i++) {
+        size[i] = rng_range(&seed, 72, max_size);
+        ptr[i] = Alloc_Mem(size[i]);
+        if (ptr[i] == NULL) {
+            fprintf(stderr, "quick: heap too small for %d blocks\n", live);
+            return 1;
+        }
+    }
+    for (int i = 0; i < live; i++) { //keep the odd ones, leaving holes
+        Free_Mem(ptr[2 * i]);
+        ptr[i] = ptr[2 * i + 1];
+        size[i] = size[2 * i + 1];
+    }
+
+    uint64_t start = now_ns();
+    for (long i = 0; i < ops; i++) {
+        int victim = rng_next(&seed) % live;
+        Free_Mem(ptr[victim]);
+        ptr[victim] = Alloc_Mem(size[victim]);
+        if (ptr[victim] == NULL) {
+            fprintf(stderr, "quick: out of memory\n");
+            return 1;
+        }
+    }
+    uint64_t elapsed = now_ns() - start;
+
+    printf("%-8s %8zu %8d %10.1f\n", name, quick_max, max_size,
+           (double)elapsed / ops);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    int live = (argc > 1) ? atoi(argv[1]) : 100000;
+    long ops = (argc > 2) ? atol(argv[2]) : 5000000;
+
+    printf("%-8s %8s %8s %10s\n", "policy", "quick", "max size", "ns/pair");
+    fflush(stdout);
+    for (int p = 0; p < (int)(sizeof(policies) / sizeof(policies[0])); p++) {
+        for (int s = 0; s < (int)(sizeof(max_sizes) / sizeof(max_sizes[0]));
+             s++) {
+            for (int quick = 0; quick < 2; quick++) {
+                // Init_Mem only works once per process, so fork for each run
+                pid_t pid = fork();
+                if (pid == 0) {
+                    exit(run(policies[p].policy, policies[p].name,
+                             quick ? 1024 : 0, max_sizes[s], live, ops));
+                }
+                int status;
+                if (pid < 0 || waitpid(pid, &status, 0) < 0 ||
+                    !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                    fprintf(stderr, "quick: run failed\n");
+                    return 1;
+                }
+            }
+        }
+    }
+    return 0;
+}
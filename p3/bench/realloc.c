@@ -0,0 +1,98 @@
+/*
+ * Append-style growth of buffers, Realloc_Mem against alloc+copy+free
+ *
+ * 'buffers' buffers are grown round robin by 'step' bytes at a time until
+ * each holds 'max' bytes, then all are freed, 'rounds' times over. Every
+ * append writes the new bytes. With one buffer the block after it is
+ * mostly free and Realloc_Mem grows in place; with several they get in
+ * each other's way and some growth has to move. glibc realloc is measured
+ * the same way for reference.
+ *
+ * Usage: realloc [max buffers] [max bytes] [step] [rounds]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mem.h"
+#include "bench.h"
+
+#define REGION (256 << 20)
+
+enum { MODE_REALLOC, MODE_COPY, MODE_LIBC };
+static const char *mode_names[] = { "Realloc_Mem", "alloc+copy", "realloc" };
+
+/* Grows one buffer by 'step' bytes in the given mode, counting moves */
+static char* grow(int mode, char *buf, int len, int step, long *moves) {
+    char *next = NULL;
+
+    if (mode == MODE_REALLOC) {
+        next = Realloc_Mem(buf, len + step);
+    } else if (mode == MODE_LIBC) {
+        next = realloc(buf, len + step);
+    } else {
+        next = Alloc_Mem(len + step);
+        if (next != NULL && buf != NULL) {
+            memcpy(next, buf, len);
+            Free_Mem(buf);
+        }
+    }
+    if (next == NULL) {
+        fprintf(stderr, "realloc: out of memory\n");
+        exit(1);
+    }
+    if (next != buf && buf != NULL) {
+        (*moves)++;
+    }
+    memset(next + len, (char)len, step);
+    return next;
+}
+
+static void run(int mode, int buffers, int max, int step, int rounds) {
+    char **buf = calloc(buffers, sizeof(char*));
+    long appends = 0;
+    long moves = 0;
+
+    uint64_t start = now_ns();
+    for (int r = 0; r < rounds; r++) {
+        for (int len = 0; len < max; len += step) {
+            for (int b = 0; b < buffers; b++) {
+                buf[b] = grow(mode, buf[b], len, step, &moves);
+                appends++;
+            }
+        }
+        for (int b = 0; b < buffers; b++) {
+            if (mode == MODE_LIBC) {
+                free(buf[b]);
+            } else {
+                Free_Mem(buf[b]);
+            }
+            buf[b] = NULL;
+        }
+    }
+    double ns = (double)(now_ns() - start) / appends;
+
+    printf("%-12s %8d %10.1f %9.1f%%\n", mode_names[mode], buffers, ns,
+           100.0 * moves / appends);
+    free(buf);
+}
+
+int main(int argc, char *argv[]) {
+    int max_buffers = (argc > 1) ? atoi(argv[1]) : 16;
+    int max = (argc > 2) ? atoi(argv[2]) : 64 << 10;
+    int step = (argc > 3) ? atoi(argv[3]) : 64;
+    int rounds = (argc > 4) ? atoi(argv[4]) : 20;
+
+    if (Init_Mem(REGION) != 0) {
+        return 1;
+    }
+
+    printf("buffers grown to %d bytes, %d bytes per append, %d rounds\n",
+           max, step, rounds);
+    printf("%-12s %8s %10s %10s\n", "mode", "buffers", "ns/append", "moved");
+    for (int buffers = 1; buffers <= max_buffers; buffers *= 4) {
+        for (int mode = MODE_REALLOC; mode <= MODE_LIBC; mode++) {
+            run(mode, buffers, max, step, rounds);
+        }
+    }
+    return 0;
+}
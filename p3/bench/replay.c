@@ -0,0 +1,465 @@
+/*
+ * Replays a trace recorded with Trace_Mem_Start (or LIBMEM_TRACE under
+ * libmemmalloc.so) on libmem and on the C library's malloc
+ *
+ * The trace is loaded and prepared before anything is timed: the records
+ * of all threads are merged in time order and every block address is
+ * turned into a dense id, so the replay itself is a tight loop over an
+ * array of ops that keeps the blocks in an array indexed by id. All calls
+ * are replayed on one thread. Every allocated block has its first byte
+ * written. Each allocator runs in a fresh process.
+ *
+ * Reported per allocator, at 20 points through the trace: the bytes the
+ * program had asked for and not freed yet (live), the resident memory
+ * the replay added (footprint), live as a percentage of it, and for
+ * libmem the fragmentation ratio of Get_Mem_Stats. Live can be above 100%
+ * as only the pages a block was written to count. At the end: calls per
+ * second, the peak footprint and the calls that failed in the replay.
+ * Calls that failed when the trace was recorded are not replayed.
+ *
+ * Usage: replay [-a libmem|glibc] [-p policy] [-r region MB] trace
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "mem.h"
+#include "bench.h"
+
+#define SAMPLES 20
+
+/* One call of the trace, ready to replay */
+typedef struct op {
+    uint32_t id; //of the block
+    uint32_t size;
+    uint8_t kind; //MEM_TRACE_ value
+    uint8_t align;
+} op;
+
+typedef struct allocator {
+    const char *name;
+    void* (*alloc)(size_t size);
+    void* (*aligned)(size_t size, size_t alignment);
+    void* (*calloc)(size_t nmemb, size_t size);
+    void* (*realloc)(void *ptr, size_t size);
+    void (*free)(void *ptr);
+} allocator;
+
+static void* glibc_aligned(size_t size, size_t alignment) {
+    void *ptr;
+    if (alignment < sizeof(void*)) {
+        alignment = sizeof(void*);
+    }
+    return (posix_memalign(&ptr, alignment, size) == 0) ? ptr : NULL;
+}
+
+static void mem_free(void *ptr) {
+    Free_Mem(ptr);
+}
+
+static const allocator allocators[] = {
+    { "libmem", Alloc_Mem, Alloc_Mem_Aligned, Calloc_Mem, Realloc_Mem,
+      mem_free },
+    { "glibc", malloc, glibc_aligned, calloc, realloc, free },
+};
+
+static op *ops;
+static long num_ops;
+static uint32_t num_ids;
+static long out_of_order; //calls on a block the trace never allocated
+
+/*
+ * Addresses of the live blocks of the trace and their ids, an open
+ * addressing table with linear probing
+ */
+static struct {
+    uint64_t *addr;
+    uint32_t *id;
+    size_t cap; //a power of two
+    size_t used;
+} live;
+
+static size_t slot_of(uint64_t addr) {
+    return (size_t)((addr >> 4) * 0x9e3779b97f4a7c15ull) & (live.cap - 1);
+}
+
+static void live_put(uint64_t addr, uint32_t id);
+
+static void live_grow(void) {
+    uint64_t *addr = live.addr;
+    uint32_t *id = live.id;
+    size_t cap = live.cap;
+
+    live.cap = (cap > 0) ? cap * 2 : 1024;
+    live.addr = calloc(live.cap, sizeof(uint64_t));
+    live.id = malloc(live.cap * sizeof(uint32_t));
+    if (live.addr == NULL || live.id == NULL) {
+        fprintf(stderr, "replay: out of memory\n");
+        exit(1);
+    }
+    live.used = 0;
+    for (size_t i = 0; i < cap; i++) {
+        if (addr[i] != 0) {
+            live_put(addr[i], id[i]);
+        }
+    }
+    free(addr);
+    free(id);
+}
+
+/* Maps addr to id, replacing what it was mapped to */
+static void live_put(uint64_t addr, uint32_t id) {
+    if (2 * (live.used + 1) > live.cap) {
+        live_grow();
+    }
+    size_t i = slot_of(addr);
+    while (live.addr[i] != 0 && live.addr[i] != addr) {
+        i = (i + 1) & (live.cap - 1);
+    }
+    if (live.addr[i] == 0) {
+        live.used++;
+    } else {
+        out_of_order++; //handed out again before it was freed
+    }
+    live.addr[i] = addr;
+    live.id[i] = id;
+}
+
+/* Unmaps addr, returns its id or -1 if it was not mapped */
+static long live_take(uint64_t addr) {
+    if (live.cap == 0) {
+        return -1;
+    }
+    size_t i = slot_of(addr);
+    while (live.addr[i] != addr) {
+        if (live.addr[i] == 0) {
+            return -1;
+        }
+        i = (i + 1) & (live.cap - 1);
+    }
+    long id = live.id[i];
+
+    // shift the entries after it back so no probe sequence has a gap
+    size_t j = i;
+    for (;;) {
+        live.addr[i] = 0;
+        for (;;) {
+            j = (j + 1) & (live.cap - 1);
+            if (live.addr[j] == 0) {
+                live.used--;
+                return id;
+            }
+            size_t home = slot_of(live.addr[j]);
+            int between = (i <= j) ? (home > i && home <= j)
+                                   : (home > i || home <= j);
+            if (!between) { //its probe sequence passes i
+                break;
+            }
+        }
+        live.addr[i] = live.addr[j];
+        live.id[i] = live.id[j];
+        i = j;
+    }
+}
+
+/* Sorts n records by time, keeping the order of records of equal time */
+static void sort_by_time(mem_trace_rec *recs, long n) {
+    mem_trace_rec *tmp = malloc(n * sizeof(mem_trace_rec));
+    mem_trace_rec *from = recs, *to = tmp;
+
+    if (tmp == NULL) {
+        fprintf(stderr, "replay: out of memory\n");
+        exit(1);
+    }
+    for (long width = 1; width < n; width *= 2) {
+        for (long lo = 0; lo < n; lo += 2 * width) {
+            long mid = (lo + width < n) ? lo + width : n;
+            long hi = (lo + 2 * width < n) ? lo + 2 * width : n;
+            long a = lo, b = mid, k = lo;
+            while (a < mid && b < hi) {
+                to[k++] = (from[b].time < from[a].time) ? from[b++]
+                                                        : from[a++];
+            }
+            while (a < mid) {
+                to[k++] = from[a++];
+            }
+            while (b < hi) {
+                to[k++] = from[b++];
+            }
+        }
+        mem_trace_rec *t = from;
+        from = to;
+        to = t;
+    }
+    if (from != recs) {
+        memcpy(recs, from, n * sizeof(mem_trace_rec));
+    }
+    free(tmp);
+}
+
+/*
+ * Reads the trace at 'path' into ops
+ * Returns 0 on success and -1 on failure
+ */
+static int load(const char *path) {
+    mem_trace_hdr hdr;
+    struct stat st;
+    int threads = 0;
+    FILE *f = fopen(path, "rb");
+
+    if (f == NULL || fstat(fileno(f), &st) != 0) {
+        perror(path);
+        return -1;
+    }
+    if (fread(&hdr, sizeof(hdr), 1, f) != 1 ||
+        memcmp(hdr.magic, MEM_TRACE_MAGIC, sizeof(hdr.magic)) != 0 ||
+        hdr.version != MEM_TRACE_VERSION) {
+        fprintf(stderr, "replay: %s is not a trace\n", path);
+        return -1;
+    }
+    long n = (st.st_size - sizeof(hdr)) / sizeof(mem_trace_rec);
+    mem_trace_rec *recs = malloc(n * sizeof(mem_trace_rec) + 1);
+    ops = malloc(n * sizeof(op) + 1);
+    if (recs == NULL || ops == NULL ||
+        (long)fread(recs, sizeof(mem_trace_rec), n, f) != n) {
+        fprintf(stderr, "replay: can't read %s\n", path);
+        return -1;
+    }
+    fclose(f);
+    sort_by_time(recs, n);
+
+    for (long i = 0; i < n; i++) {
+        mem_trace_rec *r = &recs[i];
+        op *o = &ops[num_ops];
+        long id;
+
+        threads = (r->thread >= threads) ? r->thread + 1 : threads;
+        o->kind = r->op;
+        o->size = r->size;
+        o->align = r->align;
+        if (r->op == MEM_TRACE_FREE ||
+            (r->op == MEM_TRACE_REALLOC && r->old != 0)) {
+            id = live_take((r->op == MEM_TRACE_FREE) ? r->ptr : r->old);
+            if (id < 0) {
+                out_of_order++;
+                continue;
+            }
+            if (r->op == MEM_TRACE_REALLOC && r->ptr == 0 && r->size > 0) {
+                live_put(r->old, id); //failed, the block stays
+                continue;
+            }
+            if (r->op == MEM_TRACE_REALLOC && r->size > 0) {
+                live_put(r->ptr, id);
+            }
+        } else if (r->ptr != 0) { //an allocation that did not fail
+            id = num_ids++;
+            live_put(r->ptr, id);
+        } else {
+            continue;
+        }
+        o->id = id;
+        num_ops++;
+    }
+    printf("%s: %ld calls from %d threads on %u blocks, %.2f s recorded\n",
+           path, n, threads, num_ids,
+           (n > 0) ? recs[n - 1].time / 1e9 : 0.0);
+    free(recs);
+    free(live.addr);
+    free(live.id);
+    return 0;
+}
+
+/* Returns the resident memory of the process in bytes */
+static size_t rss(void) {
+    long pages = 0, resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+
+    if (f != NULL) {
+        if (fscanf(f, "%ld %ld", &pages, &resident) != 2) {
+            resident = 0;
+        }
+        fclose(f);
+    }
+    return (size_t)resident * getpagesize();
+}
+
+/*
+ * Returns the peak resident memory since reset_peak in bytes, 0 if the
+ * kernel can't tell
+ */
+static size_t peak_rss(void) {
+    char line[128];
+    size_t kb = 0;
+    FILE *f = fopen("/proc/self/status", "r");
+
+    if (f != NULL) {
+        while (fgets(line, sizeof(line), f) != NULL) {
+            if (sscanf(line, "VmHWM: %zu kB", &kb) == 1) {
+                break;
+            }
+        }
+        fclose(f);
+    }
+    return kb << 10;
+}
+
+/* Returns 0 if the peak resident memory was reset to the current one */
+static int reset_peak(void) {
+    int fd = open("/proc/self/clear_refs", O_WRONLY);
+    int ret = (fd >= 0 && write(fd, "5", 1) == 1) ? 0 : -1;
+
+    if (fd >= 0) {
+        close(fd);
+    }
+    return ret;
+}
+
+/* Replays ops on allocator a, must be in a fresh process */
+static int run(const allocator *a, int policy, size_t region) {
+    void **ptr = malloc(num_ids * sizeof(void*) + 1);
+    uint32_t *size = malloc(num_ids * sizeof(uint32_t) + 1);
+    size_t live_bytes = 0, peak = 0;
+    uint64_t elapsed = 0;
+    long failed = 0, i = 0;
+    int is_libmem = (a == &allocators[0]);
+
+    if (ptr == NULL || size == NULL) {
+        return 1;
+    }
+    if (is_libmem) {
+        mem_opts opts = { policy };
+        opts.grow_chunk = region;
+        opts.mmap_threshold = 128 << 10; //as libmemmalloc.so
+        if (Init_Mem_Opts(region, &opts) != 0) {
+            return 1;
+        }
+    }
+    memset(ptr, 0, num_ids * sizeof(void*)); //fault the arrays in first
+    memset(size, 0, num_ids * sizeof(uint32_t));
+    int have_peak = (reset_peak() == 0);
+    size_t base = rss();
+
+    printf("\n%s\n%6s %10s %14s %8s %6s\n", a->name, "done", "live MB",
+           "footprint MB", "live", "frag");
+    for (int s = 1; s <= SAMPLES; s++) {
+        long end = num_ops * s / SAMPLES;
+        uint64_t start = now_ns();
+        for (; i < end; i++) {
+            const op *o = &ops[i];
+            void *p;
+            switch (o->kind) {
+            case MEM_TRACE_ALLOC:
+                p = a->alloc(o->size);
+                break;
+            case MEM_TRACE_ALIGNED:
+                p = a->aligned(o->size, (size_t)1 << o->align);
+                break;
+            case MEM_TRACE_CALLOC:
+                p = a->calloc(1, o->size);
+                break;
+            case MEM_TRACE_REALLOC:
+                if (o->size == 0) {
+                    a->free(ptr[o->id]);
+                    live_bytes -= size[o->id];
+                    ptr[o->id] = NULL;
+                    size[o->id] = 0;
+                    continue;
+                }
+                p = a->realloc(ptr[o->id], o->size);
+                if (p == NULL) {
+                    failed++;
+                    continue;
+                }
+                live_bytes -= size[o->id];
+                break;
+            default: //MEM_TRACE_FREE
+                a->free(ptr[o->id]);
+                live_bytes -= size[o->id];
+                ptr[o->id] = NULL;
+                size[o->id] = 0;
+                continue;
+            }
+            if (p == NULL) {
+                failed++;
+                continue;
+            }
+            *(char*)p = (char)i;
+            ptr[o->id] = p;
+            size[o->id] = o->size;
+            live_bytes += o->size;
+        }
+        elapsed += now_ns() - start;
+
+        size_t footprint = rss() - base;
+        peak = (footprint > peak) ? footprint : peak;
+        char frag[16] = "-";
+        mem_stats stats;
+        if (is_libmem && Get_Mem_Stats(&stats) == 0) {
+            snprintf(frag, sizeof(frag), "%.3f", stats.fragmentation);
+        }
+        printf("%5d%% %10.2f %14.2f %7.1f%% %6s\n", 100 * s / SAMPLES,
+               live_bytes / 1048576.0, footprint / 1048576.0,
+               (footprint > 0) ? 100.0 * live_bytes / footprint : 0.0, frag);
+    }
+    if (have_peak && peak_rss() > base) {
+        peak = peak_rss() - base;
+    }
+    printf("%ld calls in %.3f s, %.2f M calls/s, peak footprint %.2f MB, "
+           "%ld failed\n", num_ops, elapsed / 1e9,
+           (elapsed > 0) ? num_ops * 1e3 / elapsed : 0.0, peak / 1048576.0,
+           failed);
+    return 0;
+}
+
+int main(int argc, char *argv[]) {
+    const char *only = NULL;
+    int policy = MEM_POLICY_SEGLIST;
+    size_t region = 64 << 20;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "a:p:r:")) != -1) {
+        if (opt == 'a') {
+            only = optarg;
+        } else if (opt == 'p') {
+            policy = atoi(optarg);
+        } else if (opt == 'r') {
+            region = (size_t)atol(optarg) << 20;
+        } else {
+            break;
+        }
+    }
+    if (optind + 1 != argc) {
+        fprintf(stderr, "usage: replay [-a libmem|glibc] [-p policy] "
+                "[-r region MB] trace\n");
+        return 2;
+    }
+    if (load(argv[optind]) != 0) {
+        return 1;
+    }
+    if (out_of_order > 0) {
+        printf("%ld calls on blocks that were not live, left out\n",
+               out_of_order);
+    }
+    fflush(stdout);
+
+    for (int i = 0; i < 2; i++) {
+        if (only != NULL && strcmp(only, allocators[i].name) != 0) {
+            continue;
+        }
+        // Init_Mem only works once per process, so fork for each run
+        pid_t pid = fork();
+        if (pid == 0) {
+            exit(run(&allocators[i], policy, region));
+        }
+        int status;
+        if (pid < 0 || waitpid(pid, &status, 0) < 0 ||
+            !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            fprintf(stderr, "replay: run failed\n");
+            return 1;
+        }
+    }
+    return 0;
+}
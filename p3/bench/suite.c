@@ -0,0 +1,487 @@
+/*
+ * The standard workloads, on libmem and on the C library's malloc, for
+ * catching regressions
+ *
+ * fixed    - churn of 256 byte blocks: free a random slot, allocate again
+ * random   - the same with random sizes from 16 bytes to 4 KiB
+ * bestfit  - tests/bestfit.c scaled up: groups of nine blocks with every
+ *            other one freed, then holes filled with 50 byte requests
+ * coalesce - tests/coalesce1-3.c scaled up: groups of 600 byte blocks
+ *            with two or three neighbours freed in different orders, then
+ *            the merged size allocated
+ * lifo     - batches of random sizes freed in the reverse order
+ * fifo     - batches of random sizes freed in the order allocated
+ *
+ * Every allocation and free is timed on its own; the mean and percentiles
+ * are in ns per call. Allocated blocks have a byte written in every page
+ * (not timed). peak MB is the peak resident memory the workload added and
+ * frag is 1 - live bytes / resident memory added, taken when the most
+ * bytes are live; heap frag is the fragmentation ratio of Get_Mem_Stats
+ * at that point. Each workload runs in a fresh process.
+ *
+ * -o file      also write the results as CSV
+ * -b file      compare with the CSV of an earlier run: a mean, p99 or peak
+ *              worse by more than -t percent (10) is a regression, and the
+ *              exit status is 1 if there was one
+ * -n ops       calls per workload (1000000)
+ * -p policy    MEM_POLICY_ value for libmem (0)
+ *
+ * Usage: suite [-o csv] [-b baseline csv] [-t percent] [-n ops] [-p policy]
+ */
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include "mem.h"
+#include "bench.h"
+
+#define REGION (256 << 20)
+#define SLOTS 10000
+
+typedef struct allocator {
+    const char *name;
+    void* (*alloc)(size_t size);
+    void (*free)(void *ptr);
+} allocator;
+
+static void mem_free(void *ptr) {
+    Free_Mem(ptr);
+}
+
+static const allocator allocators[] = {
+    { "libmem", Alloc_Mem, mem_free },
+    { "glibc", malloc, free },
+};
+
+typedef struct result {
+    char workload[16];
+    char allocator[16];
+    long ops;
+    double mean;
+    uint64_t p50, p90, p99, p999, max;
+    double peak_mb;
+    double frag;
+    double heap_frag; //-1 for glibc
+} result;
+
+/* State of the workload running in this process */
+static const allocator *A;
+static uint64_t *lat;
+static long num_lat, max_lat;
+static size_t live_bytes, base_rss;
+static result *res;
+
+/* Returns the resident memory of the process in bytes */
+static size_t rss(void) {
+    long pages = 0, resident = 0;
+    FILE *f = fopen("/proc/self/statm", "r");
+
+    if (f != NULL) {
+        if (fscanf(f, "%ld %ld", &pages, &resident) != 2) {
+            resident = 0;
+        }
+        fclose(f);
+    }
+    return (size_t)resident * getpagesize();
+}
+
+/* Returns the peak resident memory in bytes, 0 if the kernel can't tell */
+static size_t peak_rss(void) {
+    char line[128];
+    size_t kb = 0;
+    FILE *f = fopen("/proc/self/status", "r");
+
+    if (f != NULL) {
+        while (fgets(line, sizeof(line), f) != NULL) {
+            if (sscanf(line, "VmHWM: %zu kB", &kb) == 1) {
+                break;
+            }
+        }
+        fclose(f);
+    }
+    return kb << 10;
+}
+
+/* Returns 1 while the workload should go on */
+static int more(void) {
+    return num_lat < max_lat;
+}
+
+static void* alloc(size_t size) {
+    uint64_t start = now_ns();
+    char *ptr = A->alloc(size);
+    uint64_t end = now_ns();
+
+    if (ptr == NULL) {
+        fprintf(stderr, "suite: %s out of memory\n", A->name);
+        exit(1);
+    }
+    if (num_lat < max_lat) {
+        lat[num_lat++] = end - start;
+    }
+    for (size_t off = 0; off < size; off += 4096) {
+        ptr[off] = 1;
+    }
+    live_bytes += size;
+    return ptr;
+}
+
+static void release(void *ptr, size_t size) {
+    uint64_t start = now_ns();
+    A->free(ptr);
+    uint64_t end = now_ns();
+
+    if (num_lat < max_lat) {
+        lat[num_lat++] = end - start;
+    }
+    live_bytes -= size;
+}
+
+/* Takes frag and heap frag if more bytes are live than the last time */
+static void sample(void) {
+    static size_t most = 0;
+    mem_stats stats;
+
+    if (live_bytes <= most) {
+        return;
+    }
+    most = live_bytes;
+    size_t added = rss() - base_rss;
+    res->frag = (added > live_bytes) ? 1.0 - (double)live_bytes / added : 0;
+    if (A == &allocators[0] && Get_Mem_Stats(&stats) == 0) {
+        res->heap_frag = stats.fragmentation;
+    }
+}
+
+static void churn(int min_size, int max_size) {
+    static void *ptr[SLOTS];
+    static size_t size[SLOTS];
+    uint32_t rng = 1234;
+
+    for (int i = 0; i < SLOTS; i++) {
+        size[i] = rng_range(&rng, min_size, max_size);
+        ptr[i] = alloc(size[i]);
+    }
+    while (more()) {
+        int s = rng_next(&rng) % SLOTS;
+        release(ptr[s], size[s]);
+        size[s] = rng_range(&rng, min_size, max_size);
+        ptr[s] = alloc(size[s]);
+    }
+    sample();
+    for (int i = 0; i < SLOTS; i++) {
+        release(ptr[i], size[i]);
+    }
+}
+
+static void fixed(void) {
+    churn(256, 256);
+}
+
+static void random_sizes(void) {
+    churn(16, 4096);
+}
+
+static void bestfit(void) {
+    static const size_t sizes[9] = { 300, 200, 200, 100, 200, 800, 500,
+                                     700, 300 };
+    enum { GROUPS = 4000 };
+    static void *ptr[GROUPS][9];
+    static void *fill[GROUPS * 4];
+
+    while (more()) {
+        for (int g = 0; g < GROUPS; g++) {
+            for (int i = 0; i < 9; i++) {
+                ptr[g][i] = alloc(sizes[i]);
+            }
+        }
+        for (int g = 0; g < GROUPS; g++) {
+            for (int i = 1; i < 9; i += 2) {
+                release(ptr[g][i], sizes[i]);
+            }
+        }
+        for (int i = 0; i < GROUPS * 4; i++) {
+            fill[i] = alloc(50);
+        }
+        sample();
+        for (int i = 0; i < GROUPS * 4; i++) {
+            release(fill[i], 50);
+        }
+        for (int g = 0; g < GROUPS; g++) {
+            for (int i = 0; i < 9; i += 2) {
+                release(ptr[g][i], sizes[i]);
+            }
+        }
+    }
+}
+
+static void coalesce(void) {
+    enum { GROUPS = 4000 };
+    static void *ptr[GROUPS][5];
+
+    while (more()) {
+        for (int g = 0; g < GROUPS; g++) {
+            for (int i = 0; i < 5; i++) {
+                ptr[g][i] = alloc(600);
+            }
+        }
+        for (int g = 0; g < GROUPS; g++) {
+            if (g % 3 == 0) { //coalesce1: with the next block
+                release(ptr[g][1], 600);
+                release(ptr[g][2], 600);
+                ptr[g][1] = alloc(1200);
+                ptr[g][2] = NULL;
+            } else if (g % 3 == 1) { //coalesce2: with the previous one
+                release(ptr[g][2], 600);
+                release(ptr[g][1], 600);
+                ptr[g][1] = alloc(1200);
+                ptr[g][2] = NULL;
+            } else { //coalesce3: with both
+                release(ptr[g][1], 600);
+                release(ptr[g][3], 600);
+                release(ptr[g][2], 600);
+                ptr[g][1] = alloc(1800);
+                ptr[g][2] = ptr[g][3] = NULL;
+            }
+        }
+        sample();
+        for (int g = 0; g < GROUPS; g++) {
+            size_t merged = (g % 3 == 2) ? 1800 : 1200;
+            release(ptr[g][0], 600);
+            release(ptr[g][1], merged);
+            if (ptr[g][3] != NULL) {
+                release(ptr[g][3], 600);
+            }
+            release(ptr[g][4], 600);
+        }
+    }
+}
+
+static void batches(int lifo) {
+    static void *ptr[SLOTS];
+    static size_t size[SLOTS];
+    uint32_t rng = 4321;
+
+    while (more()) {
+        for (int i = 0; i < SLOTS; i++) {
+            size[i] = rng_range(&rng, 16, 1024);
+            ptr[i] = alloc(size[i]);
+        }
+        sample();
+        for (int i = 0; i < SLOTS; i++) {
+            int j = lifo ? SLOTS - 1 - i : i;
+            release(ptr[j], size[j]);
+        }
+    }
+}
+
+static void lifo(void) {
+    batches(1);
+}
+
+static void fifo(void) {
+    batches(0);
+}
+
+static const struct {
+    const char *name;
+    void (*run)(void);
+} workloads[] = {
+    { "fixed", fixed },
+    { "random", random_sizes },
+    { "bestfit", bestfit },
+    { "coalesce", coalesce },
+    { "lifo", lifo },
+    { "fifo", fifo },
+};
+
+/* Runs one workload on allocator a, must be in a fresh process */
+static int run(int w, const allocator *a, long ops, int policy, result *r) {
+    mem_opts opts = { policy };
+
+    memset(r, 0, sizeof(*r));
+    snprintf(r->workload, sizeof(r->workload), "%s", workloads[w].name);
+    snprintf(r->allocator, sizeof(r->allocator), "%s", a->name);
+    r->heap_frag = -1;
+    A = a;
+    res = r;
+    max_lat = ops;
+    if ((lat = malloc(sizeof(uint64_t) * ops)) == NULL) {
+        return 1;
+    }
+    memset(lat, 0, sizeof(uint64_t) * ops); //fault it in before the base
+    opts.grow_chunk = REGION;
+    if (a == &allocators[0] && Init_Mem_Opts(REGION, &opts) != 0) {
+        return 1;
+    }
+    int fd = open("/proc/self/clear_refs", O_WRONLY);
+    int have_peak = (fd >= 0 && write(fd, "5", 1) == 1); //reset the peak
+    if (fd >= 0) {
+        close(fd);
+    }
+    base_rss = rss();
+
+    workloads[w].run();
+
+    size_t peak = have_peak ? peak_rss() : 0;
+    r->peak_mb = (peak > base_rss) ? (peak - base_rss) / 1048576.0 : 0;
+    r->ops = num_lat;
+    uint64_t total = 0;
+    for (long i = 0; i < num_lat; i++) {
+        total += lat[i];
+    }
+    r->mean = (double)total / num_lat;
+    sort_samples(lat, num_lat);
+    r->p50 = percentile(lat, num_lat, 50);
+    r->p90 = percentile(lat, num_lat, 90);
+    r->p99 = percentile(lat, num_lat, 99);
+    r->p999 = percentile(lat, num_lat, 99.9);
+    r->max = lat[num_lat - 1];
+    return 0;
+}
+
+/*
+ * Reads the CSV of an earlier run
+ * Returns the number of results read into base, at most max
+ */
+static int read_csv(const char *path, result *base, int max) {
+    char line[256];
+    int n = 0;
+    FILE *f = fopen(path, "r");
+
+    if (f == NULL) {
+        perror(path);
+        exit(2);
+    }
+    while (n < max && fgets(line, sizeof(line), f) != NULL) {
+        result *r = &base[n];
+        if (sscanf(line, "%15[^,],%15[^,],%ld,%lf,%lu,%lu,%lu,%lu,%lu,%lf,"
+                   "%lf,%lf", r->workload, r->allocator, &r->ops, &r->mean,
+                   (unsigned long*)&r->p50, (unsigned long*)&r->p90,
+                   (unsigned long*)&r->p99, (unsigned long*)&r->p999,
+                   (unsigned long*)&r->max, &r->peak_mb, &r->frag,
+                   &r->heap_frag) == 12) {
+            n++;
+        }
+    }
+    fclose(f);
+    return n;
+}
+
+/* Returns how much worse now is than then in percent, 0 if better */
+static double worse(double now, double then) {
+    return (then > 0 && now > then) ? 100.0 * (now - then) / then : 0;
+}
+
+int main(int argc, char *argv[]) {
+    enum { MAX_RESULTS = 64 };
+    static result base[MAX_RESULTS];
+    const char *csv = NULL, *baseline = NULL;
+    double threshold = 10;
+    long ops = 1000000;
+    int policy = MEM_POLICY_SEGLIST, num_base = 0, regressions = 0;
+    int opt;
+    FILE *out = NULL;
+
+    while ((opt = getopt(argc, argv, "o:b:t:n:p:")) != -1) {
+        switch (opt) {
+        case 'o': csv = optarg; break;
+        case 'b': baseline = optarg; break;
+        case 't': threshold = atof(optarg); break;
+        case 'n': ops = atol(optarg); break;
+        case 'p': policy = atoi(optarg); break;
+        default:
+            fprintf(stderr, "usage: suite [-o csv] [-b baseline csv] "
+                    "[-t percent] [-n ops] [-p policy]\n");
+            return 2;
+        }
+    }
+    if (baseline != NULL) {
+        num_base = read_csv(baseline, base, MAX_RESULTS);
+    }
+    if (csv != NULL) {
+        if ((out = fopen(csv, "w")) == NULL) {
+            perror(csv);
+            return 2;
+        }
+        fprintf(out, "workload,allocator,ops,mean_ns,p50_ns,p90_ns,p99_ns,"
+                "p999_ns,max_ns,peak_mb,frag,heap_frag\n");
+    }
+
+    printf("%-9s %-7s %9s %8s %6s %6s %6s %7s %9s %8s %6s %9s\n",
+           "workload", "alloc", "ops", "mean", "p50", "p90", "p99", "p99.9",
+           "max", "peak MB", "frag", "heap frag");
+    fflush(stdout);
+    for (int w = 0; w < (int)(sizeof(workloads) / sizeof(workloads[0]));
+         w++) {
+        for (int a = 0; a < 2; a++) {
+            result r;
+            int fds[2];
+            // Init_Mem only works once per process, so fork for each run;
+            // the result comes back through a pipe
+            if (pipe(fds) != 0) {
+                return 1;
+            }
+            fflush(NULL); //or the child writes out the buffers again
+            pid_t pid = fork();
+            if (pid == 0) {
+                close(fds[0]);
+                int ret = run(w, &allocators[a], ops, policy, &r);
+                if (ret == 0 && write(fds[1], &r, sizeof(r)) != sizeof(r)) {
+                    ret = 1;
+                }
+                exit(ret);
+            }
+            close(fds[1]);
+            int status;
+            int got = (pid > 0) && read(fds[0], &r, sizeof(r)) == sizeof(r);
+            close(fds[0]);
+            if (pid < 0 || waitpid(pid, &status, 0) < 0 || !got ||
+                !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+                fprintf(stderr, "suite: run failed\n");
+                return 1;
+            }
+
+            char heap_frag[16] = "-";
+            if (r.heap_frag >= 0) {
+                snprintf(heap_frag, sizeof(heap_frag), "%.3f", r.heap_frag);
+            }
+            printf("%-9s %-7s %9ld %8.1f %6lu %6lu %6lu %7lu %9lu %8.2f "
+                   "%6.3f %9s", r.workload, r.allocator, r.ops, r.mean,
+                   (unsigned long)r.p50, (unsigned long)r.p90,
+                   (unsigned long)r.p99, (unsigned long)r.p999,
+                   (unsigned long)r.max, r.peak_mb, r.frag, heap_frag);
+            if (out != NULL) {
+                fprintf(out, "%s,%s,%ld,%.1f,%lu,%lu,%lu,%lu,%lu,%.2f,%.3f,"
+                        "%.3f\n", r.workload, r.allocator, r.ops, r.mean,
+                        (unsigned long)r.p50, (unsigned long)r.p90,
+                        (unsigned long)r.p99, (unsigned long)r.p999,
+                        (unsigned long)r.max, r.peak_mb, r.frag, r.heap_frag);
+            }
+            for (int i = 0; i < num_base; i++) {
+                const result *b = &base[i];
+                if (strcmp(b->workload, r.workload) != 0 ||
+                    strcmp(b->allocator, r.allocator) != 0) {
+                    continue;
+                }
+                double mean = worse(r.mean, b->mean);
+                double p99 = worse(r.p99, b->p99);
+                double peak = worse(r.peak_mb, b->peak_mb);
+                if (mean > threshold || p99 > threshold || peak > threshold) {
+                    printf("  REGRESSION mean +%.0f%% p99 +%.0f%% peak +%.0f%%",
+                           mean, p99, peak);
+                    regressions++;
+                }
+                break;
+            }
+            printf("\n");
+            fflush(stdout);
+        }
+    }
+    if (out != NULL) {
+        fclose(out);
+    }
+    return (regressions > 0) ? 1 : 0;
+}
@@ -0,0 +1,86 @@
+/*
+ * Throughput scaling of Alloc_Mem/Free_Mem from 1 to N threads
+ *
+ * Every thread churns its own set of slots: free a random slot, allocate a
+ * new block for it and touch the first byte. Most requests are small enough
+ * for the per-thread cache, 'large' percent of them go to the shared heap.
+ *
+ * Usage: threads [max threads] [ops per thread] [large percent]
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include <unistd.h>
+#include "mem.h"
+#include "bench.h"
+
+#define REGION (256 << 20)
+#define SLOTS 1024
+
+static int ops_per_thread;
+static int large_percent;
+
+static void* worker(void *arg) {
+    uint32_t seed = (uint32_t)(uintptr_t)arg * 2654435761u + 1;
+    char *slot[SLOTS] = { NULL };
+
+    for (int i = 0; i < ops_per_thread; i++) {
+        int s = rng_next(&seed) % SLOTS;
+        int size = (rng_next(&seed) % 100 < (uint32_t)large_percent)
+                   ? rng_range(&seed, 64, 1024)
+                   : rng_range(&seed, 8, 56);
+        if (slot[s] != NULL) {
+            Free_Mem(slot[s]);
+        }
+        slot[s] = Alloc_Mem(size);
+        if (slot[s] == NULL) {
+            fprintf(stderr, "threads: out of memory\n");
+            exit(1);
+        }
+        slot[s][0] = (char)s;
+    }
+    for (int s = 0; s < SLOTS; s++) {
+        if (slot[s] != NULL) {
+            Free_Mem(slot[s]);
+        }
+    }
+    return NULL;
+}
+
+int main(int argc, char *argv[]) {
+    long ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+    int max_threads = (argc > 1) ? atoi(argv[1]) : (ncpu > 1 ? ncpu : 4);
+    ops_per_thread = (argc > 2) ? atoi(argv[2]) : 1000000;
+    large_percent = (argc > 3) ? atoi(argv[3]) : 10;
+
+    if (Init_Mem(REGION) != 0) {
+        return 1;
+    }
+
+    pthread_t *tid = malloc(sizeof(pthread_t) * max_threads);
+    double base = 0;
+
+    printf("%d ops per thread, %d%% large requests\n",
+           ops_per_thread, large_percent);
+    printf("%8s %12s %10s %10s\n", "threads", "Mops/s", "speedup", "ns/op");
+
+    for (int n = 1; n <= max_threads; n++) {
+        uint64_t start = now_ns();
+        for (int t = 0; t < n; t++) {
+            pthread_create(&tid[t], NULL, worker, (void*)(uintptr_t)(t + 1));
+        }
+        for (int t = 0; t < n; t++) {
+            pthread_join(tid[t], NULL);
+        }
+        double secs = (now_ns() - start) / 1e9;
+        double mops = (double)n * ops_per_thread / secs / 1e6;
+        if (n == 1) {
+            base = mops;
+        }
+        // ns/op is the average time one thread spends per operation
+        printf("%8d %12.2f %10.2f %10.1f\n", n, mops, mops / base,
+               secs * 1e9 / ops_per_thread);
+    }
+    free(tid);
+    return 0;
+}
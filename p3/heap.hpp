@@ -0,0 +1,419 @@
+#ifndef __heap_hpp__
+#define __heap_hpp__
+
+#include <cstddef>
+#include <cstdint>
+#include <new>
+#include <sys/mman.h>
+
+/*
+ * The block heap of mem.c as a template, with the parts mem.c fixes picked
+ * at compile time instead:
+ *
+ *   mem::Heap<mem::NextFit, mem::Deferred, mem::FullTag> heap(1 << 20);
+ *   void *p = heap.alloc(100);
+ *   heap.free(p);
+ *
+ * Fit      - which free block a request takes: FirstFit, NextFit or
+ *            BestFit (what mem.c does within a size class)
+ * Coalesce - when a freed block is merged with its free neighbours:
+ *            Immediate (on every free, like mem.c) or Deferred (in one
+ *            sweep over the heap when a request finds no free block)
+ * Layout   - how blocks are tagged: BoundaryTag (a header on every block,
+ *            a footer only on free ones and a prev-busy bit in the header,
+ *            like mem.c) or FullTag (a header and a footer on every block)
+ *
+ * Each policy is a class whose hooks the heap calls directly, so every
+ * combination compiles to its own code without a branch on the policy.
+ * Every free block is on one doubly linked list, the block freed last at
+ * its head. Payloads are aligned to twice the size of a size_t. A Heap
+ * lives in a mapping of its own, never grows and is not thread safe.
+ */
+namespace mem {
+
+namespace detail {
+
+const size_t kBusy = 1;
+const size_t kPrevBusy = 2; //BoundaryTag only
+const size_t kTag = sizeof(size_t);
+const size_t kAlign = 2 * kTag;
+const size_t kMinBlock = 2 * kAlign; //header, two links and a footer
+
+/*
+ * A block starts with its tag: the size in bytes, a multiple of kAlign,
+ * plus the status bits. The links are only there while the block is free.
+ */
+struct Block {
+    size_t tag;
+    Block *next;
+    Block *prev;
+
+    size_t size() const {
+        return tag & ~(kAlign - 1);
+    }
+
+    bool busy() const {
+        return (tag & kBusy) != 0;
+    }
+
+    // The block right after this one in memory
+    Block* after() {
+        return reinterpret_cast<Block*>(reinterpret_cast<char*>(this) + size());
+    }
+
+    // The last word of the block
+    size_t* footer() {
+        return reinterpret_cast<size_t*>(reinterpret_cast<char*>(this) +
+                                         size() - kTag);
+    }
+
+    void* payload() {
+        return reinterpret_cast<char*>(this) + kTag;
+    }
+
+    static Block* of(void *payload) {
+        return reinterpret_cast<Block*>(static_cast<char*>(payload) - kTag);
+    }
+};
+
+}  // namespace detail
+
+/*
+ * Layouts
+ * set_busy and set_free retag a block with a new size. Retagging the front
+ * of a split must come before retagging the rest, as a BoundaryTag block
+ * finds its prev-busy bit where the block in front left it.
+ */
+struct BoundaryTag {
+    static const size_t kOverhead = detail::kTag; //per busy block
+
+    static void set_busy(detail::Block *blk, size_t size) {
+        blk->tag = size | detail::kBusy | (blk->tag & detail::kPrevBusy);
+        blk->after()->tag |= detail::kPrevBusy;
+    }
+
+    static void set_free(detail::Block *blk, size_t size) {
+        blk->tag = size | (blk->tag & detail::kPrevBusy);
+        *blk->footer() = size;
+        blk->after()->tag &= ~detail::kPrevBusy;
+    }
+
+    // Returns the block in front of blk if it is free, NULL otherwise
+    static detail::Block* prev_free(detail::Block *blk) {
+        if (blk->tag & detail::kPrevBusy) {
+            return NULL;
+        }
+        size_t size = *(reinterpret_cast<size_t*>(blk) - 1);
+        return reinterpret_cast<detail::Block*>(
+            reinterpret_cast<char*>(blk) - size);
+    }
+};
+
+struct FullTag {
+    static const size_t kOverhead = 2 * detail::kTag;
+
+    static void set_busy(detail::Block *blk, size_t size) {
+        blk->tag = size | detail::kBusy;
+        *blk->footer() = blk->tag;
+    }
+
+    static void set_free(detail::Block *blk, size_t size) {
+        blk->tag = size;
+        *blk->footer() = size;
+    }
+
+    static detail::Block* prev_free(detail::Block *blk) {
+        size_t footer = *(reinterpret_cast<size_t*>(blk) - 1);
+        if (footer & detail::kBusy) {
+            return NULL;
+        }
+        return reinterpret_cast<detail::Block*>(
+            reinterpret_cast<char*>(blk) - (footer & ~(detail::kAlign - 1)));
+    }
+};
+
+/*
+ * Fit policies
+ * find returns a free block of at least 'size' bytes from the list at
+ * 'head' or NULL, removed is called before a block leaves the list.
+ */
+struct FirstFit {
+    detail::Block* find(detail::Block *head, size_t size) {
+        for (detail::Block *b = head; b != NULL; b = b->next) {
+            if (b->size() >= size) {
+                return b;
+            }
+        }
+        return NULL;
+    }
+
+    void removed(detail::Block*) {}
+};
+
+// First fit that starts where the previous search left off
+struct NextFit {
+    NextFit() : rover_(NULL) {}
+
+    detail::Block* find(detail::Block *head, size_t size) {
+        detail::Block *start = (rover_ != NULL) ? rover_ : head;
+        for (detail::Block *b = start; b != NULL; b = b->next) {
+            if (b->size() >= size) {
+                return rover_ = b;
+            }
+        }
+        for (detail::Block *b = head; b != start; b = b->next) {
+            if (b->size() >= size) {
+                return rover_ = b;
+            }
+        }
+        return NULL;
+    }
+
+    void removed(detail::Block *b) {
+        if (rover_ == b) {
+            rover_ = b->next;
+        }
+    }
+
+ private:
+    detail::Block *rover_;
+};
+
+struct BestFit {
+    detail::Block* find(detail::Block *head, size_t size) {
+        detail::Block *best = NULL;
+        for (detail::Block *b = head; b != NULL; b = b->next) {
+            if (b->size() >= size &&
+                (best == NULL || b->size() < best->size())) {
+                best = b;
+                if (b->size() == size) { //can't do better than exact
+                    break;
+                }
+            }
+        }
+        return best;
+    }
+
+    void removed(detail::Block*) {}
+};
+
+/*
+ * Coalescing policies
+ * freed hands a busy block back to the heap, missed is called when a
+ * request found no free block and returns true if a retry may succeed.
+ */
+struct Immediate {
+    template <class H>
+    static void freed(H &heap, detail::Block *blk) {
+        heap.merge(blk);
+    }
+
+    template <class H>
+    static bool missed(H&) {
+        return false;
+    }
+};
+
+struct Deferred {
+    template <class H>
+    static void freed(H &heap, detail::Block *blk) {
+        heap.release(blk);
+    }
+
+    template <class H>
+    static bool missed(H &heap) {
+        return heap.merge_all() > 0;
+    }
+};
+
+template <class Fit = BestFit, class Coalesce = Immediate,
+          class Layout = BoundaryTag>
+class Heap {
+ public:
+    // Maps a heap of at least 'size' bytes, throws std::bad_alloc
+    explicit Heap(size_t size) : fit_(), head_(NULL) {
+        size_t page = 4096;
+        map_len_ = (size + 2 * detail::kTag + page - 1) & ~(page - 1);
+        if (size == 0 || map_len_ < size) {
+            throw std::bad_alloc();
+        }
+        map_ = mmap(NULL, map_len_, PROT_READ | PROT_WRITE,
+                    MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (map_ == MAP_FAILED) {
+            throw std::bad_alloc();
+        }
+
+        // | pad | first block ... | end mark |, the pad reads as busy
+        char *base = static_cast<char*>(map_);
+        size_t len = (map_len_ - 2 * detail::kTag) & ~(detail::kAlign - 1);
+        *reinterpret_cast<size_t*>(base) = detail::kBusy;
+        first_ = reinterpret_cast<detail::Block*>(base + detail::kTag);
+        end_ = reinterpret_cast<detail::Block*>(base + detail::kTag + len);
+        end_->tag = detail::kBusy;
+        first_->tag = len | detail::kPrevBusy;
+        Layout::set_free(first_, len);
+        insert(first_);
+    }
+
+    ~Heap() {
+        munmap(map_, map_len_);
+    }
+
+    Heap(const Heap&) = delete;
+    Heap& operator=(const Heap&) = delete;
+
+    /*
+     * Returns 'size' bytes or NULL when no free block is big enough
+     */
+    void* alloc(size_t size) {
+        size_t max = reinterpret_cast<char*>(end_) -
+                     reinterpret_cast<char*>(first_);
+        if (size == 0 || size > max) {
+            return NULL;
+        }
+        size_t need = (size + Layout::kOverhead + detail::kAlign - 1) &
+                      ~(detail::kAlign - 1);
+        if (need < detail::kMinBlock) {
+            need = detail::kMinBlock;
+        }
+
+        detail::Block *blk = fit_.find(head_, need);
+        if (blk == NULL && Coalesce::missed(*this)) {
+            blk = fit_.find(head_, need);
+        }
+        if (blk == NULL) {
+            return NULL;
+        }
+        remove(blk);
+
+        size_t total = blk->size();
+        if (total - need >= detail::kMinBlock) { //split
+            Layout::set_busy(blk, need);
+            detail::Block *rest = blk->after();
+            Layout::set_free(rest, total - need);
+            insert(rest);
+        } else {
+            Layout::set_busy(blk, total);
+        }
+        return blk->payload();
+    }
+
+    /*
+     * Gives back a block from alloc
+     * Returns 0 on success and -1 if ptr is not a busy block of the heap
+     */
+    int free(void *ptr) {
+        if (ptr <= static_cast<void*>(first_) ||
+            ptr >= static_cast<void*>(end_) ||
+            reinterpret_cast<uintptr_t>(ptr) % detail::kAlign != 0) {
+            return -1;
+        }
+        detail::Block *blk = detail::Block::of(ptr);
+        if (!blk->busy()) {
+            return -1;
+        }
+        Coalesce::freed(*this, blk);
+        return 0;
+    }
+
+    // Bytes in free blocks
+    size_t free_bytes() const {
+        size_t total = 0;
+        for (detail::Block *b = head_; b != NULL; b = b->next) {
+            total += b->size();
+        }
+        return total;
+    }
+
+    // Size of the largest free block
+    size_t largest_free() const {
+        size_t largest = 0;
+        for (detail::Block *b = head_; b != NULL; b = b->next) {
+            if (b->size() > largest) {
+                largest = b->size();
+            }
+        }
+        return largest;
+    }
+
+ private:
+    friend Coalesce;
+
+    void insert(detail::Block *blk) {
+        blk->prev = NULL;
+        blk->next = head_;
+        if (head_ != NULL) {
+            head_->prev = blk;
+        }
+        head_ = blk;
+    }
+
+    void remove(detail::Block *blk) {
+        fit_.removed(blk);
+        if (blk->prev != NULL) {
+            blk->prev->next = blk->next;
+        } else {
+            head_ = blk->next;
+        }
+        if (blk->next != NULL) {
+            blk->next->prev = blk->prev;
+        }
+    }
+
+    // Frees the busy block blk and merges it with its free neighbours
+    void merge(detail::Block *blk) {
+        size_t size = blk->size();
+        detail::Block *next = blk->after();
+        detail::Block *prev = Layout::prev_free(blk);
+
+        if (prev != NULL) {
+            remove(prev);
+            size += prev->size();
+            blk = prev;
+        }
+        if (!next->busy()) {
+            remove(next);
+            size += next->size();
+        }
+        Layout::set_free(blk, size);
+        insert(blk);
+    }
+
+    // Frees the busy block blk without merging it
+    void release(detail::Block *blk) {
+        Layout::set_free(blk, blk->size());
+        insert(blk);
+    }
+
+    /*
+     * Merges every run of free blocks into one block, walking the heap
+     * Returns the number of blocks merged away
+     */
+    size_t merge_all() {
+        size_t merged = 0;
+        for (detail::Block *b = first_; b != end_; b = b->after()) {
+            if (b->busy()) {
+                continue;
+            }
+            size_t size = b->size();
+            for (detail::Block *n = b->after(); !n->busy(); n = n->after()) {
+                remove(n);
+                size += n->size();
+                merged++;
+                Layout::set_free(b, size);
+            }
+        }
+        return merged;
+    }
+
+    Fit fit_;
+    detail::Block *head_; //free list
+    detail::Block *first_;
+    detail::Block *end_; //busy block of size 0
+    void *map_;
+    size_t map_len_;
+};
+
+}  // namespace mem
+
+#endif  // __heap_hpp__
@@ -0,0 +1,298 @@
+/*
+ * malloc, free and friends on top of libmem, built as libmemmalloc.so so
+ * that libmem can stand in for the C library's allocator:
+ *
+ *   LD_PRELOAD=/path/to/libmemmalloc.so ./program
+ *
+ * libmem is set up by the first call into any of these functions. How it
+ * is set up can be changed with environment variables:
+ *
+ *   LIBMEM_REGION_MB      - size of the first region, the heaps grow by
+ *                           chunks of that size after it (64 by default)
+ *   LIBMEM_HEAPS          - number of heaps threads are spread over (1)
+ *   LIBMEM_POLICY         - 0 for MEM_POLICY_SEGLIST, 1 for MEM_POLICY_TLSF,
+ *                           2 for MEM_POLICY_ADDR, 3 for MEM_POLICY_LIFO
+ *   LIBMEM_MMAP_THRESHOLD - requests of at least this many bytes get a
+ *                           mapping of their own, 0 never (128 KiB)
+ *   LIBMEM_PURGE          - purge_threshold in bytes, 0 never purges (0)
+ *   LIBMEM_SLAB           - 1 serves requests of up to 64 bytes from slabs;
+ *                           their slots are only aligned as their size
+ *                           needs, not to 16 bytes like glibc's (0)
+ *   LIBMEM_QUICK          - quick_max in bytes, freed blocks up to this size
+ *                           are coalesced in batches, 0 never defers (0)
+ *   LIBMEM_TRACE          - file to record every call to with
+ *                           Trace_Mem_Start, for bench/replay (none)
+ *
+ * Setting up libmem must not depend on malloc, but the C library may
+ * still call malloc while it runs (for instance for a thread key). Such a
+ * call on the thread doing the setup is served from a static buffer whose
+ * blocks are never freed; other threads wait for the setup to finish.
+ *
+ * A fork holds every lock of libmem, so the child of a multithreaded
+ * process can go on allocating; the child does not trace.
+ */
+#include <errno.h>
+#include <fcntl.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "mem.h"
+
+#define EXPORT __attribute__((visibility("default")))
+
+#define BOOT_SIZE (64 << 10)
+
+enum { INIT_NONE, INIT_RUNNING, INIT_DONE, INIT_FAILED };
+
+static int init_state = INIT_NONE;
+static __thread int init_thread = 0; //this thread is setting up libmem
+static int trace_fd = -1; //LIBMEM_TRACE
+
+/*
+ * Blocks handed out while libmem is being set up, each one after a
+ * size_t that holds its size and padded to keep the payloads aligned
+ */
+static char boot_buf[BOOT_SIZE] __attribute__((aligned(16)));
+static size_t boot_used = 0;
+
+/*
+ * Returns the value of the environment variable 'name' as a number, or
+ * 'def' if it is not set
+ */
+static long env_long(const char *name, long def) {
+    const char *value = getenv(name);
+    return (value != NULL && *value != '\0') ? atol(value) : def;
+}
+
+/*
+ * Sets up libmem with the options from the environment
+ * Returns 0 on success and -1 on failure
+ */
+static int init_mem(void) {
+    mem_opts opts = { 0 };
+    size_t region = (size_t)env_long("LIBMEM_REGION_MB", 64) << 20;
+
+    opts.nheaps = (int)env_long("LIBMEM_HEAPS", 1);
+    opts.policy = (int)env_long("LIBMEM_POLICY", MEM_POLICY_SEGLIST);
+    opts.grow_chunk = region;
+    opts.mmap_threshold = (size_t)env_long("LIBMEM_MMAP_THRESHOLD", 128 << 10);
+    opts.purge_threshold = (size_t)env_long("LIBMEM_PURGE", 0);
+    opts.slab = (int)env_long("LIBMEM_SLAB", 0);
+    opts.quick_max = (size_t)env_long("LIBMEM_QUICK", 0);
+    if (Init_Mem_Opts(region, &opts) != 0) {
+        return -1;
+    }
+    pthread_atfork(Fork_Mem_Prepare, Fork_Mem_Parent, Fork_Mem_Child);
+
+    const char *trace = getenv("LIBMEM_TRACE");
+    if (trace != NULL && *trace != '\0') {
+        trace_fd = open(trace, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (trace_fd >= 0 && Trace_Mem_Start(trace_fd) != 0) {
+            close(trace_fd);
+            trace_fd = -1;
+        }
+    }
+    return 0;
+}
+
+/*
+ * Ends the trace of LIBMEM_TRACE when the program exits, calls made after
+ * this are not recorded
+ */
+__attribute__((destructor)) static void trace_end(void) {
+    if (trace_fd >= 0) {
+        Trace_Mem_Stop();
+        close(trace_fd);
+        trace_fd = -1;
+    }
+}
+
+/*
+ * Makes sure libmem is set up
+ * Returns 1 if libmem can be used, 0 if the caller is in the middle of
+ * setting it up and -1 if the setup failed
+ */
+static int ready(void) {
+    int state = __atomic_load_n(&init_state, __ATOMIC_ACQUIRE);
+
+    while (state != INIT_DONE) {
+        if (state == INIT_FAILED) {
+            return -1;
+        }
+        if (init_thread) {
+            return 0;
+        }
+        int expected = INIT_NONE;
+        if (__atomic_compare_exchange_n(&init_state, &expected, INIT_RUNNING, 0,
+                                        __ATOMIC_ACQUIRE, __ATOMIC_ACQUIRE)) {
+            init_thread = 1;
+            state = (init_mem() == 0) ? INIT_DONE : INIT_FAILED;
+            init_thread = 0;
+            __atomic_store_n(&init_state, state, __ATOMIC_RELEASE);
+        } else if (expected == INIT_RUNNING) {
+            sched_yield(); //another thread is setting up
+            state = __atomic_load_n(&init_state, __ATOMIC_ACQUIRE);
+        } else {
+            state = expected;
+        }
+    }
+    return 1;
+}
+
+/*
+ * Allocates 'size' bytes from the static buffer, only ever called by the
+ * thread setting up libmem
+ * Returns NULL when the buffer is used up
+ */
+static void* boot_alloc(size_t size) {
+    size_t need = (16 + size + 15) & ~(size_t)15;
+
+    if (size > BOOT_SIZE || need > BOOT_SIZE - boot_used) {
+        return NULL;
+    }
+    char *blk = boot_buf + boot_used;
+    boot_used += need;
+    *(size_t*) (blk + 16 - sizeof(size_t)) = size;
+    return blk + 16;
+}
+
+/*
+ * Returns 1 if ptr came from the static buffer
+ */
+static int is_boot(void *ptr) {
+    return (char*)ptr >= boot_buf && (char*)ptr < boot_buf + BOOT_SIZE;
+}
+
+/*
+ * Returns the size a block of the static buffer was allocated with
+ */
+static size_t boot_size(void *ptr) {
+    return *(size_t*) ((char*)ptr - sizeof(size_t));
+}
+
+EXPORT void* malloc(size_t size) {
+    void *ptr = NULL;
+    int state = ready();
+
+    if (state > 0) {
+        ptr = Alloc_Mem((size != 0) ? size : 1);
+    } else if (state == 0) {
+        ptr = boot_alloc(size);
+    }
+    if (ptr == NULL) {
+        errno = ENOMEM;
+    }
+    return ptr;
+}
+
+EXPORT void free(void *ptr) {
+    if (ptr == NULL || is_boot(ptr)) {
+        return;
+    }
+    Free_Mem(ptr);
+}
+
+EXPORT void* calloc(size_t nmemb, size_t size) {
+    void *ptr = NULL;
+    int state = ready();
+
+    if (state > 0) {
+        ptr = (nmemb != 0 && size != 0) ? Calloc_Mem(nmemb, size)
+                                        : Calloc_Mem(1, 1);
+    } else if (state == 0 && (size == 0 || nmemb <= SIZE_MAX / size)) {
+        ptr = boot_alloc(nmemb * size); //the static buffer starts zeroed
+    }
+    if (ptr == NULL) {
+        errno = ENOMEM;
+    }
+    return ptr;
+}
+
+EXPORT void* realloc(void *ptr, size_t size) {
+    if (ptr == NULL) {
+        return malloc(size);
+    }
+    if (size == 0) {
+        free(ptr);
+        return NULL;
+    }
+
+    void *new_ptr;
+    if (is_boot(ptr)) { //moves out of the static buffer
+        new_ptr = malloc(size);
+        if (new_ptr != NULL) {
+            size_t old_size = boot_size(ptr);
+            memcpy(new_ptr, ptr, (old_size < size) ? old_size : size);
+        }
+        return new_ptr;
+    }
+    new_ptr = Realloc_Mem(ptr, size);
+    if (new_ptr == NULL) {
+        errno = ENOMEM;
+    }
+    return new_ptr;
+}
+
+EXPORT int posix_memalign(void **memptr, size_t alignment, size_t size) {
+    if (alignment < sizeof(void*) || (alignment & (alignment - 1)) != 0) {
+        return EINVAL;
+    }
+    if (ready() <= 0) {
+        return ENOMEM;
+    }
+    void *ptr = Alloc_Mem_Aligned((size != 0) ? size : 1, alignment);
+    if (ptr == NULL) {
+        return ENOMEM;
+    }
+    *memptr = ptr;
+    return 0;
+}
+
+EXPORT void* aligned_alloc(size_t alignment, size_t size) {
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        errno = EINVAL;
+        return NULL;
+    }
+    void *ptr = NULL;
+    if (ready() > 0) {
+        ptr = Alloc_Mem_Aligned((size != 0) ? size : 1, alignment);
+    }
+    if (ptr == NULL) {
+        errno = ENOMEM;
+    }
+    return ptr;
+}
+
+EXPORT void* memalign(size_t alignment, size_t size) {
+    return aligned_alloc(alignment, size);
+}
+
+EXPORT void* valloc(size_t size) {
+    return aligned_alloc(getpagesize(), size);
+}
+
+EXPORT void* pvalloc(size_t size) {
+    size_t pagesize = getpagesize();
+
+    if (size > SIZE_MAX - pagesize) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    // a whole number of pages, at least one
+    size = (size != 0) ? (size + pagesize - 1) & ~(pagesize - 1) : pagesize;
+    return aligned_alloc(pagesize, size);
+}
+
+EXPORT size_t malloc_usable_size(void *ptr) {
+    if (ptr == NULL) {
+        return 0;
+    }
+    if (is_boot(ptr)) {
+        return boot_size(ptr);
+    }
+    return Usable_Size_Mem(ptr);
+}
@@ -1,10 +1,16 @@
+#define _GNU_SOURCE //mremap
 #include <stdio.h>
+#include <stdint.h>
+#include <errno.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <fcntl.h>
 #include <sys/mman.h>
 #include <string.h>
+#include <pthread.h>
+#include <sched.h>
+#include <time.h>
 #include "mem.h"
 
 /*
@@ -13,11 +19,12 @@
  * The blocks are ordered in the increasing order of addresses 
  */
 typedef struct blk_hdr {                         
-        int size_status;
+        size_t size_status;
   
     /*
-    * Size of the block is always a multiple of 8
-    * => last two bits are always zero - can be used to store other information
+    * Size of the block is always a multiple of ALIGN (8 bytes in a 32-bit
+    * build, 16 bytes in a 64-bit build)
+    * => last three bits are always zero - can be used to store other information
     *
     * LSB -> Least Significant Bit (Last Bit)
     * SLB -> Second Last Bit 
@@ -30,7 +37,7 @@ typedef struct blk_hdr {
     */
 
     /*
-    * Examples:
+    * Examples (32-bit build, 4 byte header):
     * 
     * For a busy block with a payload of 20 bytes (i.e. 20 bytes data + an additional 4 bytes for header)
     * Header:
@@ -54,193 +61,3308 @@ blk_hdr *first_blk = NULL;
 /*
  * Note: 
  *  The end of the available memory can be determined using end_mark
- *  The size_status of end_mark has a value of 1
+ *  The end_mark is a busy block of size 0, so its size_status is 1, plus 2
+ *  when the block in front of it is busy
  *
  */
+
+/*
+ * Free blocks are additionally threaded onto free lists.
+ * The links live in the payload of the free block, right after the header:
+ *
+ *   | header | next | prev | ...unused... | footer |
+ *
+ * so a free block must be at least MIN_BLK_SIZE bytes. Allocations are
+ * rounded up to MIN_BLK_SIZE and a split never leaves a smaller remainder.
+ *
+ * How the lists are indexed depends on the policy picked in Init_Mem_Opts:
+ *
+ * MEM_POLICY_SEGLIST - list k holds the free blocks whose size is in
+ *   [2^k, 2^(k+1)). free_map has bit k set whenever list k is non-empty.
+ *   The search is best fit.
+ *
+ * MEM_POLICY_TLSF - two level segregated fit. The first level splits sizes
+ *   by power of two, the second level splits each power of two range into
+ *   SL_COUNT equal lists. fl_map/sl_map mark the non-empty lists so a block
+ *   that is big enough is found with two find-first-set operations.
+ *   The search is good fit: the request is rounded up to the next list
+ *   boundary so that any block on the list found is big enough.
+ *
+ * MEM_POLICY_ADDR - every free block is on free_list, sorted by address.
+ *   The search is first fit from the lowest address, which behaves much
+ *   like best fit. The walk for the spot of a new free block starts at the
+ *   block in front of the one unlinked last (addr_hint), so a remainder of
+ *   a split or a block that grew by coalescing is put back right away.
+ *
+ * MEM_POLICY_LIFO - every free block is on free_list, the block freed last
+ *   at its head. The search is first fit from the head.
+ */
+typedef struct free_links {
+    blk_hdr *next;
+    blk_hdr *prev;
+} free_links;
+
+/*
+ * Large free blocks give their pages back to the OS once they have stayed
+ * free long enough (see mem_opts.purge_threshold). Such a block also keeps
+ * the time it was put on its free list, right after the links:
+ *
+ *   | header | next | prev | freed_at | ...purged pages... | footer |
+ *
+ * Only the whole pages between freed_at and the footer are purged, so the
+ * header, links and footer never fault. A purged block has PURGED set in
+ * its header. A block split off a purged block stays purged, a block
+ * coalesced from it does not (some of its pages are resident again).
+ * The bit is only ever set on free blocks.
+ */
+#define PURGED 4
+
+/*
+ * Every payload is aligned to ALIGN, twice the header size, so a header
+ * always sits right in front of an aligned address: 8 bytes in a 32-bit
+ * build and 16 bytes in a 64-bit build, like malloc
+ */
+#define HDR_SIZE ((int)sizeof(blk_hdr))
+#define ALIGN (2 * HDR_SIZE)
+#define MIN_BLK_SIZE \
+    ((int)((2 * sizeof(blk_hdr) + sizeof(free_links) + ALIGN - 1) & \
+           ~(ALIGN - 1)))
+#define SIZE_BITS (8 * (int)sizeof(size_t))
+#define NUM_CLASSES SIZE_BITS
+
+#define SL_LOG2 4
+#define SL_COUNT (1 << SL_LOG2)
+#define FL_SHIFT (SL_LOG2 + 3) //sizes below 2^FL_SHIFT share fl 0
+#define FL_COUNT (SIZE_BITS - FL_SHIFT + 1)
+
+/*
+ * While a small block sits in a thread cache, on a remote free queue or on
+ * a quick list, its payload holds the link to the next block.
+ */
+typedef struct cached_blk {
+    struct cached_blk *next;
+} cached_blk;
+
+/*
+ * Such a block was freed by the program but is still busy to the heap. It
+ * has CACHED set in its header until it is handed out again or really
+ * freed, so a second free of it fails whichever thread's cache it is in.
+ * CACHED is the PURGED bit, which a busy block never has otherwise (but a
+ * slab's block has SLAB, the same bit, and can't be freed either).
+ * A thread sets the bit without the heap lock while the p-bit may change
+ * under it, so both are only ever changed atomically on a busy block.
+ */
+#define CACHED PURGED
+
+/*
+ * Marks the busy block hdr as cached
+ * Returns 0 on success and -1 if it is free or cached already
+ */
+static int blk_cache(blk_hdr *hdr) {
+    size_t status = __atomic_load_n(&hdr->size_status, __ATOMIC_RELAXED);
+
+    do {
+        if ((status & (CACHED | 1)) != 1) {
+            return -1;
+        }
+    } while (!__atomic_compare_exchange_n(&hdr->size_status, &status,
+                                          status | CACHED, 1, __ATOMIC_ACQUIRE,
+                                          __ATOMIC_RELAXED));
+    return 0;
+}
+
+/*
+ * Hands the cached block hdr out again
+ */
+static void blk_uncache(blk_hdr *hdr) {
+    __atomic_fetch_and(&hdr->size_status, ~(size_t)CACHED, __ATOMIC_RELAXED);
+}
+
+/*
+ * A chunk is one contiguous run of blocks from first_blk to end_mark.
+ * A heap starts out with a single chunk and, if it may grow, maps another
+ * chunk whenever no free block fits. A new mapping that the OS places right
+ * after the last chunk is merged into it: the old end_mark becomes a free
+ * block that coalesces with the last free block of the chunk.
+ * Chunks after the first keep this struct at the start of their mapping.
+ *
+ * Memory fresh from the OS reads as zero. Blocks are always carved from the
+ * front of a free block, so the part of a chunk that was never handed out
+ * is a tail of its last free block, starting at 'fresh'. Apart from the
+ * footer of that block, nothing at or above 'fresh' was ever written, and
+ * Calloc_Mem does not clear it again.
+ */
+typedef struct mem_chunk {
+    struct mem_chunk *next;
+    char *start; //first byte of the chunk's memory
+    char *end; //one past its last byte, moves when a mapping is merged in
+    blk_hdr *first_blk;
+    blk_hdr *end_mark;
+    char *fresh; //nothing from here to end_mark was ever handed out
+} mem_chunk;
+
+//what a free block keeps at its front, written even in fresh memory
+#define FREE_META (HDR_SIZE + sizeof(free_links) + sizeof(unsigned long))
+
+//largest chunk and largest growable request
+#define MAX_GROW_SIZE ((size_t)1 << (SIZE_BITS > 32 ? 40 : 30))
+//largest region Init_Mem or Heap_Create accept, anything bigger is most
+//likely a negative size
+#define MAX_REGION_SIZE (SIZE_MAX / 2 - (1 << 20))
+
+//mappings that are never purged: locked pages can't be dropped and huge
+//pages only go back whole
+#define MAP_NO_PURGE (MEM_MAP_LOCK | MEM_MAP_HUGETLB)
+
+/*
+ * A request of at least mem_opts.mmap_threshold bytes gets a mapping of its
+ * own instead of a block of a heap, so it neither fragments the heap nor
+ * stays mapped once freed. The mapping starts with a mapped_blk that links
+ * it into the list of its heap, the payload follows at 'offset':
+ *
+ *   | mapped_blk | ...alignment gap... | header | payload ... |
+ *
+ * The header is busy with MAPPED set and holds 'offset' as its size.
+ * MAPPED is the PURGED bit, which a busy block of a heap never has. A
+ * pointer outside of every heap is looked up on the lists by its address,
+ * never read, since the block may have been unmapped already.
+ */
+#define MAPPED PURGED
+
+typedef struct mapped_blk {
+    mem_heap *heap;
+    struct mapped_blk *next;
+    struct mapped_blk *prev;
+    size_t len; //of the whole mapping
+    size_t offset; //of the payload
+} mapped_blk;
+
+static int mapped_used = 0; //some heap has an mmap_threshold
+
+/*
+ * With mem_opts.slab set, requests of up to SLAB_MAX bytes are served from
+ * slabs instead of blocks of their own. A slab is a busy block of exactly
+ * SLAB_SIZE bytes whose payload starts on a SLAB_SIZE boundary, split into
+ * slots of one size behind a slab header. A slot has no header of its own,
+ * the slab is found by rounding the slot address down to SLAB_SIZE:
+ *
+ *   | block header | slab | slot | slot | ... | slot | block header | slab
+ *                  ^ SLAB_SIZE boundary                              ^
+ *
+ * so slabs carved one after the other leave no gap between them.
+ * The block header has SLAB set, the PURGED bit that a busy block never
+ * has otherwise. Slot sizes are multiples of SLAB_STEP, so a slot is only
+ * aligned to the largest power of two its size is a multiple of (enough
+ * for any object of that size). Free slots are kept on a list in the slab,
+ * slots never handed out are taken in order after the last one used.
+ * A bit per slot marks the ones handed out, so a slot freed twice is caught.
+ * Slabs with free slots are on a list per size, under h->slab_lock.
+ */
+#define SLAB PURGED
+#define SLAB_SIZE 4096
+#define SLAB_STEP 8
+#define SLAB_MAX 64
+#define SLAB_CLASSES (SLAB_MAX / SLAB_STEP)
+#define SLAB_MAGIC 0x736c6162ul
+#define LONG_BITS (8 * (int)sizeof(unsigned long))
+
+typedef struct slab {
+    unsigned long magic; //SLAB_MAGIC ^ address of the slab
+    mem_heap *heap;
+    struct slab *next; //slabs of this size with free slots
+    struct slab *prev;
+    void *free; //free slots
+    unsigned int slot_size;
+    unsigned int used; //slots handed out
+    unsigned int fresh; //slots from here on were never handed out
+    unsigned int slots;
+    unsigned long busy[SLAB_SIZE / SLAB_STEP / LONG_BITS]; //slots handed out
+} slab;
+
+#define SLAB_HDR ((sizeof(slab) + ALIGN - 1) & ~(size_t)(ALIGN - 1))
+
+static int slab_used = 0; //some heap has slabs
+
+/*
+ * A heap with a quick_max does not coalesce the small blocks it gets back
+ * right away. Such a block stays marked busy, so its neighbours and their
+ * p-bits are left as they are, and waits on the quick list for its size.
+ * It is CACHED, like a block in a thread cache. A request of exactly that size takes it back without a search or
+ * a split. The waiting blocks are freed and coalesced in one batch when a
+ * request finds no free block or more than QUICK_LIMIT bytes are waiting.
+ */
+#define QUICK_MAX_SIZE 1024
+#define QUICK_BINS ((QUICK_MAX_SIZE + HDR_SIZE) / ALIGN + 1)
+#define QUICK_LIMIT (256 << 10)
+
+/*
+ * A pool hands out objects of one size from chunks it takes from the
+ * default heap. A chunk is a block of pool->chunk_size bytes (a power of
+ * two) on a chunk_size boundary, so the chunk of an object is found by
+ * rounding its address down. Like a slab, a chunk keeps its free objects
+ * on a list and takes the ones never handed out in order. Chunks with free
+ * objects are on the pool's 'partial' list, every chunk is on 'chunks'.
+ */
+#define POOL_CHUNK_MIN (16 << 10)
+#define POOL_CHUNK_OBJS 32 //a chunk holds at least this many objects
+#define POOL_MAGIC 0x706f6f6cul
+
+typedef struct pool_chunk {
+    unsigned long magic; //POOL_MAGIC ^ address of the chunk
+    mem_pool *pool;
+    struct pool_chunk *next; //all chunks
+    struct pool_chunk *prev;
+    struct pool_chunk *next_partial; //chunks with free objects
+    struct pool_chunk *prev_partial;
+    void *free; //free objects
+    size_t used; //objects handed out
+    size_t fresh; //objects from here on were never handed out
+} pool_chunk;
+
+/*
+ * An arena bumps 'top' through its current chunk and takes a new chunk
+ * from the default heap when a request does not fit. Chunks are listed
+ * newest first, so restoring a marker frees the chunks in front of the
+ * marker's one. Arena_Reset keeps the oldest chunk for reuse.
+ */
+#define ARENA_CHUNK (64 << 10)
+
+typedef struct arena_chunk {
+    struct arena_chunk *next; //older chunk
+    char *end;
+} arena_chunk;
+
+#define ARENA_HDR ((sizeof(arena_chunk) + ALIGN - 1) & ~(size_t)(ALIGN - 1))
+
+struct mem_arena {
+    size_t chunk_size;
+    arena_chunk *chunks; //the current one first
+    char *top;
+};
+
+struct mem_pool {
+    pthread_mutex_t lock;
+    size_t obj_size;
+    size_t obj_offset; //of the first object in a chunk
+    size_t chunk_size;
+    size_t chunk_objs;
+    pool_chunk *chunks;
+    pool_chunk *partial;
+    mem_pool *next; //on 'pools', for the fork handlers
+    mem_pool *prev;
+};
+
+static mem_pool *pools = NULL;
+static pthread_mutex_t pools_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Everything that describes one heap: its chunks of blocks, the free lists
+ * over them and the lock that guards both.
+ *
+ * The default heap used by Alloc_Mem/Free_Mem lives in the static 'heaps'
+ * array. A heap made by Heap_Create has its own mapping and keeps this
+ * struct at the start of it, in front of its first block.
+ *
+ * Init_Mem_Opts can split its region into several heaps. Each thread is
+ * bound to one of them (round robin) and allocates from it. A block freed
+ * by a thread bound to a different heap is not freed under the owner's lock;
+ * it is pushed on the owner's 'remote' queue instead, a lock-free stack
+ * with many producers and a single consumer. The owner takes the whole
+ * queue with one atomic exchange and frees the batch on its next Alloc_Mem.
+ */
+struct mem_heap {
+    pthread_mutex_t lock;
+    int policy;
+    size_t max_size; //largest block a request may round up to
+    mem_chunk first_chunk;
+    mem_chunk *last_chunk;
+
+    size_t grow_next; //size of the next chunk to map, 0 if the heap can't grow
+    int grow_pct; //each chunk is this percentage of the one before
+
+    blk_hdr *free_lists[NUM_CLASSES];
+    unsigned long free_map;
+
+    blk_hdr *tlsf_lists[FL_COUNT][SL_COUNT];
+    unsigned long fl_map;
+    unsigned int sl_map[FL_COUNT];
+
+    blk_hdr *free_list; //MEM_POLICY_ADDR and MEM_POLICY_LIFO
+    blk_hdr *addr_hint; //free block in front of the one unlinked last
+    size_t free_bytes; //in blocks on the free lists
+    size_t free_blocks;
+
+    cached_blk *remote; //blocks freed by threads bound to other heaps
+
+    size_t purge_threshold; //free blocks this big are purged, 0 for never
+    int purge_decay; //ms a block stays free before it is purged
+    int purge_advice; //MADV_ value passed to madvise
+    int purge_pending; //a large free block is waiting to be purged
+    unsigned long clock; //ms, read whenever the lock is taken
+    unsigned long next_sweep; //when the oldest waiting block is due
+    long long purged_bytes;
+    long long refaulted_bytes;
+
+    void *map_base; //own mapping of a Heap_Create heap, NULL for Init_Mem's
+    int map_flags; //MEM_MAP_ flags chunks are mapped with
+
+    size_t mmap_threshold; //requests this big get their own mapping, 0 never
+    mapped_blk *mapped; //blocks that have their own mapping
+    size_t mapped_bytes; //mapped for them
+
+    int slab; //small requests come from slabs
+    pthread_mutex_t slab_lock;
+    slab *slabs[SLAB_CLASSES]; //slabs with free slots, per slot size
+
+    size_t quick_max; //blocks up to this size wait on quick lists, 0 never
+    size_t quick_bytes; //waiting on the quick lists
+    cached_blk *quick[QUICK_BINS]; //per block size / ALIGN
+};
+
+#define MAX_HEAPS 64
+
+static mem_heap heaps[MAX_HEAPS];
+static int num_heaps = 0;
+static int next_heap = 0; //round robin thread binding
+static char *heap_base = NULL; //heap i spans heap_base + i * heap_span
+static char *heap_end = NULL; //the last heap also takes the remainder
+static size_t heap_span = 0;
+
+/*
+ * Chunks the default heaps grew by, so Free_Mem can find the owner of a
+ * block outside of the Init_Mem region. Entries are only ever appended
+ * (under grown_lock) and 'end' only ever grows, so readers need no lock.
+ * Once the table is full the default heaps only grow by merging.
+ */
+#define MAX_GROWN 1024
+
+static struct {
+    char *start;
+    char *end;
+    mem_heap *heap;
+} grown[MAX_GROWN];
+static int num_grown = 0;
+static pthread_mutex_t grown_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Each thread also keeps a cache of the small blocks it freed, one bin per
+ * block size up to TCACHE_MAX_SIZE. A cached block stays marked busy in the
+ * heap, so neighbours never coalesce with it. Alloc_Mem and Free_Mem serve
+ * small sizes from the cache without locking; the heap lock is only taken
+ * on a cache miss and when a full bin is flushed back to the heap.
+ * Only blocks of the thread's own heap are ever cached.
+ */
+#define TCACHE_MAX_SIZE 64
+#define TCACHE_BINS (TCACHE_MAX_SIZE / ALIGN + 1)
+#define TCACHE_BIN_MAX 32 //a bin this full is flushed down to half
+
+/*
+ * A thread's frees are only cached once it allocated from the default
+ * heaps and so armed the exit hook that flushes the cache: the C library
+ * frees (but does not allocate) while it tears a thread down, after the
+ * last thread-specific destructor, and a block cached then would be lost.
+ */
+typedef struct tcache {
+    mem_heap *heap; //heap the thread is bound to
+    int caching; //0 not yet, 1 frees are cached, -1 the exit hook ran
+    cached_blk *bins[TCACHE_BINS];
+    int counts[TCACHE_BINS];
+} tcache;
+
+static __thread tcache tc;
+
+/*
+ * Set by blk_take for the calling thread when the block it carved is known
+ * to read as zero between lo and hi, so Calloc_Mem can skip that part
+ */
+static __thread struct {
+    blk_hdr *blk;
+    char *lo;
+    char *hi;
+} zero_hint;
+static void tcache_key_init(void);
+static pthread_key_t tcache_key;
+static pthread_once_t tcache_once = PTHREAD_ONCE_INIT;
+/*
+ * Set once tcache_destroy ran for the calling thread. The C library may
+ * still allocate and free after the last thread-specific destructor (as it
+ * tears a thread down), so from then on the thread keeps nothing of its
+ * own that its exit would have to hand back.
+ */
+static __thread int thread_exited;
+
+/*
+ * Allocations and frees through the default heaps, counted per thread so
+ * Alloc_Mem and Free_Mem never share a cache line or take a lock for them.
+ * Only the owning thread writes its counters; Get_Mem_Stats adds up every
+ * thread on 'stats_threads' under stats_lock, and an exiting thread adds
+ * its counts to 'stats_retired' before it leaves the list.
+ * The counters are not in thread-local storage: a thread whose first call
+ * comes from the C library tearing it down never gets to its exit hook,
+ * so they come from mappings that are never unmapped and such a thread's
+ * stay on the list. The counters of exited threads are reused.
+ */
+enum { STAT_ALLOCS, STAT_FREES, STAT_FAILED, STAT_COUNT };
+
+typedef struct thread_stats {
+    size_t count[STAT_COUNT];
+    struct thread_stats *next;
+    struct thread_stats *prev;
+} thread_stats;
+
+#define STATS_MAP (64 << 10) //mapped at a time for counters
+
+static __thread thread_stats *ts;
+static thread_stats *stats_threads = NULL;
+static thread_stats *stats_spare = NULL; //of exited threads, on 'next'
+static thread_stats stats_retired;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+
+/*
+ * Tracing of the default heaps, see Trace_Mem_Start
+ * A thread appends records to a buffer of its own and writes the buffer
+ * to trace_fd when it is full, without a lock. 'busy' is set while the
+ * owner appends or writes, so Trace_Mem_Stop can wait for it before it
+ * writes out what is left. The buffers are on 'trace_bufs', an exiting
+ * thread writes out and unlinks its own.
+ */
+#define TRACE_BUF_RECS 8192
+
+typedef struct trace_buf {
+    struct trace_buf *next;
+    struct trace_buf *prev;
+    int busy;
+    int len;
+    uint16_t thread;
+    mem_trace_rec recs[TRACE_BUF_RECS];
+} trace_buf;
+
+static int trace_on = 0;
+static int trace_fd = -1;
+static int trace_error = 0; //a write failed
+static uint64_t trace_start;
+static uint16_t trace_threads = 0;
+static trace_buf *trace_bufs = NULL;
+static pthread_mutex_t trace_lock = PTHREAD_MUTEX_INITIALIZER;
+static __thread trace_buf *tbuf;
+static __thread int trace_thread; //id of the thread plus 1, 0 for none yet
+static __thread int trace_nested; //inside a traced call, don't trace again
+
+static void trace_write(const void *data, size_t len);
+
+/*
+ * Helper function for bit-masking
+ * Returns the last 2 bits of the address as an integer
+ * Returns 0 for both free
+ * Returns 1 for current alloc prev free
+ * Returns 2 for prev alloc current free
+ * Returns 3 for both alloc
+ * Plus 4 for a purged free block
+ * -1 if Null address
+ */
+ int bitmask(blk_hdr* blk){
+   if(blk != NULL){
+     return (int)((blk->size_status) & 7);
+   }
+     return -1;
+ }
+/*
+ * Helper funtion for getting address without the status
+ * Masks the last 3 bit away
+ * Returns size of blk
+ * Returns 0 if Null addr
+ */
+ size_t blksize(blk_hdr* blk){
+   if(blk != NULL){
+     return (blk->size_status) - bitmask(blk);
+   }
+   return 0;
+ }
+
+/*
+ * Helper function for getting the free list links of a free block
+ */
+static free_links* links(blk_hdr* blk) {
+    return (free_links*) ((char*)blk + HDR_SIZE);
+}
+
+/*
+ * Helper function for getting the time a large free block was freed
+ */
+static unsigned long* freed_at(blk_hdr* blk) {
+    return (unsigned long*) ((char*)blk + HDR_SIZE + sizeof(free_links));
+}
+
+/*
+ * Helper function for finding the whole pages of the free block blk of
+ * 'size' bytes that can be purged, i.e. those past freed_at and before the
+ * footer
+ * Sets *lo to the first of them and returns how many bytes they span
+ */
+static long purge_range(blk_hdr* blk, size_t size, char **lo) {
+    unsigned long pagesize = getpagesize();
+    unsigned long start = (unsigned long)(freed_at(blk) + 1);
+    unsigned long end = (unsigned long)blk + size - HDR_SIZE;
+
+    start = (start + pagesize - 1) & ~(pagesize - 1);
+    end &= ~(pagesize - 1);
+    *lo = (char*)start;
+    return (end > start) ? (long)(end - start) : 0;
+}
+
+/*
+ * Helper function for mapping a block size to its segregated list
+ * Returns the index of the highest set bit of size
+ */
+static int size_class(size_t size) {
+    return SIZE_BITS - 1 - __builtin_clzl(size);
+}
+
+/*
+ * Pushes the free block blk on the front of the list for its size class
+ */
+static void seg_insert(mem_heap *h, blk_hdr* blk) {
+    int cls = size_class(blksize(blk));
+    free_links *l = links(blk);
+
+    l->prev = NULL;
+    l->next = h->free_lists[cls];
+    if (l->next != NULL) {
+        links(l->next)->prev = blk;
+    }
+    h->free_lists[cls] = blk;
+    h->free_map |= 1ul << cls;
+}
+
+/*
+ * Unlinks the free block blk from the list for its size class
+ */
+static void seg_remove(mem_heap *h, blk_hdr* blk) {
+    int cls = size_class(blksize(blk));
+    free_links *l = links(blk);
+
+    if (l->prev != NULL) {
+        links(l->prev)->next = l->next;
+    } else {
+        h->free_lists[cls] = l->next;
+        if (l->next == NULL) {
+            h->free_map &= ~(1ul << cls);
+        }
+    }
+    if (l->next != NULL) {
+        links(l->next)->prev = l->prev;
+    }
+}
+
+/*
+ * Returns the smallest free block of at least 'size' bytes or NULL
+ * Only the list for the size class of 'size' and the lists above it are
+ * searched. Blocks in a higher class are all big enough, so the first
+ * non-empty one holds the best fit if the own class did not.
+ */
+static blk_hdr* seg_find(mem_heap *h, size_t size) {
+    int cls = size_class(size);
+    unsigned long map = h->free_map & (~0ul << cls);
+    blk_hdr *best_fit = NULL;
+
+    while (map != 0) {
+        cls = __builtin_ctzl(map);
+        for (blk_hdr *curr = h->free_lists[cls]; curr != NULL;
+             curr = links(curr)->next) {
+            size_t currSize = blksize(curr);
+            if (currSize >= size &&
+                (best_fit == NULL || currSize < blksize(best_fit))) {
+                best_fit = curr;
+                if (currSize == size) { //can't do better than exact
+                    return best_fit;
+                }
+            }
+        }
+        if (best_fit != NULL) {
+            return best_fit;
+        }
+        map &= map - 1; //next non-empty class
+    }
+    return NULL;
+}
+
+/*
+ * Helper function for mapping a block size to its TLSF list
+ * Sets *fl and *sl to the first and second level index
+ */
+static void tlsf_mapping(size_t size, int *fl, int *sl) {
+    if (size < (1ul << FL_SHIFT)) {
+        *fl = 0;
+        *sl = (int)(size >> (FL_SHIFT - SL_LOG2));
+    } else {
+        int msb = SIZE_BITS - 1 - __builtin_clzl(size);
+        *fl = msb - FL_SHIFT + 1;
+        *sl = (int)(size >> (msb - SL_LOG2)) ^ SL_COUNT;
+    }
+}
+
+/*
+ * Pushes the free block blk on the front of its TLSF list
+ */
+static void tlsf_insert(mem_heap *h, blk_hdr* blk) {
+    int fl, sl;
+    free_links *l = links(blk);
+
+    tlsf_mapping(blksize(blk), &fl, &sl);
+    l->prev = NULL;
+    l->next = h->tlsf_lists[fl][sl];
+    if (l->next != NULL) {
+        links(l->next)->prev = blk;
+    }
+    h->tlsf_lists[fl][sl] = blk;
+    h->fl_map |= 1ul << fl;
+    h->sl_map[fl] |= 1u << sl;
+}
+
+/*
+ * Unlinks the free block blk from its TLSF list
+ */
+static void tlsf_remove(mem_heap *h, blk_hdr* blk) {
+    int fl, sl;
+    free_links *l = links(blk);
+
+    tlsf_mapping(blksize(blk), &fl, &sl);
+    if (l->prev != NULL) {
+        links(l->prev)->next = l->next;
+    } else {
+        h->tlsf_lists[fl][sl] = l->next;
+        if (l->next == NULL) {
+            h->sl_map[fl] &= ~(1u << sl);
+            if (h->sl_map[fl] == 0) {
+                h->fl_map &= ~(1ul << fl);
+            }
+        }
+    }
+    if (l->next != NULL) {
+        links(l->next)->prev = l->prev;
+    }
+}
+
+/*
+ * Returns a free block of at least 'size' bytes or NULL in constant time
+ * 'size' is rounded up to the next list boundary first, so the head of the
+ * first non-empty list at or above it always fits.
+ * Only when that finds nothing is the list 'size' itself maps to searched,
+ * as it may still hold a block that fits (e.g. a request for nearly the
+ * whole heap)
+ */
+static blk_hdr* tlsf_find(mem_heap *h, size_t size) {
+    size_t rounded = size;
+    int fl, sl;
+
+    if (rounded >= (1ul << FL_SHIFT)) {
+        rounded += (1ul << (SIZE_BITS - 1 - __builtin_clzl(rounded) - SL_LOG2)) - 1;
+    }
+    tlsf_mapping(rounded, &fl, &sl);
+
+    unsigned int map = (fl < FL_COUNT) ? h->sl_map[fl] & (~0u << sl) : 0;
+    if (map == 0 && fl + 1 < FL_COUNT) { //try the next non-empty level
+        unsigned long fl_map = h->fl_map & (~0ul << (fl + 1));
+        if (fl_map != 0) {
+            fl = __builtin_ctzl(fl_map);
+            map = h->sl_map[fl];
+        }
+    }
+    if (map != 0) {
+        sl = __builtin_ctz(map);
+        return h->tlsf_lists[fl][sl];
+    }
+
+    tlsf_mapping(size, &fl, &sl);
+    for (blk_hdr *curr = h->tlsf_lists[fl][sl]; curr != NULL;
+         curr = links(curr)->next) {
+        if (blksize(curr) >= size) {
+            return curr;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Puts the free block blk on the single free list, after 'prev' (at the
+ * head if prev is NULL)
+ */
+static void single_insert(mem_heap *h, blk_hdr* prev, blk_hdr* blk) {
+    free_links *l = links(blk);
+
+    l->prev = prev;
+    l->next = (prev != NULL) ? links(prev)->next : h->free_list;
+    if (l->next != NULL) {
+        links(l->next)->prev = blk;
+    }
+    if (prev != NULL) {
+        links(prev)->next = blk;
+    } else {
+        h->free_list = blk;
+    }
+}
+
+/*
+ * Puts the free block blk on the single free list in address order
+ * The walk starts at addr_hint, forward or backward depending on which
+ * side of it blk goes, or at the head when there is no hint
+ */
+static void addr_insert(mem_heap *h, blk_hdr* blk) {
+    blk_hdr *prev = h->addr_hint;
+
+    while (prev != NULL && prev > blk) {
+        prev = links(prev)->prev;
+    }
+    blk_hdr *next = (prev != NULL) ? links(prev)->next : h->free_list;
+    while (next != NULL && next < blk) {
+        prev = next;
+        next = links(next)->next;
+    }
+    single_insert(h, prev, blk);
+}
+
+/*
+ * Unlinks the free block blk from the single free list
+ */
+static void single_remove(mem_heap *h, blk_hdr* blk) {
+    free_links *l = links(blk);
+
+    if (l->prev != NULL) {
+        links(l->prev)->next = l->next;
+    } else {
+        h->free_list = l->next;
+    }
+    if (l->next != NULL) {
+        links(l->next)->prev = l->prev;
+    }
+    h->addr_hint = l->prev; //blk is most likely put back where it was
+}
+
+/*
+ * Returns the first free block of at least 'size' bytes on the single
+ * free list or NULL
+ */
+static blk_hdr* single_find(mem_heap *h, size_t size) {
+    for (blk_hdr *curr = h->free_list; curr != NULL; curr = links(curr)->next) {
+        if (blksize(curr) >= size) {
+            return curr;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Puts the free block blk on the free list picked by the policy
+ */
+static void list_insert(mem_heap *h, blk_hdr* blk) {
+    if (h->purge_threshold > 0 && blksize(blk) >= h->purge_threshold &&
+        !(blk->size_status & PURGED)) { //start its decay
+        *freed_at(blk) = h->clock;
+        if (!h->purge_pending) {
+            h->purge_pending = 1;
+            h->next_sweep = h->clock + h->purge_decay;
+        }
+    }
+    h->free_bytes += blksize(blk);
+    h->free_blocks++;
+    if (h->policy == MEM_POLICY_TLSF) {
+        tlsf_insert(h, blk);
+    } else if (h->policy == MEM_POLICY_ADDR) {
+        addr_insert(h, blk);
+    } else if (h->policy == MEM_POLICY_LIFO) {
+        single_insert(h, NULL, blk);
+    } else {
+        seg_insert(h, blk);
+    }
+}
+
+/*
+ * Takes the free block blk off its free list
+ * Must be called before the size of blk is changed
+ */
+static void list_remove(mem_heap *h, blk_hdr* blk) {
+    h->free_bytes -= blksize(blk);
+    h->free_blocks--;
+    if (h->policy == MEM_POLICY_TLSF) {
+        tlsf_remove(h, blk);
+    } else if (h->policy == MEM_POLICY_ADDR || h->policy == MEM_POLICY_LIFO) {
+        single_remove(h, blk);
+    } else {
+        seg_remove(h, blk);
+    }
+}
+
+/*
+ * Returns a free block of at least 'size' bytes or NULL
+ */
+static blk_hdr* find_fit(mem_heap *h, size_t size) {
+    if (h->policy == MEM_POLICY_TLSF) {
+        return tlsf_find(h, size);
+    }
+    if (h->policy == MEM_POLICY_ADDR || h->policy == MEM_POLICY_LIFO) {
+        return single_find(h, size);
+    }
+    return seg_find(h, size);
+}
  
 /*
- * Helper function for bit-masking
- * Returns the last 2 bits of the address as an integer
- * Returns 0 for both free
- * Returns 1 for current alloc prev free
- * Returns 2 for prev alloc current free
- * Returns 3 for both alloc
- * -1 if Null address
+ * Rounds a request of 'size' payload bytes up to a block size
+ * The header is added, the total is rounded up to a multiple of ALIGN and
+ * to at least MIN_BLK_SIZE
+ * Returns 0 when the request can never be satisfied by heap h
+ */
+static size_t blk_round(mem_heap *h, size_t size) {
+    //checks for abnormally large requests (or negative ones) and zero
+    if(size == 0 || size > h->max_size){
+      return 0;
+    }
+    
+    size += HDR_SIZE; //add header
+    //round up and add padding
+    size_t pad = size % ALIGN;
+    if(pad != 0){
+      pad = ALIGN - pad;
+    }
+    size = size + pad;
+    if(size < MIN_BLK_SIZE){ //must be able to hold the links once freed
+      size = MIN_BLK_SIZE;
+    }
+    if(size > h->max_size){ //if request ends up larger than size after including pad and header
+      return 0;
+    }
+    return size;
+}
+
+/*
+ * Turns the free block curr_hdr of heap h into a busy block of 'size'
+ * bytes, caller must hold h->lock
+ * - Take the block off its free list
+ * - Split it into two blocks when the rest is big enough for a free block
+ */
+static void blk_take(mem_heap *h, blk_hdr *curr_hdr, size_t size) {
+    list_remove(h, curr_hdr);
+    size_t currSize = blksize(curr_hdr);
+    size_t purged = curr_hdr -> size_status & PURGED;
+    long refaulted = 0;
+    char *lo;
+    blk_hdr *next = (blk_hdr*)((char*)curr_hdr + currSize);
+
+    zero_hint.blk = NULL;
+    if(purged){ //its purged pages fault back in, except those of the remainder
+      refaulted = purge_range(curr_hdr, currSize, &lo);
+      if(h->purge_advice == MADV_DONTNEED){ //dropped pages read as zero
+        zero_hint.blk = curr_hdr;
+        zero_hint.lo = lo;
+        zero_hint.hi = lo + refaulted;
+      }
+    }
+    if(blksize(next) == 0){ //last block of its chunk, may be fresh
+      mem_chunk *c = &h->first_chunk;
+      while(c->end_mark != next){
+        c = c->next;
+      }
+      char *fresh_end = (currSize - size < MIN_BLK_SIZE) ? (char*)next - HDR_SIZE
+                                                         : (char*)curr_hdr + size;
+      if(c->fresh < fresh_end &&
+         (zero_hint.blk == NULL || fresh_end - c->fresh > zero_hint.hi - zero_hint.lo)){
+        zero_hint.blk = curr_hdr;
+        zero_hint.lo = c->fresh;
+        zero_hint.hi = fresh_end; //the footer is not fresh
+      }
+      if(currSize - size < MIN_BLK_SIZE){
+        c->fresh = (char*)next;
+      }else if(c->fresh < (char*)curr_hdr + size + FREE_META){
+        c->fresh = (char*)curr_hdr + size + FREE_META; //front of the remainder
+      }
+    }
+    
+    //Allocating
+    if(currSize - size < MIN_BLK_SIZE) { //Exact fit, remainder too small to split
+      curr_hdr -> size_status = currSize + (curr_hdr -> size_status & 2) + 1;//a-bit ON
+      blk_hdr *next = (blk_hdr*)((char*)curr_hdr + currSize);
+      //p-bit for next hdr ON, end_mark included; it may be cached meanwhile
+      __atomic_fetch_add(&next->size_status, 2, __ATOMIC_RELAXED);
+    } else { //Splitting
+      blk_hdr *newHeader = (blk_hdr*) ((char*)curr_hdr + size); //new free Header
+      size_t newSize = currSize - size;
+      newHeader -> size_status = newSize + 2 + purged; //newSize/10, still purged
+      blk_hdr *footer = (blk_hdr*) ((char*)newHeader + newSize - HDR_SIZE); //new Footer
+      footer -> size_status = newSize;
+      list_insert(h, newHeader);
+      if(purged){
+        refaulted -= purge_range(newHeader, newSize, &lo);
+      }else if(h->purge_threshold > 0 && newSize >= h->purge_threshold){
+        *freed_at(newHeader) = *freed_at(curr_hdr); //its pages are no younger
+      }
+      
+      curr_hdr -> size_status = size + (curr_hdr -> size_status & 2);//new alloc' header, p-bit if any
+      curr_hdr -> size_status += 1;//a-bit ON
+    }
+    h->refaulted_bytes += refaulted;
+}
+
+/*
+ * Returns how many bytes a free block must have to hold a block of 'size'
+ * bytes whose payload is aligned to 'align' (a power of two, 0 for ALIGN),
+ * wherever the free block starts
+ */
+static size_t aligned_need(size_t size, size_t align) {
+    return (align > ALIGN) ? size + align + MIN_BLK_SIZE : size;
+}
+
+/*
+ * Function for splitting off the front of the free block curr_hdr so that
+ * the block after it has a payload aligned to 'align', caller must hold
+ * h->lock
+ * The front goes back on the free lists, it is never smaller than a free
+ * block so nothing is wasted. curr_hdr must have aligned_need() bytes.
+ * Returns the free block that starts at the aligned spot
+ */
+static blk_hdr* blk_align(mem_heap *h, blk_hdr *curr_hdr, size_t align) {
+    uintptr_t payload = (uintptr_t)curr_hdr + HDR_SIZE;
+    uintptr_t aligned = (payload + align - 1) & ~(uintptr_t)(align - 1);
+
+    while(aligned != payload && aligned - payload < MIN_BLK_SIZE){
+      aligned += align; //front too small to be a free block
+    }
+    size_t lead = aligned - payload;
+    if(lead == 0){ //already aligned
+      return curr_hdr;
+    }
+
+    size_t currSize = blksize(curr_hdr);
+    size_t bits = curr_hdr -> size_status & (2 | PURGED);
+    list_remove(h, curr_hdr);
+
+    blk_hdr *rest = (blk_hdr*) ((char*)curr_hdr + lead);
+    curr_hdr -> size_status = lead + bits; //front keeps p-bit, purged if it was
+    ((blk_hdr*) ((char*)rest - HDR_SIZE)) -> size_status = lead; //its footer
+    rest -> size_status = (currSize - lead) + (bits & PURGED); //prev free
+    ((blk_hdr*) ((char*)rest + currSize - lead - HDR_SIZE)) -> size_status =
+        currSize - lead;
+    list_insert(h, curr_hdr);
+    list_insert(h, rest);
+    return rest;
+}
+
+static int quick_flush(mem_heap *h);
+
+/* 
+ * Function for allocating a block of 'size' bytes (header included) from
+ * heap h, caller must hold h->lock
+ * Argument - align: alignment of the payload if bigger than ALIGN, else 0
+ * Returns address of allocated block on success 
+ * Returns NULL on failure 
+ * - Take a block of exactly that size off its quick list if there is one
+ * - Search the free lists for the best free block which can accommodate the requested size 
+ * - When none fits, coalesce the blocks on the quick lists and search again
+ * - Split off the front of the block when the payload has to be aligned
+ * - Also, when allocating a block - split it into two blocks
+ */                    
+static void* heap_alloc(mem_heap *h, size_t size, size_t align) { 
+    if(size <= h->quick_max && align == 0 && h->quick[size / ALIGN] != NULL){
+      cached_blk *c = h->quick[size / ALIGN];
+      h->quick[size / ALIGN] = c->next;
+      h->quick_bytes -= size;
+      blk_uncache((blk_hdr*) ((char*)c - HDR_SIZE));
+      zero_hint.blk = NULL;
+      return c;
+    }
+
+    //Looking for free blk
+    blk_hdr *curr_hdr = find_fit(h, aligned_need(size, align));
+    if(curr_hdr == NULL && h->quick_bytes > 0 && quick_flush(h) > 0){
+      curr_hdr = find_fit(h, aligned_need(size, align));
+    }
+    if(curr_hdr == NULL){ //No free space
+      return NULL;
+    }
+    if(align > ALIGN){
+      curr_hdr = blk_align(h, curr_hdr, align);
+    }
+    blk_take(h, curr_hdr, size);
+    
+    return (void*) ((char*)curr_hdr + HDR_SIZE);//return payload
+}
+
+/*
+ * Gives the 'len' bytes of whole pages at lo back to the OS
+ * Returns 0 on success and -1 if madvise failed
+ */
+static int purge_pages(mem_heap *h, char *lo, long len) {
+    if (madvise(lo, len, h->purge_advice) != 0) {
+        if (h->purge_advice == MADV_DONTNEED ||
+            madvise(lo, len, MADV_DONTNEED) != 0) {
+            return -1;
+        }
+        h->purge_advice = MADV_DONTNEED; //MADV_FREE not supported here
+    }
+    h->purged_bytes += len;
+    return 0;
+}
+
+/*
+ * Keeps the free block blk purged after it was coalesced from purged and
+ * resident blocks, by purging the pages of blk that the purged blocks did
+ * not cover. r holds the pages of the n purged blocks in address order as
+ * {start, length} pairs.
+ * Returns 0 on success and -1 if blk could not be purged
+ */
+static int purge_merge(mem_heap *h, blk_hdr *blk, char *r[][2], int n) {
+    char *lo;
+    long len = purge_range(blk, blksize(blk), &lo);
+    char *hi = lo + len;
+
+    for (int i = 0; i <= n && lo < hi; i++) {
+        char *gap_end = (i < n && r[i][0] < hi) ? r[i][0] : hi;
+        if (gap_end > lo && purge_pages(h, lo, gap_end - lo) != 0) {
+            return -1;
+        }
+        if (i < n && r[i][1] > lo) {
+            lo = r[i][1];
+        }
+    }
+    return 0;
+}
+
+/* 
+ * Function for giving the busy block curr_hdr back to heap h,
+ * caller must hold h->lock
+ * - Mark the block as free 
+ * - Coalesce if one or both of the immediate neighbours are free 
+ * - Put the coalesced block on its free list
+ */                    
+static void heap_free(mem_heap *h, blk_hdr *curr_hdr) {                        
+    blk_hdr *temp = NULL;
+    size_t freed = blksize(curr_hdr);
+    char *purged[2][2]; //pages of purged neighbours, in address order
+    int npurged = 0;
+    
+    //check prev block
+    if((curr_hdr -> size_status & 2) == 0){//prev block free
+      temp = (blk_hdr*) ((char*)curr_hdr - HDR_SIZE);
+      size_t footer = temp->size_status;
+      temp = (blk_hdr*) ((char*)curr_hdr - footer); //temp at prev addr
+      if(temp -> size_status & PURGED){
+        long len = purge_range(temp, footer, &purged[npurged][0]);
+        purged[npurged][1] = purged[npurged][0] + len;
+        npurged++;
+      }
+      list_remove(h, temp);
+      temp -> size_status += blksize(curr_hdr);
+      curr_hdr = temp;
+    }
+    
+    //check next block
+    temp = (blk_hdr*) ((char*)curr_hdr + blksize(curr_hdr));
+    if((temp -> size_status & 1) == 0){//next block free
+      if(temp -> size_status & PURGED){
+        long len = purge_range(temp, blksize(temp), &purged[npurged][0]);
+        purged[npurged][1] = purged[npurged][0] + len;
+        npurged++;
+      }
+      list_remove(h, temp);
+      curr_hdr -> size_status += blksize(temp);
+    }else{
+      __atomic_fetch_sub(&temp->size_status, 2, __ATOMIC_RELAXED); //turn p-bit off
+    }
+    
+    //no coalesce or coalesce already set up
+    curr_hdr -> size_status = blksize(curr_hdr) + 2; //curr_hdr/10
+    temp = (blk_hdr*) ((char*)curr_hdr + blksize(curr_hdr) - HDR_SIZE);//footer addr
+    temp -> size_status = blksize(curr_hdr);//set footer
+
+    //a small block merged into a purged one is purged along with it, a large
+    //one makes the whole block resident and starts its decay
+    if(npurged > 0 && freed < h->purge_threshold &&
+       purge_merge(h, curr_hdr, purged, npurged) == 0){
+      curr_hdr -> size_status |= PURGED;
+    }
+    list_insert(h, curr_hdr);
+}
+
+/*
+ * Frees and coalesces every block waiting on the quick lists of heap h,
+ * caller must hold h->lock
+ * Returns the number of blocks freed
+ */
+static int quick_flush(mem_heap *h) {
+    int flushed = 0;
+
+    for (int bin = 0; bin < QUICK_BINS; bin++) {
+        while (h->quick[bin] != NULL) {
+            cached_blk *c = h->quick[bin];
+            h->quick[bin] = c->next;
+            heap_free(h, (blk_hdr*) ((char*)c - HDR_SIZE));
+            flushed++;
+        }
+    }
+    h->quick_bytes = 0;
+    return flushed;
+}
+
+/*
+ * Gives the busy block curr_hdr back to heap h, caller must hold h->lock
+ * and have marked it with blk_cache, so no other free of it gets this far
+ * A small block waits on its quick list when the heap has them, anything
+ * else is freed and coalesced right away
+ */
+static void heap_release(mem_heap *h, blk_hdr *curr_hdr) {
+    size_t size = blksize(curr_hdr);
+
+    if (size > h->quick_max) {
+        heap_free(h, curr_hdr);
+        return;
+    }
+    cached_blk *c = (cached_blk*) ((char*)curr_hdr + HDR_SIZE);
+    c->next = h->quick[size / ALIGN];
+    h->quick[size / ALIGN] = c;
+    h->quick_bytes += size;
+    if (h->quick_bytes > QUICK_LIMIT) {
+        quick_flush(h);
+    }
+}
+
+/*
+ * Function for resizing the busy block curr_hdr of heap h to 'size' bytes
+ * (header included) without moving it, caller must hold h->lock
+ * Returns 0 on success
+ * Returns -1 if the block would have to move
+ * - Shrinking splits off the tail as a free block, which coalesces with
+ *   the next block if that one is free
+ * - Growing takes what is missing from the front of the next block, which
+ *   must be free and big enough
+ */
+static int heap_resize(mem_heap *h, blk_hdr *curr_hdr, size_t size) {
+    size_t currSize = blksize(curr_hdr);
+
+    if(size <= currSize){ //Shrinking
+      if(currSize - size >= MIN_BLK_SIZE){ //tail big enough to be a block
+        blk_hdr *tail = (blk_hdr*) ((char*)curr_hdr + size);
+        tail -> size_status = (currSize - size) + 2 + 1; //busy, prev busy
+        curr_hdr -> size_status = size + (curr_hdr -> size_status & 3);
+        heap_free(h, tail);
+      }
+      return 0;
+    }
+
+    //Growing
+    blk_hdr *next = (blk_hdr*) ((char*)curr_hdr + currSize);
+    if((next -> size_status & 1) || currSize + blksize(next) < size){
+      return -1; //next block busy (or the end_mark) or too small
+    }
+    blk_take(h, next, size - currSize);
+    curr_hdr -> size_status += blksize(next); //absorb what was taken
+    return 0;
+}
+
+/*
+ * Gives the purgeable pages of the free block blk back to the OS and marks
+ * it purged, caller must hold h->lock
+ * Returns the number of bytes purged
+ */
+static long purge_blk(mem_heap *h, blk_hdr *blk) {
+    char *lo;
+    long len = purge_range(blk, blksize(blk), &lo);
+
+    if (len == 0 || purge_pages(h, lo, len) != 0) {
+        return 0;
+    }
+    blk->size_status |= PURGED;
+    return len;
+}
+
+/*
+ * Purges the free blocks of heap h of at least 'min' bytes that are not
+ * purged yet, caller must hold h->lock
+ * Unless 'force' is set only blocks that have been free for purge_decay ms
+ * are purged, and the sweep is rescheduled for the next one that is due.
+ * Only the free lists that can hold blocks of 'min' bytes are walked.
+ * Returns the number of bytes purged
+ */
+static long purge_sweep(mem_heap *h, size_t min, int force) {
+    long total = 0;
+    int pending = 0;
+    int first, count;
+    blk_hdr **lists;
+
+    if (h->policy == MEM_POLICY_TLSF) {
+        int fl, sl;
+        tlsf_mapping(min, &fl, &sl);
+        lists = &h->tlsf_lists[0][0];
+        first = fl * SL_COUNT;
+        count = FL_COUNT * SL_COUNT;
+    } else if (h->policy == MEM_POLICY_ADDR || h->policy == MEM_POLICY_LIFO) {
+        lists = &h->free_list;
+        first = 0;
+        count = 1;
+    } else {
+        lists = h->free_lists;
+        first = size_class(min);
+        count = NUM_CLASSES;
+    }
+
+    for (int i = first; i < count; i++) {
+        for (blk_hdr *curr = lists[i]; curr != NULL; curr = links(curr)->next) {
+            if ((curr->size_status & PURGED) || blksize(curr) < min) {
+                continue;
+            }
+            if (force || (long)(h->clock - *freed_at(curr)) >= h->purge_decay) {
+                total += purge_blk(h, curr);
+            } else if (!pending || (long)(*freed_at(curr) + h->purge_decay -
+                                          h->next_sweep) < 0) {
+                pending = 1;
+                h->next_sweep = *freed_at(curr) + h->purge_decay;
+            }
+        }
+    }
+    if (h->purge_threshold > 0 && min <= h->purge_threshold) {
+        h->purge_pending = pending;
+    }
+    return total;
+}
+
+/*
+ * Reads the clock used for purging, in milliseconds
+ */
+static unsigned long clock_ms(void) {
+    struct timespec ts;
+#ifdef CLOCK_MONOTONIC_COARSE
+    clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+#else
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+#endif
+    return (unsigned long)ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+/*
+ * Takes the lock of heap h for an allocation or a free
+ * A heap that purges also reads the clock, for stamping the blocks freed
+ */
+static void heap_lock(mem_heap *h) {
+    pthread_mutex_lock(&h->lock);
+    if (h->purge_threshold > 0) {
+        h->clock = clock_ms();
+    }
+}
+
+/*
+ * Releases the lock of heap h, purging the large free blocks that are due
+ * first
+ */
+static void heap_unlock(mem_heap *h) {
+    if (h->purge_pending && (long)(h->clock - h->next_sweep) >= 0) {
+        purge_sweep(h, h->purge_threshold, 0);
+    }
+    pthread_mutex_unlock(&h->lock);
+}
+
+/*
+ * Returns the heap whose region holds ptr, or NULL if ptr is outside of
+ * every heap
+ */
+static mem_heap* heap_of(void *ptr) {
+    if ((char*)ptr >= heap_base && (char*)ptr < heap_end) {
+        size_t idx = ((char*)ptr - heap_base) / heap_span;
+        return &heaps[(idx < (size_t)num_heaps) ? idx : (size_t)num_heaps - 1];
+    }
+
+    int n = __atomic_load_n(&num_grown, __ATOMIC_ACQUIRE);
+    for (int i = 0; i < n; i++) {
+        if ((char*)ptr >= grown[i].start &&
+            (char*)ptr < __atomic_load_n(&grown[i].end, __ATOMIC_ACQUIRE)) {
+            return grown[i].heap;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Pushes the payload of a busy block on the remote free queue of its
+ * owner h, without taking any lock
+ * Returns 0 on success and -1 if the block is free, or cached or queued
+ * already (by the owner's cache, a quick list or any thread's free)
+ */
+static int remote_push(mem_heap *h, void *ptr) {
+    cached_blk *c = ptr;
+
+    if (blk_cache((blk_hdr*) ((char*)ptr - HDR_SIZE)) != 0) {
+        return -1;
+    }
+    cached_blk *head = __atomic_load_n(&h->remote, __ATOMIC_RELAXED);
+    do {
+        c->next = head;
+    } while (!__atomic_compare_exchange_n(&h->remote, &head, c, 1,
+                                          __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+    return 0;
+}
+
+/*
+ * Frees every block on the remote free queue of h in one batch,
+ * caller must hold h->lock
+ * Returns the number of blocks freed
+ */
+static int remote_drain(mem_heap *h) {
+    cached_blk *c = __atomic_exchange_n(&h->remote, NULL, __ATOMIC_ACQUIRE);
+    int drained = 0;
+
+    while (c != NULL) {
+        cached_blk *next = c->next;
+        heap_release(h, (blk_hdr*) ((char*)c - HDR_SIZE));
+        c = next;
+        drained++;
+    }
+    return drained;
+}
+
+/*
+ * Returns the heap the calling thread allocates from, binding the thread
+ * to the next heap round robin on its first call
+ */
+static mem_heap* thread_heap(void) {
+    if (tc.heap == NULL) {
+        int idx = __atomic_fetch_add(&next_heap, 1, __ATOMIC_RELAXED);
+        tc.heap = &heaps[idx % num_heaps];
+        pthread_once(&tcache_once, tcache_key_init);
+        pthread_setspecific(tcache_key, &tc); //flush the cache on exit
+    }
+    return tc.heap;
+}
+
+/*
+ * Hands the cached blocks in 'bin' beyond the first 'keep' back to the
+ * thread's heap, taking its lock once for the whole batch
+ */
+static void tcache_flush(int bin, int keep) {
+    mem_heap *h = tc.heap;
+
+    heap_lock(h);
+    while (tc.counts[bin] > keep) {
+        cached_blk *c = tc.bins[bin];
+        tc.bins[bin] = c->next;
+        tc.counts[bin]--;
+        heap_release(h, (blk_hdr*) ((char*)c - HDR_SIZE));
+    }
+    heap_unlock(h);
+}
+
+/*
+ * Hands every block cached by the calling thread back to its heap
+ * Returns the number of blocks handed back
+ */
+static int tcache_flush_all(void) {
+    int flushed = 0;
+
+    for (int bin = 0; bin < TCACHE_BINS; bin++) {
+        if (tc.counts[bin] > 0) {
+            flushed += tc.counts[bin];
+            tcache_flush(bin, 0);
+        }
+    }
+    return flushed;
+}
+
+/*
+ * Thread exit hook, the cache of an exiting thread goes back to the heap
+ */
+static void tcache_destroy(void *arg) {
+    (void)arg;
+    thread_exited = 1;
+    tc.caching = -1; //frees after this go straight to the heap
+    tcache_flush_all();
+    if (tbuf != NULL) { //write out and drop the trace buffer
+        pthread_mutex_lock(&trace_lock);
+        if (trace_on && tbuf->len > 0) {
+            trace_write(tbuf->recs, sizeof(mem_trace_rec) * tbuf->len);
+        }
+        if (tbuf->prev != NULL) {
+            tbuf->prev->next = tbuf->next;
+        } else {
+            trace_bufs = tbuf->next;
+        }
+        if (tbuf->next != NULL) {
+            tbuf->next->prev = tbuf->prev;
+        }
+        pthread_mutex_unlock(&trace_lock);
+        munmap(tbuf, sizeof(trace_buf));
+        tbuf = NULL;
+    }
+    if (ts != NULL) { //keep the thread's counts
+        pthread_mutex_lock(&stats_lock);
+        for (int i = 0; i < STAT_COUNT; i++) {
+            stats_retired.count[i] += ts->count[i];
+        }
+        if (ts->prev != NULL) {
+            ts->prev->next = ts->next;
+        } else {
+            stats_threads = ts->next;
+        }
+        if (ts->next != NULL) {
+            ts->next->prev = ts->prev;
+        }
+        ts->next = stats_spare;
+        stats_spare = ts;
+        pthread_mutex_unlock(&stats_lock);
+        ts = NULL;
+    }
+}
+
+static void tcache_key_init(void) {
+    pthread_key_create(&tcache_key, tcache_destroy);
+}
+
+/*
+ * Makes sure tcache_destroy runs when the calling thread exits, even if
+ * it was bound to a heap before and the hook already ran once
+ */
+static void exit_hook(void) {
+    thread_heap();
+    pthread_setspecific(tcache_key, &tc);
+}
+
+/*
+ * Returns zeroed counters linked into 'stats_threads', NULL if there is
+ * no memory for them. Called with stats_lock held.
+ */
+static thread_stats* stats_link(void) {
+    if (stats_spare == NULL) {
+        thread_stats *t = mmap(NULL, STATS_MAP, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (t == MAP_FAILED) {
+            return NULL;
+        }
+        for (size_t i = 0; i < STATS_MAP / sizeof(*t); i++) {
+            t[i].next = stats_spare;
+            stats_spare = &t[i];
+        }
+    }
+    thread_stats *t = stats_spare;
+    stats_spare = t->next;
+    memset(t, 0, sizeof(*t));
+    t->next = stats_threads;
+    if (t->next != NULL) {
+        t->next->prev = t;
+    }
+    stats_threads = t;
+    return t;
+}
+
+/*
+ * Adds one to counter 'which' of the calling thread, linking counters for
+ * the thread into 'stats_threads' on its first call
+ * The store is atomic only so Get_Mem_Stats never reads a torn value,
+ * nothing else writes the counter. Nothing is counted before Init_Mem.
+ */
+static void stats_add(int which) {
+    if (num_heaps == 0) {
+        return;
+    }
+    if (ts == NULL) {
+        pthread_mutex_lock(&stats_lock);
+        if (!thread_exited) {
+            ts = stats_link();
+        }
+        if (ts == NULL) { //count it as retired right away
+            stats_retired.count[which]++;
+            pthread_mutex_unlock(&stats_lock);
+            return;
+        }
+        pthread_mutex_unlock(&stats_lock);
+        exit_hook(); //unlinks them
+    }
+    __atomic_store_n(&ts->count[which], ts->count[which] + 1,
+                     __ATOMIC_RELAXED);
+}
+
+static void* heap_grow_alloc(mem_heap *h, size_t size, size_t align);
+static void* mapped_alloc(mem_heap *h, size_t size, size_t align);
+static mapped_blk* mapped_of(mem_heap *heap, void *ptr);
+static int mapped_free(mem_heap *heap, void *ptr);
+static slab* slab_of(mem_heap *heap, void *ptr);
+static int slab_free(slab *s, void *ptr);
+
+/*
+ * Allocates a block of 'size' bytes aligned to 'align' (0 for ALIGN) from
+ * heap h under its lock, freeing whatever other threads queued for h first
+ */
+static void* heap_alloc_locked(mem_heap *h, size_t size, size_t align) {
+    heap_lock(h);
+    if (__atomic_load_n(&h->remote, __ATOMIC_RELAXED) != NULL) {
+        remote_drain(h);
+    }
+    void *ptr = heap_alloc(h, size, align);
+    heap_unlock(h);
+    return ptr;
+}
+
+/* 
+ * Function for allocating 'size' bytes aligned to 'align' (0 for ALIGN)
+ * from the default heap
+ * Returns address of allocated block on success 
+ * Returns NULL on failure 
+ * Here is what this function should accomplish 
+ * - Requests of at least the mmap threshold get a mapping of their own
+ * - Check for sanity of size - Return NULL when appropriate 
+ * - Round up size to a multiple of ALIGN 
+ * - Small blocks without a bigger alignment come from the calling thread's
+ *   cache when it has one
+ * - Anything else is allocated from the thread's heap under its lock
+ * - When that heap is full, the thread's cache is flushed and the heap
+ *   retried, then the other heaps are tried and then the heap grows
+ */                    
+static void* default_alloc(size_t size, size_t align) { 
+    if(num_heaps == 0){ //Init_Mem not called yet
+      return NULL;
+    }
+    mem_heap *h = thread_heap();
+    if(tc.caching == 0){
+      tc.caching = 1;
+    }
+    if(h->mmap_threshold > 0 && size >= h->mmap_threshold){
+      return mapped_alloc(h, size, align);
+    }
+    size = blk_round(h, size);
+    if(size == 0){
+      return NULL;
+    }
+
+    if(size <= TCACHE_MAX_SIZE && align == 0 && tc.bins[size / ALIGN] != NULL){ //cache hit
+      cached_blk *c = tc.bins[size / ALIGN];
+      tc.bins[size / ALIGN] = c->next;
+      tc.counts[size / ALIGN]--;
+      blk_uncache((blk_hdr*) ((char*)c - HDR_SIZE));
+      return c;
+    }
+
+    void *ptr = heap_alloc_locked(h, size, align);
+    if(ptr == NULL && tcache_flush_all() > 0){ //cached blocks may coalesce into a fit
+      ptr = heap_alloc_locked(h, size, align);
+    }
+    for(int i = 1; ptr == NULL && i < num_heaps; i++){ //borrow from the other heaps
+      ptr = heap_alloc_locked(&heaps[(h - heaps + i) % num_heaps], size, align);
+    }
+    if(ptr == NULL && h->grow_next > 0){ //map more memory
+      ptr = heap_grow_alloc(h, size, align);
+    }
+    return ptr;
+}
+
+/* 
+ * Function for freeing up a block allocated from the default heap
+ * Argument - ptr: Address of the block to be freed up 
+ * Returns 0 on success 
+ * Returns -1 on failure 
+ * Here is what this function should accomplish 
+ * - Return -1 if ptr is NULL
+ * - A slot of a slab goes back to its slab, -1 if it was not handed out
+ * - Return -1 if ptr is not ALIGN byte aligned or if the block is already freed
+ * - A block with a mapping of its own is unmapped
+ * - A block freed before counts as freed while it waits in any thread's
+ *   cache, on a quick list or on a remote free queue, too
+ * - A block of another thread's heap goes on that heap's remote free queue
+ * - Small blocks go to the calling thread's cache if it caches frees, a
+ *   full cache bin is flushed halfway back to the heap
+ * - Anything else is freed and coalesced in the heap under its lock
+ */                    
+static int default_free(void *ptr) {                        
+    //ptr checking
+    if(ptr == NULL){//NULL
+      return -1;
+    }
+    slab *s = slab_of(NULL, ptr);
+    if(s != NULL){ //a slot, not a block
+      return slab_free(s, ptr);
+    }
+    if(((uintptr_t)ptr % ALIGN) != 0){//ALIGN byte aligned
+      return -1;
+    }
+    mem_heap *owner = heap_of(ptr);
+    if(owner == NULL){ //not in a heap, maybe mapped on its own
+      return mapped_free(NULL, ptr);
+    }
+    
+    //Compute header
+    blk_hdr *curr_hdr = (blk_hdr*) ((char*)ptr - HDR_SIZE);
+    //only the p-bit of a busy block changes under us, and only under the heap lock
+    size_t status = __atomic_load_n(&curr_hdr->size_status, __ATOMIC_RELAXED);
+    size_t size = status & ~(size_t)7;
+
+    if((status & 1) == 0){ 
+      return -1; //block already free
+    }
+
+    if(owner != thread_heap()){
+      return remote_push(owner, ptr);
+    }
+
+    if(blk_cache(curr_hdr) != 0){
+      return -1; //freed before, maybe still in some thread's cache
+    }
+    if(size <= TCACHE_MAX_SIZE && tc.caching == 1){
+      cached_blk *c = ptr;
+      c->next = tc.bins[size / ALIGN];
+      tc.bins[size / ALIGN] = c;
+      if(++tc.counts[size / ALIGN] >= TCACHE_BIN_MAX){
+        tcache_flush(size / ALIGN, TCACHE_BIN_MAX / 2);
+      }
+      return 0;
+    }
+
+    heap_lock(owner);
+    heap_release(owner, curr_hdr);
+    heap_unlock(owner);
+    return 0;
+}
+
+/*
+ * Sets up chunk c over the 'len' bytes at base as one big free block
+ * base must be ALIGN byte aligned and len a multiple of ALIGN
+ * The new free block is not put on a free list
+ */
+static void chunk_init(mem_chunk *c, char *base, size_t len) {
+    c->next = NULL;
+    c->start = base;
+    c->end = base + len;
+
+    // for double word alignement and end mark
+    len -= ALIGN;
+
+    // To begin with there is only one big free block
+    // initialize heap so that first block meets 
+    // double word alignement requirement
+    c->first_blk = (blk_hdr*) base + 1;
+    c->end_mark = (blk_hdr*)((char*)c->first_blk + len);
+  
+    // Setting up the header
+    c->first_blk->size_status = len;
+
+    // Marking the previous block as busy
+    c->first_blk->size_status += 2;
+
+    // Setting up the end mark and marking it as busy
+    c->end_mark->size_status = 1;
+
+    // Setting up the footer
+    blk_hdr *footer = (blk_hdr*) ((char*)c->first_blk + len - HDR_SIZE);
+    footer->size_status = len;
+
+    c->fresh = (char*)c->first_blk + FREE_META;
+}
+
+/*
+ * Returns the size of the huge pages MAP_HUGETLB maps, from /proc/meminfo
+ */
+static size_t huge_page_size() {
+    static size_t size = 0;
+
+    if (size == 0) {
+        size_t kb = 2048; //the usual size if it can't be read
+        char line[128];
+        FILE *f = fopen("/proc/meminfo", "r");
+        while (f != NULL && fgets(line, sizeof(line), f) != NULL) {
+            if (sscanf(line, "Hugepagesize: %zu kB", &kb) == 1) {
+                break;
+            }
+        }
+        if (f != NULL) {
+            fclose(f);
+        }
+        size = kb << 10;
+    }
+    return size;
+}
+
+/*
+ * Returns len rounded up to a whole number of the pages a mapping with
+ * the MEM_MAP_ flags 'flags' is made of
+ */
+static size_t map_round(size_t len, int flags) {
+    size_t pagesize = (flags & MEM_MAP_HUGETLB) ? huge_page_size()
+                                                : (size_t)getpagesize();
+    return (len + pagesize - 1) / pagesize * pagesize;
+}
+
+/*
+ * Faults in the 'len' bytes of pages at ptr for writing
+ */
+static void map_populate(char *ptr, size_t len) {
+#ifdef MADV_POPULATE_WRITE
+    if (madvise(ptr, len, MADV_POPULATE_WRITE) == 0) {
+        return;
+    }
+#endif
+    size_t pagesize = getpagesize();
+    for (size_t i = 0; i < len; i += pagesize) {
+        ((volatile char*)ptr)[i] = 0;
+    }
+}
+
+/*
+ * Maps 'len' bytes of zeroed memory for a heap, at addr if the OS agrees
+ * Argument - len: Multiple of map_round() for *flags
+ * Argument - flags: MEM_MAP_ flags to map with, MEM_MAP_HUGETLB is cleared
+ *            if there were no huge pages left and THP was used instead
+ * Returns the mapping on success and MAP_FAILED on failure
+ */
+static void* map_region(void *addr, size_t len, int *flags) {
+    int mmap_flags = MAP_PRIVATE | MAP_ANONYMOUS;
+    int thp = *flags & (MEM_MAP_HUGETLB | MEM_MAP_THP);
+    void *ptr = MAP_FAILED;
+
+#ifdef MAP_HUGETLB
+    if (*flags & MEM_MAP_HUGETLB) {
+        ptr = mmap(addr, len, PROT_READ | PROT_WRITE,
+                   mmap_flags | MAP_HUGETLB |
+                   ((*flags & MEM_MAP_POPULATE) ? MAP_POPULATE : 0), -1, 0);
+    }
+#endif
+    if (ptr == MAP_FAILED) {
+        *flags &= ~MEM_MAP_HUGETLB;
+        // THP must be asked for before the pages fault in
+        if ((*flags & MEM_MAP_POPULATE) && !thp) {
+            mmap_flags |= MAP_POPULATE;
+        }
+        ptr = mmap(addr, len, PROT_READ | PROT_WRITE, mmap_flags, -1, 0);
+        if (ptr == MAP_FAILED) {
+            return MAP_FAILED;
+        }
+#ifdef MADV_HUGEPAGE
+        if (thp) {
+            madvise(ptr, len, MADV_HUGEPAGE); //only a hint
+        }
+#endif
+        if ((*flags & MEM_MAP_POPULATE) && thp) {
+            map_populate(ptr, len);
+        }
+    }
+    if ((*flags & MEM_MAP_LOCK) && mlock(ptr, len) != 0) {
+        fprintf(stderr, "Error:mem.c: mlock failed, RLIMIT_MEMLOCK too low?\n");
+        munmap(ptr, len);
+        return MAP_FAILED;
+    }
+    return ptr;
+}
+
+/*
+ * Sets up heap h over the 'len' bytes at base as one chunk
+ * base must be ALIGN byte aligned and len a multiple of ALIGN
+ * map_flags are the MEM_MAP_ flags base was mapped with
+ */
+static void heap_init(mem_heap *h, char *base, size_t len,
+                      const mem_opts *opts, int map_flags) {
+    memset(h, 0, sizeof(*h));
+    pthread_mutex_init(&h->lock, NULL);
+    pthread_mutex_init(&h->slab_lock, NULL);
+    h->policy = (opts != NULL) ? opts->policy : MEM_POLICY_SEGLIST;
+    h->map_flags = map_flags;
+
+    chunk_init(&h->first_chunk, base, len);
+    h->last_chunk = &h->first_chunk;
+    h->max_size = len - ALIGN;
+
+    h->purge_advice = MADV_DONTNEED;
+    if (opts != NULL && opts->purge_threshold > 0 &&
+        !(map_flags & MAP_NO_PURGE)) {
+        // a block smaller than a page has no whole page to give back
+        h->purge_threshold = (opts->purge_threshold > (size_t)getpagesize())
+                             ? opts->purge_threshold : (size_t)getpagesize();
+        h->purge_decay = (opts->purge_decay_ms > 0) ? opts->purge_decay_ms
+                                                    : 1000;
+        h->clock = clock_ms();
+    }
+#ifdef MADV_FREE
+    if (opts != NULL && opts->purge_mode == MEM_PURGE_FREE) {
+        h->purge_advice = MADV_FREE;
+    }
+#endif
+
+    if (opts != NULL && opts->mmap_threshold > 0) {
+        h->mmap_threshold = opts->mmap_threshold;
+        mapped_used = 1;
+    }
+    if (opts != NULL && opts->slab) {
+        h->slab = 1;
+        slab_used = 1;
+    }
+    if (opts != NULL && opts->quick_max > 0) {
+        h->quick_max = ((opts->quick_max < QUICK_MAX_SIZE) ? opts->quick_max
+                                                          : QUICK_MAX_SIZE)
+                       + HDR_SIZE;
+    }
+
+    if (opts != NULL && opts->grow_chunk > 0) {
+        h->grow_next = (opts->grow_chunk < MAX_GROW_SIZE) ? opts->grow_chunk
+                                                          : MAX_GROW_SIZE;
+        h->grow_pct = (opts->grow_pct > 0) ? opts->grow_pct : 200;
+        if (h->max_size < MAX_GROW_SIZE) {
+            h->max_size = MAX_GROW_SIZE;
+        }
+    }
+
+    // The whole heap starts out on a single free list
+    list_insert(h, h->first_chunk.first_blk);
+}
+
+/*
+ * Remembers that a chunk of default heap h now covers [start, end)
+ * old_start is where the chunk started before a mapping was merged into
+ * it, or NULL for a new chunk. A chunk only ever gets bigger, so a reader
+ * racing with the update still finds every block that was already handed out
+ * Returns 0 on success and -1 if all MAX_GROWN entries are taken
+ */
+static int grown_set(mem_heap *h, char *old_start, char *start, char *end) {
+    int ret = 0;
+
+    pthread_mutex_lock(&grown_lock);
+    for (int i = 0; old_start != NULL && i < num_grown; i++) {
+        if (grown[i].start == old_start) {
+            __atomic_store_n(&grown[i].start, start, __ATOMIC_RELEASE);
+            __atomic_store_n(&grown[i].end, end, __ATOMIC_RELEASE);
+            pthread_mutex_unlock(&grown_lock);
+            return 0;
+        }
+    }
+    if (num_grown < MAX_GROWN) {
+        grown[num_grown].start = start;
+        grown[num_grown].end = end;
+        grown[num_grown].heap = h;
+        __atomic_store_n(&num_grown, num_grown + 1, __ATOMIC_RELEASE);
+    } else {
+        ret = -1;
+    }
+    pthread_mutex_unlock(&grown_lock);
+    return ret;
+}
+
+/*
+ * Merges the 'len' bytes mapped at space_ptr, right after chunk c, into c
+ * The old end_mark becomes a busy block over the new memory, freeing it
+ * coalesces it with the last block of the chunk if that one is free
+ */
+static void chunk_append(mem_heap *h, mem_chunk *c, char *space_ptr,
+                         size_t len) {
+    blk_hdr *old_mark = c->end_mark;
+
+    c->end_mark = (blk_hdr*) (space_ptr + len - HDR_SIZE);
+    c->end_mark->size_status = 1 + 2;
+    old_mark->size_status = len + (old_mark->size_status & 2) + 1;
+    c->end = space_ptr + len;
+    heap_free(h, old_mark);
+    // the old tail no longer counts as fresh, its footer and end_mark are
+    // left behind in the middle of the free block
+    if (c->fresh < (char*)old_mark + FREE_META) {
+        c->fresh = (char*)old_mark + FREE_META;
+    }
+}
+
+/*
+ * Merges the 'len' bytes mapped at space_ptr, right before chunk c, into c
+ * The new memory becomes a busy block in front of the old first block,
+ * freeing it coalesces it with that block if it is free. A chunk struct
+ * kept at the start of the chunk moves down to the new start.
+ * Returns the chunk struct at its new place
+ */
+static mem_chunk* chunk_prepend(mem_heap *h, mem_chunk *c, char *space_ptr,
+                                size_t len) {
+    blk_hdr *old_first = c->first_blk;
+    blk_hdr *new_first;
+
+    if (c == &h->first_chunk) {
+        new_first = (blk_hdr*) space_ptr + 1;
+    } else {
+        mem_chunk *prev = &h->first_chunk;
+        while (prev->next != c) {
+            prev = prev->next;
+        }
+        memcpy(space_ptr, c, sizeof(mem_chunk));
+        c = (mem_chunk*) space_ptr;
+        prev->next = c;
+        new_first = (blk_hdr*) ((char*)old_first - len);
+    }
+
+    c->start = space_ptr;
+    c->first_blk = new_first;
+    new_first->size_status = len + 2 + 1;
+    heap_free(h, new_first);
+    return c;
+}
+
+/*
+ * Maps another chunk for heap h that can hold a block of 'size' bytes,
+ * caller must hold h->lock
+ * The chunk is h->grow_next bytes, or bigger if the block needs it, and the
+ * one after it grows by h->grow_pct percent
+ * Returns 0 on success and -1 if the heap can't grow or the OS said no
+ */
+static int heap_grow(mem_heap *h, size_t size) {
+    size_t pagesize = getpagesize();
+    size_t hdr_size = (sizeof(mem_chunk) + ALIGN - 1) & ~(size_t)(ALIGN - 1);
+    mem_chunk *last = h->last_chunk;
+    size_t len = h->grow_next;
+    size_t need = hdr_size + size + ALIGN;
+    char *space_ptr;
+
+    if (h->grow_next == 0) {
+        return -1;
+    }
+    if (len < need) {
+        len = need;
+    }
+    len = map_round(len, h->map_flags);
+    if (len > MAX_GROW_SIZE + pagesize) {
+        return -1;
+    }
+
+    // ask for the spot right after the last chunk so the two can merge,
+    // the OS may also put it right before it
+    int map_flags = h->map_flags;
+    space_ptr = map_region(last->end, len, &map_flags);
+    if (MAP_FAILED == (void*)space_ptr) {
+        return -1;
+    }
+
+    // a default heap's chunk has to be registered before any of it is handed
+    // out, or Free_Mem would not find its blocks
+    int fits = (size_t)(last->end - last->start) + len <= MAX_GROW_SIZE;
+    int append = fits && space_ptr == last->end;
+    int prepend = !append && fits && space_ptr + len == last->start;
+    if (h->map_base == NULL) {
+        char *start = append ? last->start : space_ptr;
+        char *end = prepend ? last->end : space_ptr + len;
+        char *old_start = (append || prepend) ? last->start : NULL;
+        if (grown_set(h, old_start, start, end) != 0) {
+            munmap(space_ptr, len);
+            return -1;
+        }
+    }
+
+    unsigned long long next = (unsigned long long)h->grow_next * h->grow_pct / 100;
+    h->grow_next = (next > MAX_GROW_SIZE) ? MAX_GROW_SIZE : (size_t)next;
+
+    if (append) {
+        chunk_append(h, last, space_ptr, len);
+    } else if (prepend) {
+        h->last_chunk = chunk_prepend(h, last, space_ptr, len);
+        if (h == &heaps[0]) {
+            first_blk = heaps[0].first_chunk.first_blk;
+        }
+    } else {
+        mem_chunk *c = (mem_chunk*) space_ptr;
+        chunk_init(c, space_ptr + hdr_size, len - hdr_size);
+        c->start = space_ptr;
+        list_insert(h, c->first_blk);
+        last->next = c;
+        h->last_chunk = c;
+    }
+    return 0;
+}
+
+/*
+ * Allocates a block of 'size' bytes aligned to 'align' (0 for ALIGN) from
+ * heap h after growing it, retrying first in case another thread already
+ * grew it
+ */
+static void* heap_grow_alloc(mem_heap *h, size_t size, size_t align) {
+    void *ptr = NULL;
+
+    heap_lock(h);
+    ptr = heap_alloc(h, size, align);
+    if (ptr == NULL && heap_grow(h, aligned_need(size, align)) == 0) {
+        ptr = heap_alloc(h, size, align);
+    }
+    heap_unlock(h);
+    return ptr;
+}
+
+/*
+ * Allocates a block of 'size' bytes aligned to 'align' (0 for ALIGN) with a
+ * mapping of its own, linked into the list of heap h
+ * Returns the payload on success and NULL on failure
+ */
+static void* mapped_alloc(mem_heap *h, size_t size, size_t align) {
+    size_t offset = (sizeof(mapped_blk) + HDR_SIZE + ALIGN - 1) & ~(size_t)(ALIGN - 1);
+    int map_flags = h->map_flags & ~MEM_MAP_HUGETLB; //must stay mremap-able
+
+    if (size > MAX_REGION_SIZE) {
+        return NULL;
+    }
+    size_t len = map_round(offset + size + align, map_flags);
+    char *base = map_region(NULL, len, &map_flags);
+    if (MAP_FAILED == (void*)base) {
+        return NULL;
+    }
+    if (align > ALIGN) {
+        uintptr_t payload = (uintptr_t)base + offset;
+        offset += ((payload + align - 1) & ~(uintptr_t)(align - 1)) - payload;
+    }
+
+    mapped_blk *m = (mapped_blk*) base;
+    m->heap = h;
+    m->len = len;
+    m->offset = offset;
+    blk_hdr *hdr = (blk_hdr*) (base + offset - HDR_SIZE);
+    hdr->size_status = offset + MAPPED + 1;
+
+    pthread_mutex_lock(&h->lock);
+    m->prev = NULL;
+    m->next = h->mapped;
+    if (m->next != NULL) {
+        m->next->prev = m;
+    }
+    h->mapped = m;
+    h->mapped_bytes += len;
+    pthread_mutex_unlock(&h->lock);
+
+    zero_hint.blk = hdr; //fresh pages read as zero
+    zero_hint.lo = base + offset;
+    zero_hint.hi = base + len;
+    return base + offset;
+}
+
+/*
+ * Returns the mapped_blk on the list of heap h whose payload is ptr, or
+ * NULL if there is none; caller must hold h->lock
+ */
+static mapped_blk* mapped_find(mem_heap *h, void *ptr) {
+    for (mapped_blk *m = h->mapped; m != NULL; m = m->next) {
+        if ((char*)m + m->offset == (char*)ptr) {
+            return m;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Returns the heap to look for the mapped block ptr in, the i-th default
+ * heap for heap NULL, or NULL once there is none left to try
+ */
+static mem_heap* mapped_heap(mem_heap *heap, void *ptr, int i) {
+    if (!mapped_used || ptr == NULL || ((uintptr_t)ptr % ALIGN) != 0) {
+        return NULL;
+    }
+    if (heap != NULL) {
+        return (i == 0) ? heap : NULL;
+    }
+    return (i < num_heaps) ? &heaps[i] : NULL;
+}
+
+/*
+ * Returns the mapped_blk of the block whose payload is ptr, or NULL if ptr
+ * is not the payload of a block with a mapping of its own in heap, or in
+ * any default heap for NULL
+ */
+static mapped_blk* mapped_of(mem_heap *heap, void *ptr) {
+    mem_heap *h;
+
+    for (int i = 0; (h = mapped_heap(heap, ptr, i)) != NULL; i++) {
+        pthread_mutex_lock(&h->lock);
+        mapped_blk *m = mapped_find(h, ptr);
+        pthread_mutex_unlock(&h->lock);
+        if (m != NULL) {
+            return m;
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Unlinks the mapped block m from the list of its heap, caller must hold
+ * the heap's lock
+ */
+static void mapped_unlink(mapped_blk *m) {
+    if (m->prev != NULL) {
+        m->prev->next = m->next;
+    } else {
+        m->heap->mapped = m->next;
+    }
+    if (m->next != NULL) {
+        m->next->prev = m->prev;
+    }
+}
+
+/*
+ * Frees the block with payload ptr and a mapping of its own in heap, or in
+ * any default heap for NULL, by unmapping it
+ * Returns 0 on success and -1 if there is no such block or munmap failed
+ */
+static int mapped_free(mem_heap *heap, void *ptr) {
+    mem_heap *h;
+
+    for (int i = 0; (h = mapped_heap(heap, ptr, i)) != NULL; i++) {
+        pthread_mutex_lock(&h->lock);
+        mapped_blk *m = mapped_find(h, ptr);
+        if (m != NULL) {
+            mapped_unlink(m);
+            h->mapped_bytes -= m->len;
+            pthread_mutex_unlock(&h->lock);
+            return munmap(m, m->len);
+        }
+        pthread_mutex_unlock(&h->lock);
+    }
+    return -1;
+}
+
+/*
+ * Resizes the mapped block m to 'size' bytes with mremap, so the data is
+ * never copied; the mapping moves if it can't grow where it is
+ * Returns the new payload on success and NULL on failure, m is left as it was
+ */
+static void* mapped_resize(mapped_blk *m, size_t size) {
+    mem_heap *h = m->heap;
+    void *ptr = (char*)m + m->offset;
+
+    if (size > MAX_REGION_SIZE) {
+        return NULL;
+    }
+    size_t len = map_round(m->offset + size, h->map_flags & ~MEM_MAP_HUGETLB);
+    if (len == m->len) {
+        return ptr;
+    }
+
+    pthread_mutex_lock(&h->lock);
+    mapped_unlink(m);
+    mapped_blk *moved = mremap(m, m->len, len, MREMAP_MAYMOVE);
+    if (moved == MAP_FAILED) {
+        moved = m;
+        ptr = NULL;
+    } else {
+        h->mapped_bytes += len - moved->len;
+        moved->len = len;
+        ptr = (char*)moved + moved->offset;
+    }
+    moved->prev = NULL;
+    moved->next = h->mapped;
+    if (moved->next != NULL) {
+        moved->next->prev = moved;
+    }
+    h->mapped = moved;
+    pthread_mutex_unlock(&h->lock);
+    return ptr;
+}
+
+static int blk_check(mem_heap *h, void *ptr);
+
+/*
+ * Returns the slab whose slot ptr is, or NULL if ptr is not a slot
+ * Argument - heap: Heap made by Heap_Create, NULL for the default heaps
+ */
+static slab* slab_of(mem_heap *heap, void *ptr) {
+    if (!slab_used || ptr == NULL) {
+        return NULL;
+    }
+    slab *s = (slab*) ((uintptr_t)ptr & ~(uintptr_t)(SLAB_SIZE - 1));
+    if ((size_t)((char*)ptr - (char*)s) < SLAB_HDR) {
+        return NULL; //a slab header is never handed out
+    }
+    // the block header in front of the slab must be in the heap too
+    mem_heap *owner = heap;
+    if (heap == NULL) {
+        owner = heap_of((char*)s - HDR_SIZE);
+    } else if (blk_check(heap, s) != 0) {
+        owner = NULL;
+    }
+    if (owner == NULL || !owner->slab) {
+        return NULL;
+    }
+    size_t status = ((blk_hdr*) ((char*)s - HDR_SIZE))->size_status;
+    if ((status & (SLAB | 1)) != (SLAB | 1) ||
+        s->magic != (SLAB_MAGIC ^ (uintptr_t)s) || s->heap != owner) {
+        return NULL;
+    }
+    return s;
+}
+
+/*
+ * Takes a new slab with slots of 'slot_size' bytes out of heap h, growing
+ * the heap if it has to
+ * Returns the slab on success and NULL if the heap is full
+ */
+static slab* slab_new(mem_heap *h, unsigned int slot_size) {
+    size_t size = blk_round(h, SLAB_SIZE - HDR_SIZE);
+    slab *s = NULL;
+
+    heap_lock(h);
+    if (size != 0) {
+        s = heap_alloc(h, size, SLAB_SIZE);
+        if (s == NULL && heap_grow(h, aligned_need(size, SLAB_SIZE)) == 0) {
+            s = heap_alloc(h, size, SLAB_SIZE);
+        }
+    }
+    if (s != NULL) { //the p-bit only changes under the lock
+        ((blk_hdr*) ((char*)s - HDR_SIZE))->size_status |= SLAB;
+    }
+    heap_unlock(h);
+    if (s == NULL) {
+        return NULL;
+    }
+
+    s->magic = SLAB_MAGIC ^ (uintptr_t)s;
+    s->heap = h;
+    s->next = NULL;
+    s->prev = NULL;
+    s->free = NULL;
+    s->slot_size = slot_size;
+    s->used = 0;
+    s->fresh = 0;
+    s->slots = (SLAB_SIZE - HDR_SIZE - SLAB_HDR) / slot_size;
+    memset(s->busy, 0, sizeof(s->busy));
+    return s;
+}
+
+/*
+ * Puts slab s on the list of slabs with free slots of its heap, caller
+ * must hold the heap's slab_lock
+ */
+static void slab_push(mem_heap *h, slab *s) {
+    int idx = s->slot_size / SLAB_STEP - 1;
+
+    s->prev = NULL;
+    s->next = h->slabs[idx];
+    if (s->next != NULL) {
+        s->next->prev = s;
+    }
+    h->slabs[idx] = s;
+}
+
+/*
+ * Takes slab s off the list of slabs with free slots of its heap, caller
+ * must hold the heap's slab_lock
+ */
+static void slab_unlink(mem_heap *h, slab *s) {
+    if (s->prev != NULL) {
+        s->prev->next = s->next;
+    } else {
+        h->slabs[s->slot_size / SLAB_STEP - 1] = s->next;
+    }
+    if (s->next != NULL) {
+        s->next->prev = s->prev;
+    }
+}
+
+/*
+ * Allocates a slot for 'size' bytes, 0 < size <= SLAB_MAX, from the slabs
+ * of heap h
+ * Returns the slot on success and NULL if no new slab could be made
+ */
+static void* slab_alloc(mem_heap *h, size_t size) {
+    unsigned int slot_size = (size + SLAB_STEP - 1) / SLAB_STEP * SLAB_STEP;
+    int idx = slot_size / SLAB_STEP - 1;
+    void *ptr;
+
+    pthread_mutex_lock(&h->slab_lock);
+    slab *s = h->slabs[idx];
+    if (s == NULL) {
+        s = slab_new(h, slot_size);
+        if (s == NULL) {
+            pthread_mutex_unlock(&h->slab_lock);
+            return NULL;
+        }
+        slab_push(h, s);
+    }
+    unsigned int slot;
+    if (s->free != NULL) {
+        ptr = s->free;
+        s->free = *(void**)ptr;
+        slot = ((char*)ptr - (char*)s - SLAB_HDR) / slot_size;
+    } else {
+        slot = s->fresh++;
+        ptr = (char*)s + SLAB_HDR + (size_t)slot * slot_size;
+    }
+    s->busy[slot / LONG_BITS] |= 1ul << (slot % LONG_BITS);
+    s->used++;
+    if (s->free == NULL && s->fresh == s->slots) { //full
+        slab_unlink(h, s);
+    }
+    pthread_mutex_unlock(&h->slab_lock);
+    return ptr;
+}
+
+/*
+ * Returns the index of slot ptr of slab s if it is handed out, -1 if ptr
+ * is not the start of a slot or the slot is free. Caller must hold the
+ * heap's slab_lock.
+ */
+static int slab_slot(slab *s, void *ptr) {
+    size_t offset = (char*)ptr - (char*)s - SLAB_HDR;
+    size_t slot = offset / s->slot_size;
+
+    if (offset % s->slot_size != 0 || slot >= s->fresh ||
+        (s->busy[slot / LONG_BITS] & (1ul << (slot % LONG_BITS))) == 0) {
+        return -1;
+    }
+    return (int)slot;
+}
+
+/*
+ * Puts the slot ptr back into slab s
+ * A slab that is left empty goes back to the heap, unless it is the only
+ * one of its size with free slots
+ * Returns 0 on success and -1 if ptr is not a slot handed out
+ */
+static int slab_free(slab *s, void *ptr) {
+    mem_heap *h = s->heap;
+
+    pthread_mutex_lock(&h->slab_lock);
+    int slot = slab_slot(s, ptr);
+    if (slot < 0) {
+        pthread_mutex_unlock(&h->slab_lock);
+        return -1; //freed twice or inside a slot
+    }
+    s->busy[slot / LONG_BITS] &= ~(1ul << (slot % LONG_BITS));
+    if (s->free == NULL && s->fresh == s->slots) { //was full
+        slab_push(h, s);
+    }
+    *(void**)ptr = s->free;
+    s->free = ptr;
+    s->used--;
+    if (s->used == 0 && (s->prev != NULL || s->next != NULL)) {
+        slab_unlink(h, s);
+        s->magic = 0;
+        blk_hdr *hdr = (blk_hdr*) ((char*)s - HDR_SIZE);
+        heap_lock(h);
+        hdr->size_status &= ~(size_t)SLAB;
+        heap_free(h, hdr);
+        heap_unlock(h);
+    }
+    pthread_mutex_unlock(&h->slab_lock);
+    return 0;
+}
+
+/*
+ * Returns 0 if opts is NULL or holds valid options, -1 otherwise
+ */
+static int opts_check(const mem_opts *opts) {
+    if (opts != NULL && (opts->policy < MEM_POLICY_SEGLIST ||
+                         opts->policy > MEM_POLICY_LIFO)) {
+        fprintf(stderr, "Error:mem.c: Unknown allocation policy\n");
+        return -1;
+    }
+    if (opts != NULL && (opts->map_flags & ~(MEM_MAP_HUGETLB | MEM_MAP_THP |
+                                             MEM_MAP_POPULATE |
+                                             MEM_MAP_LOCK)) != 0) {
+        fprintf(stderr, "Error:mem.c: Unknown map flags\n");
+        return -1;
+    }
+    if (opts != NULL && opts->mmap_threshold > MAX_REGION_SIZE) {
+        fprintf(stderr, "Error:mem.c: Invalid mmap threshold\n");
+        return -1;
+    }
+    if (opts != NULL && (opts->purge_threshold > MAX_REGION_SIZE ||
+                         opts->purge_decay_ms < 0 ||
+                         (opts->purge_mode != MEM_PURGE_DONTNEED &&
+                          opts->purge_mode != MEM_PURGE_FREE))) {
+        fprintf(stderr, "Error:mem.c: Invalid purge options\n");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Returns 0 if ptr could be the payload of a busy block in heap h, -1 if not
+ */
+static int blk_check(mem_heap *h, void *ptr) {
+    if (ptr == NULL || ((uintptr_t)ptr % ALIGN) != 0) {
+        return -1;
+    }
+    for (mem_chunk *c = &h->first_chunk; c != NULL; c = c->next) {
+        if ((char*)ptr > (char*)c->first_blk && (char*)ptr < (char*)c->end_mark) {
+            return 0;
+        }
+    }
+    return -1;
+}
+
+/*
+ * Function for creating a new heap with its own region of memory
+ * Argument - sizeOfRegion: Size of the region the blocks are carved from
+ * Argument - opts: Allocator options, NULL for the defaults (nheaps is ignored)
+ * Returns the new heap on success and NULL on failure
+ */
+mem_heap* Heap_Create(size_t sizeOfRegion, const mem_opts *opts) {
+    size_t hdr_size = (sizeof(mem_heap) + ALIGN - 1) & ~(size_t)(ALIGN - 1);
+    size_t map_len;
+    void *space_ptr;
+
+    if (sizeOfRegion == 0) {
+        fprintf(stderr, "Error:mem.c: Requested block size is not positive\n");
+        return NULL;
+    }
+    if (sizeOfRegion > MAX_REGION_SIZE) { //also a negative int passed in
+        fprintf(stderr, "Error:mem.c: Requested block size is too big\n");
+        return NULL;
+    }
+    if (opts_check(opts) != 0) {
+        return NULL;
+    }
+
+    // the heap struct sits in front of the blocks, round the total up to
+    // a multiple of pagesize
+    int map_flags = (opts != NULL) ? opts->map_flags : 0;
+    map_len = map_round(hdr_size + sizeOfRegion, map_flags);
+
+    space_ptr = map_region(NULL, map_len, &map_flags);
+    if (MAP_FAILED == space_ptr) {
+        fprintf(stderr, "Error:mem.c: mmap cannot allocate space\n");
+        return NULL;
+    }
+
+    mem_heap *h = space_ptr;
+    heap_init(h, (char*)space_ptr + hdr_size, map_len - hdr_size, opts,
+              map_flags);
+    h->map_base = space_ptr;
+    return h;
+}
+
+/*
+ * Function for allocating 'size' bytes from a heap
+ * Argument - heap: Heap made by Heap_Create, NULL for the default heap
+ * Returns address of allocated block on success 
+ * Returns NULL on failure 
+ */
+void* Heap_Alloc(mem_heap *heap, size_t size) {
+    return Heap_Alloc_Aligned(heap, size, 1);
+}
+
+/*
+ * Returns 1 if the calling thread should trace the call it is in
+ */
+static inline int tracing(void) {
+    return __atomic_load_n(&trace_on, __ATOMIC_RELAXED) && !trace_nested;
+}
+
+/*
+ * Returns the time for a trace record, in ns
+ */
+static uint64_t trace_now(void) {
+    struct timespec t;
+    clock_gettime(CLOCK_MONOTONIC, &t);
+    return (uint64_t)t.tv_sec * 1000000000ull + t.tv_nsec;
+}
+
+/*
+ * Writes 'len' bytes of trace to trace_fd, remembering a failure
+ */
+static void trace_write(const void *data, size_t len) {
+    size_t done = 0;
+
+    while (done < len && !trace_error) {
+        ssize_t n = write(trace_fd, (const char*)data + done, len - done);
+        if (n > 0) {
+            done += n;
+        } else if (n == 0 || errno != EINTR) {
+            trace_error = 1;
+        }
+    }
+}
+
+static void trace_fill(mem_trace_rec *r, int op, void *ptr, void *old,
+                       size_t size, size_t alignment, uint64_t time) {
+    r->time = (time > trace_start) ? time - trace_start : 0;
+    r->ptr = (uintptr_t)ptr;
+    r->old = (uintptr_t)old;
+    r->size = (size < UINT32_MAX) ? size : UINT32_MAX;
+    r->op = op;
+    r->align = (alignment > 1) ? __builtin_ctzl(alignment) : 0;
+    r->thread = trace_thread - 1;
+}
+
+/*
+ * Appends a record to the trace buffer of the calling thread, making one
+ * on its first call; 'time' is when the call was made. A thread past its
+ * exit hook writes the record out on its own.
+ */
+static void trace_add(int op, void *ptr, void *old, size_t size,
+                      size_t alignment, uint64_t time) {
+    trace_buf *b = tbuf;
+
+    if (thread_exited) {
+        mem_trace_rec r;
+        pthread_mutex_lock(&trace_lock);
+        if (trace_on) {
+            if (trace_thread == 0) { //never traced before
+                trace_thread = ++trace_threads;
+            }
+            trace_fill(&r, op, ptr, old, size, alignment, time);
+            trace_write(&r, sizeof(r));
+        }
+        pthread_mutex_unlock(&trace_lock);
+        return;
+    }
+    if (b == NULL) {
+        b = mmap(NULL, sizeof(trace_buf), PROT_READ | PROT_WRITE,
+                 MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (b == MAP_FAILED) {
+            return;
+        }
+        pthread_mutex_lock(&trace_lock);
+        b->thread = trace_threads++;
+        trace_thread = trace_threads;
+        b->next = trace_bufs;
+        if (b->next != NULL) {
+            b->next->prev = b;
+        }
+        trace_bufs = b;
+        pthread_mutex_unlock(&trace_lock);
+        tbuf = b;
+        exit_hook(); //writes it out
+    }
+
+    // seq_cst on both sides: either Trace_Mem_Stop sees busy and waits, or
+    // this sees that tracing stopped
+    __atomic_store_n(&b->busy, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&trace_on, __ATOMIC_SEQ_CST)) {
+        trace_fill(&b->recs[b->len++], op, ptr, old, size, alignment, time);
+        if (b->len == TRACE_BUF_RECS) {
+            trace_write(b->recs, sizeof(b->recs));
+            b->len = 0;
+        }
+    }
+    __atomic_store_n(&b->busy, 0, __ATOMIC_RELEASE);
+}
+
+/*
+ * Heap_Alloc_Aligned without counting the request in the statistics
+ */
+static void* alloc_aligned(mem_heap *heap, size_t size, size_t alignment) {
+    if (alignment == 0 || (alignment & (alignment - 1)) != 0) {
+        return NULL;
+    }
+    size_t align = (alignment > ALIGN) ? alignment : 0;
+
+    if (slab_used && size > 0 && size <= SLAB_MAX) {
+        mem_heap *h = (heap != NULL) ? heap : (num_heaps > 0) ? thread_heap() : NULL;
+        size_t slot_size = (size + SLAB_STEP - 1) / SLAB_STEP * SLAB_STEP;
+        size_t slot_align = slot_size & -slot_size; //SLAB_HDR is a multiple of ALIGN
+        if (h != NULL && h->slab && alignment <= slot_align && alignment <= ALIGN) {
+            void *ptr = slab_alloc(h, size);
+            if (ptr != NULL) {
+                return ptr;
+            }
+        }
+    }
+    if (heap == NULL) {
+        return default_alloc(size, align);
+    }
+    if (heap->mmap_threshold > 0 && size >= heap->mmap_threshold) {
+        return mapped_alloc(heap, size, align);
+    }
+    size = blk_round(heap, size);
+    if (size == 0) {
+        return NULL;
+    }
+    void *ptr = heap_alloc_locked(heap, size, align);
+    if (ptr == NULL && heap->grow_next > 0) {
+        ptr = heap_grow_alloc(heap, size, align);
+    }
+    return ptr;
+}
+
+/*
+ * Function for allocating 'size' bytes at an aligned address from a heap
+ * Argument - heap: Heap made by Heap_Create, NULL for the default heap
+ * Argument - alignment: Power of two the address is a multiple of
+ * Returns address of allocated block on success 
+ * Returns NULL on failure, also when alignment is not a power of two
+ * The gap in front of the block becomes a free block of its own
+ */
+void* Heap_Alloc_Aligned(mem_heap *heap, size_t size, size_t alignment) {
+    void *ptr = alloc_aligned(heap, size, alignment);
+
+    if (heap == NULL) {
+        stats_add((ptr != NULL) ? STAT_ALLOCS : STAT_FAILED);
+        if (tracing()) {
+            trace_add((alignment > 1) ? MEM_TRACE_ALIGNED : MEM_TRACE_ALLOC,
+                      ptr, NULL, size, alignment, trace_now());
+        }
+    }
+    return ptr;
+}
+
+/*
+ * Function for freeing up a block allocated from a heap
+ * Argument - heap: Heap the block came from, NULL for the default heap
+ * Argument - ptr: Address of the block to be freed up 
+ * Returns 0 on success 
+ * Returns -1 if ptr is not a busy block of heap
+ */
+int Heap_Free(mem_heap *heap, void *ptr) {
+    if (heap == NULL) {
+        uint64_t time = tracing() ? trace_now() : 0;
+        int ret = default_free(ptr);
+        if (ret == 0) {
+            stats_add(STAT_FREES);
+            if (time != 0) {
+                trace_add(MEM_TRACE_FREE, ptr, NULL, 0, 0, time);
+            }
+        }
+        return ret;
+    }
+    slab *s = slab_of(heap, ptr);
+    if (s != NULL) {
+        return slab_free(s, ptr);
+    }
+    if (blk_check(heap, ptr) != 0) {
+        return mapped_free(heap, ptr);
+    }
+
+    blk_hdr *curr_hdr = (blk_hdr*) ((char*)ptr - HDR_SIZE);
+    if (blk_cache(curr_hdr) != 0) {
+        return -1; //freed before
+    }
+    heap_lock(heap);
+    heap_release(heap, curr_hdr);
+    heap_unlock(heap);
+    return 0;
+}
+
+/*
+ * Heap_Calloc without tracing the call
+ */
+static void* heap_calloc(mem_heap *heap, size_t nmemb, size_t size) {
+    if (size != 0 && nmemb > SIZE_MAX / size) {
+        return NULL;
+    }
+    size *= nmemb;
+    zero_hint.blk = NULL;
+
+    char *ptr = Heap_Alloc(heap, size);
+    if (ptr == NULL) {
+        return NULL;
+    }
+    char *lo = ptr + size; //[lo, hi) is known to be zero
+    char *hi = ptr + size;
+    if (zero_hint.blk == (blk_hdr*) (ptr - HDR_SIZE) &&
+        zero_hint.lo < ptr + size && zero_hint.hi > ptr) {
+        lo = (zero_hint.lo > ptr) ? zero_hint.lo : ptr;
+        hi = (zero_hint.hi < ptr + size) ? zero_hint.hi : ptr + size;
+    }
+    memset(ptr, 0, lo - ptr);
+    memset(hi, 0, ptr + size - hi);
+    return ptr;
+}
+
+/*
+ * Function for allocating zeroed memory for an array from a heap
+ * Argument - heap: Heap to allocate from, NULL for the default heap
+ * Argument - nmemb: Number of elements
+ * Argument - size: Size of each element
+ * Returns address of allocated block on success 
+ * Returns NULL on failure, also when nmemb * size overflows
+ * Memory that was never handed out and pages purged with MADV_DONTNEED
+ * already read as zero, only the rest of the block is cleared
+ */
+void* Heap_Calloc(mem_heap *heap, size_t nmemb, size_t size) {
+    if (heap != NULL || !tracing()) {
+        return heap_calloc(heap, nmemb, size);
+    }
+    trace_nested++;
+    void *ptr = heap_calloc(heap, nmemb, size);
+    trace_nested--;
+    trace_add(MEM_TRACE_CALLOC, ptr, NULL,
+              (size != 0 && nmemb > SIZE_MAX / size) ? SIZE_MAX : nmemb * size,
+              0, trace_now());
+    return ptr;
+}
+
+/*
+ * Heap_Realloc without tracing the call
+ */
+static void* heap_realloc(mem_heap *heap, void *ptr, size_t size) {
+    if (ptr == NULL) {
+        return Heap_Alloc(heap, size);
+    }
+    if (size == 0) {
+        Heap_Free(heap, ptr);
+        return NULL;
+    }
+
+    slab *s = slab_of(heap, ptr);
+    if (s != NULL) { //a slot can't grow, only move
+        if (size <= s->slot_size) {
+            return ptr;
+        }
+        void *new_ptr = Heap_Alloc(heap, size);
+        if (new_ptr != NULL) {
+            memcpy(new_ptr, ptr, s->slot_size);
+            if (Heap_Free(heap, ptr) != 0) { //not a slot handed out
+                Heap_Free(heap, new_ptr);
+                return NULL;
+            }
+        }
+        return new_ptr;
+    }
+
+    mem_heap *owner = heap;
+    if (heap == NULL) {
+        owner = ((uintptr_t)ptr % ALIGN == 0) ? heap_of(ptr) : NULL;
+    } else if (blk_check(heap, ptr) != 0) {
+        owner = NULL;
+    }
+    if (owner == NULL) {
+        mapped_blk *m = mapped_of(heap, ptr);
+        return (m != NULL) ? mapped_resize(m, size) : NULL;
+    }
+    // a block grown past the mmap threshold moves to a mapping of its own
+    int to_mapped = owner->mmap_threshold > 0 && size >= owner->mmap_threshold;
+    size_t new_size = blk_round(owner, size);
+    if (new_size == 0 && !to_mapped) {
+        return NULL;
+    }
+
+    blk_hdr *curr_hdr = (blk_hdr*) ((char*)ptr - HDR_SIZE);
+    int resized = -1;
+    size_t old_size = 0;
+
+    heap_lock(owner);
+    if ((curr_hdr->size_status & (CACHED | 1)) == 1) { //not freed
+        if (!to_mapped) {
+            resized = heap_resize(owner, curr_hdr, new_size);
+        }
+        old_size = blksize(curr_hdr) - HDR_SIZE;
+    }
+    heap_unlock(owner);
+    if (resized == 0) {
+        return ptr;
+    }
+    if (old_size == 0) {
+        return NULL; //ptr was already free
+    }
+
+    void *new_ptr = Heap_Alloc(heap, size);
+    if (new_ptr != NULL) {
+        memcpy(new_ptr, ptr, (old_size < size) ? old_size : size);
+        Heap_Free(heap, ptr);
+    }
+    return new_ptr;
+}
+
+/*
+ * Function for resizing a block allocated from a heap
+ * Argument - heap: Heap the block came from, NULL for the default heap
+ * Argument - ptr: Address of the block, NULL to allocate a new one
+ * Argument - size: New size in bytes, 0 to free the block
+ * Returns the address of the resized block, which is ptr unless the block
+ * had to move
+ * Returns NULL on failure, ptr is left as it was
+ * - The block is resized in place when it shrinks or when the block after
+ *   it is free and big enough
+ * - Otherwise a new block is allocated, the data copied and ptr freed
+ * - A block with a mapping of its own is resized with mremap instead and
+ *   keeps its own mapping, whatever the new size
+ * - A slot of a slab stays put while the new size fits in it
+ */
+void* Heap_Realloc(mem_heap *heap, void *ptr, size_t size) {
+    if (heap != NULL || !tracing()) {
+        return heap_realloc(heap, ptr, size);
+    }
+    uint64_t time = trace_now(); //before ptr is freed
+    trace_nested++;
+    void *new_ptr = heap_realloc(heap, ptr, size);
+    trace_nested--;
+    trace_add(MEM_TRACE_REALLOC, new_ptr, ptr, size, 0, time);
+    return new_ptr;
+}
+
+/*
+ * Function for reading how many bytes of a block can be used
+ * Argument - heap: Heap the block came from, NULL for the default heap
+ * Argument - ptr: Address of the block
+ * Returns the size of the payload, at least the size that was asked for
+ * Returns 0 if ptr is not a busy block of heap
+ */
+size_t Heap_Usable_Size(mem_heap *heap, void *ptr) {
+    slab *s = slab_of(heap, ptr);
+    if (s != NULL) {
+        return s->slot_size;
+    }
+    int ours = (heap == NULL) ? ((uintptr_t)ptr % ALIGN == 0 && heap_of(ptr) != NULL)
+                              : (blk_check(heap, ptr) == 0);
+    if (!ours) {
+        mapped_blk *m = mapped_of(heap, ptr);
+        return (m != NULL) ? m->len - m->offset : 0;
+    }
+    blk_hdr *curr_hdr = (blk_hdr*) ((char*)ptr - HDR_SIZE);
+    size_t status = __atomic_load_n(&curr_hdr->size_status, __ATOMIC_RELAXED);
+    return ((status & (CACHED | 1)) == 1) ? (status & ~(size_t)7) - HDR_SIZE : 0;
+}
+
+/*
+ * Function for releasing a heap made by Heap_Create and every block in it
+ * Argument - heap: Heap to release, it must not be used afterwards
+ * Returns 0 on success and -1 on failure
+ */
+int Heap_Destroy(mem_heap *heap) {
+    if (heap == NULL || heap->map_base != (void*)heap) {
+        return -1; //NULL, the default heap or not a heap at all
+    }
+    mem_chunk *c = heap->first_chunk.next;
+    while (c != NULL) {
+        mem_chunk *next = c->next;
+        munmap(c->start, c->end - c->start);
+        c = next;
+    }
+    mapped_blk *m = heap->mapped;
+    while (m != NULL) {
+        mapped_blk *next = m->next;
+        munmap(m, m->len);
+        m = next;
+    }
+    pthread_mutex_destroy(&heap->slab_lock);
+    pthread_mutex_destroy(&heap->lock);
+    // a mapping merged into the first chunk goes with the heap's own one
+    return munmap(heap->map_base, heap->first_chunk.end - (char*)heap->map_base);
+}
+
+/*
+ * Function for giving the free pages of a heap back to the OS right away
+ * Argument - heap: Heap to purge, NULL for all the default heaps
+ * Returns the number of bytes purged
+ */
+long Heap_Purge(mem_heap *heap) {
+    long total = 0;
+
+    if (heap != NULL) {
+        if (heap->map_flags & MAP_NO_PURGE) {
+            return 0;
+        }
+        heap_lock(heap);
+        quick_flush(heap); //waiting blocks may coalesce into purgeable ones
+        total = purge_sweep(heap, MIN_BLK_SIZE, 1);
+        heap_unlock(heap);
+        return total;
+    }
+    for (int i = 0; i < num_heaps; i++) {
+        total += Heap_Purge(&heaps[i]);
+    }
+    return total;
+}
+
+/*
+ * Function for reading how many bytes a heap has purged so far
+ * Argument - heap: Heap to report on, NULL for all the default heaps
+ * Argument - purged: Set to the bytes given back to the OS, may be NULL
+ * Argument - refaulted: Set to how many of those were allocated again,
+ *            may be NULL
+ */
+void Heap_Purge_Stats(mem_heap *heap, long long *purged,
+                      long long *refaulted) {
+    long long p = 0, r = 0;
+
+    for (int i = 0; i < ((heap != NULL) ? 1 : num_heaps); i++) {
+        mem_heap *h = (heap != NULL) ? heap : &heaps[i];
+        pthread_mutex_lock(&h->lock);
+        p += h->purged_bytes;
+        r += h->refaulted_bytes;
+        pthread_mutex_unlock(&h->lock);
+    }
+    if (purged != NULL) {
+        *purged = p;
+    }
+    if (refaulted != NULL) {
+        *refaulted = r;
+    }
+}
+
+/* 
+ * Function for allocating 'size' bytes from the default heap
+ * Returns address of allocated block on success 
+ * Returns NULL on failure 
+ */
+void* Alloc_Mem(size_t size) {
+    return Heap_Alloc(NULL, size);
+}
+
+/* 
+ * Function for freeing up a block allocated by Alloc_Mem
+ * Returns 0 on success 
+ * Returns -1 on failure 
+ */
+int Free_Mem(void *ptr) {
+    return Heap_Free(NULL, ptr);
+}
+
+/* 
+ * Function for allocating 'size' bytes from the default heap at an address
+ * that is a multiple of 'alignment', a power of two
+ * Returns address of allocated block on success 
+ * Returns NULL on failure 
+ */
+void* Alloc_Mem_Aligned(size_t size, size_t alignment) {
+    return Heap_Alloc_Aligned(NULL, size, alignment);
+}
+
+/* 
+ * Function for allocating zeroed memory for an array of nmemb elements of
+ * 'size' bytes from the default heap
+ * Returns address of allocated block on success 
+ * Returns NULL on failure 
+ */
+void* Calloc_Mem(size_t nmemb, size_t size) {
+    return Heap_Calloc(NULL, nmemb, size);
+}
+
+/* 
+ * Function for resizing a block allocated by Alloc_Mem
+ * Returns the address of the resized block on success 
+ * Returns NULL on failure 
+ */
+void* Realloc_Mem(void *ptr, size_t size) {
+    return Heap_Realloc(NULL, ptr, size);
+}
+
+/* 
+ * Function for reading how many bytes of a block allocated by Alloc_Mem
+ * can be used
+ * Returns the size of the payload, 0 if ptr is not a busy block
+ */
+size_t Usable_Size_Mem(void *ptr) {
+    return Heap_Usable_Size(NULL, ptr);
+}
+
+/*
+ * Function for creating a pool of objects of one size
+ * Argument - obj_size: Size of every object
+ * Argument - align: Power of two the address of every object is a multiple
+ *            of, 0 for the alignment of Alloc_Mem
+ * Returns the new pool on success and NULL on failure
+ * The pool and its chunks come from the default heap, Init_Mem must have
+ * been called
+ */
+mem_pool* Pool_Create(size_t obj_size, size_t align) {
+    if (align == 0) {
+        align = ALIGN;
+    }
+    if (obj_size == 0 || (align & (align - 1)) != 0 ||
+        obj_size > MAX_GROW_SIZE / POOL_CHUNK_OBJS || align > MAX_GROW_SIZE / 4) {
+        return NULL;
+    }
+    if (obj_size < sizeof(void*)) { //a free object holds the next one
+        obj_size = sizeof(void*);
+    }
+    obj_size = (obj_size + align - 1) & ~(align - 1);
+
+    mem_pool *pool = Alloc_Mem(sizeof(mem_pool));
+    if (pool == NULL) {
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pool->obj_size = obj_size;
+    pool->obj_offset = (sizeof(pool_chunk) + align - 1) & ~(align - 1);
+    pool->chunk_size = POOL_CHUNK_MIN;
+    while (pool->chunk_size < pool->obj_offset + obj_size * POOL_CHUNK_OBJS) {
+        pool->chunk_size *= 2;
+    }
+    // the block header of the next chunk takes the end of this one
+    pool->chunk_objs = (pool->chunk_size - HDR_SIZE - pool->obj_offset) / obj_size;
+    pool->chunks = NULL;
+    pool->partial = NULL;
+
+    pthread_mutex_lock(&pools_lock);
+    pool->prev = NULL;
+    pool->next = pools;
+    if (pool->next != NULL) {
+        pool->next->prev = pool;
+    }
+    pools = pool;
+    pthread_mutex_unlock(&pools_lock);
+    return pool;
+}
+
+/*
+ * Puts chunk c on the partial list of pool, caller must hold pool->lock
+ */
+static void pool_push(mem_pool *pool, pool_chunk *c) {
+    c->prev_partial = NULL;
+    c->next_partial = pool->partial;
+    if (c->next_partial != NULL) {
+        c->next_partial->prev_partial = c;
+    }
+    pool->partial = c;
+}
+
+/*
+ * Takes chunk c off the partial list of pool, caller must hold pool->lock
+ */
+static void pool_unlink(mem_pool *pool, pool_chunk *c) {
+    if (c->prev_partial != NULL) {
+        c->prev_partial->next_partial = c->next_partial;
+    } else {
+        pool->partial = c->next_partial;
+    }
+    if (c->next_partial != NULL) {
+        c->next_partial->prev_partial = c->prev_partial;
+    }
+}
+
+/*
+ * Function for allocating an object from a pool in constant time
+ * Returns address of the object on success
+ * Returns NULL on failure
+ */
+void* Pool_Alloc(mem_pool *pool) {
+    void *ptr;
+
+    if (pool == NULL) {
+        return NULL;
+    }
+    pthread_mutex_lock(&pool->lock);
+    pool_chunk *c = pool->partial;
+    if (c == NULL) { //take a new chunk from the heap
+        c = Alloc_Mem_Aligned(pool->chunk_size - HDR_SIZE, pool->chunk_size);
+        if (c == NULL) {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+        c->magic = POOL_MAGIC ^ (uintptr_t)c;
+        c->pool = pool;
+        c->free = NULL;
+        c->used = 0;
+        c->fresh = 0;
+        c->prev = NULL;
+        c->next = pool->chunks;
+        if (c->next != NULL) {
+            c->next->prev = c;
+        }
+        pool->chunks = c;
+        pool_push(pool, c);
+    }
+    if (c->free != NULL) {
+        ptr = c->free;
+        c->free = *(void**)ptr;
+    } else {
+        ptr = (char*)c + pool->obj_offset + c->fresh * pool->obj_size;
+        c->fresh++;
+    }
+    c->used++;
+    if (c->free == NULL && c->fresh == pool->chunk_objs) { //full
+        pool_unlink(pool, c);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return ptr;
+}
+
+/*
+ * Function for freeing an object of a pool in constant time
+ * Returns 0 on success
+ * Returns -1 if ptr is not an object of pool
+ * A chunk left empty goes back to the heap, unless it is the only one
+ * with free objects. An object freed twice is not detected.
+ */
+int Pool_Free(mem_pool *pool, void *ptr) {
+    if (pool == NULL || ptr == NULL) {
+        return -1;
+    }
+    pool_chunk *c = (pool_chunk*) ((uintptr_t)ptr & ~(uintptr_t)(pool->chunk_size - 1));
+    size_t offset = (char*)ptr - (char*)c;
+    if (offset < pool->obj_offset ||
+        (offset - pool->obj_offset) % pool->obj_size != 0) {
+        return -1;
+    }
+
+    // the chunk header changes under the lock, a chunk may even be given
+    // back to the heap by another thread's Pool_Free
+    pthread_mutex_lock(&pool->lock);
+    if (c->magic != (POOL_MAGIC ^ (uintptr_t)c) || c->pool != pool ||
+        (offset - pool->obj_offset) / pool->obj_size >= c->fresh) {
+        pthread_mutex_unlock(&pool->lock);
+        return -1;
+    }
+    if (c->free == NULL && c->fresh == pool->chunk_objs) { //was full
+        pool_push(pool, c);
+    }
+    *(void**)ptr = c->free;
+    c->free = ptr;
+    c->used--;
+    if (c->used == 0 && (c->prev_partial != NULL || c->next_partial != NULL)) {
+        pool_unlink(pool, c);
+        if (c->prev != NULL) {
+            c->prev->next = c->next;
+        } else {
+            pool->chunks = c->next;
+        }
+        if (c->next != NULL) {
+            c->next->prev = c->prev;
+        }
+        c->magic = 0;
+        Free_Mem(c);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    return 0;
+}
+
+/*
+ * Function for releasing a pool along with every object still in it
+ * Returns 0 on success and -1 on failure
  */
- int bitmask(blk_hdr* blk){
-   if(blk != NULL){
-     return (blk->size_status) & 7;
-   }
-     return -1;
- }
+int Pool_Destroy(mem_pool *pool) {
+    if (pool == NULL) {
+        return -1;
+    }
+    pthread_mutex_lock(&pools_lock);
+    if (pool->prev != NULL) {
+        pool->prev->next = pool->next;
+    } else {
+        pools = pool->next;
+    }
+    if (pool->next != NULL) {
+        pool->next->prev = pool->prev;
+    }
+    pthread_mutex_unlock(&pools_lock);
+    pool_chunk *c = pool->chunks;
+    while (c != NULL) {
+        pool_chunk *next = c->next;
+        c->magic = 0;
+        Free_Mem(c);
+        c = next;
+    }
+    pthread_mutex_destroy(&pool->lock);
+    return Free_Mem(pool);
+}
+
 /*
- * Helper funtion for getting address without the status
- * Masks the last 2 bit away
- * Returns integer value of size of blk
- * Returns -1 if Null addr
+ * Function for creating an arena
+ * Argument - chunk_size: Size of the chunks taken from the default heap,
+ *            0 for the default; bigger requests get a chunk of their own
+ * Returns the new arena on success and NULL on failure
  */
- int blksize(blk_hdr* blk){
-   if(blk != NULL){
-     return (blk->size_status) - bitmask(blk);
-   }
-   return -1;
- }
- 
-/* 
- * Function for allocating 'size' bytes
+mem_arena* Arena_Create(size_t chunk_size) {
+    if (chunk_size == 0) {
+        chunk_size = ARENA_CHUNK;
+    }
+    if (chunk_size > MAX_GROW_SIZE) {
+        return NULL;
+    }
+    mem_arena *arena = Alloc_Mem(sizeof(mem_arena));
+    if (arena == NULL) {
+        return NULL;
+    }
+    arena->chunk_size = chunk_size;
+    arena->chunks = NULL;
+    arena->top = NULL;
+    return arena;
+}
+
+/*
+ * Function for allocating 'size' bytes from an arena by bumping a pointer
  * Returns address of allocated block on success 
  * Returns NULL on failure 
- * Here is what this function should accomplish 
- * - Check for sanity of size - Return NULL when appropriate 
- * - Round up size to a multiple of 8 
- * - Traverse the list of blocks and allocate the best free block which can accommodate the requested size 
- * - Also, when allocating a block - split it into two blocks
- * Tips: Be careful with pointer arithmetic 
- */                    
-void* Alloc_Mem(int size) { 
-    static int mem_size = 0;//size of the full alloc' heap
-    if(mem_size == 0){
-      mem_size = (first_blk -> size_status - 2);
+ */
+void* Arena_Alloc(mem_arena *arena, size_t size) {
+    return Arena_Alloc_Aligned(arena, size, ALIGN);
+}
+
+/*
+ * Function for allocating 'size' bytes from an arena at an address that is
+ * a multiple of 'alignment', a power of two
+ * Returns address of allocated block on success 
+ * Returns NULL on failure 
+ */
+void* Arena_Alloc_Aligned(mem_arena *arena, size_t size, size_t alignment) {
+    if (arena == NULL || alignment == 0 || (alignment & (alignment - 1)) != 0 ||
+        size > MAX_GROW_SIZE || alignment > MAX_GROW_SIZE) {
+        return NULL;
+    }
+    if (arena->chunks != NULL) {
+        char *ptr = (char*) (((uintptr_t)arena->top + alignment - 1) &
+                             ~(uintptr_t)(alignment - 1));
+        if (ptr <= arena->chunks->end && size <= (size_t)(arena->chunks->end - ptr)) {
+            arena->top = ptr + size;
+            return ptr;
+        }
     }
 
-    //checks for abnormally large requests or negative and zero
-    if(size <= 0 || size >  mem_size){
-      return NULL;
+    // the rest of the current chunk is given up
+    size_t len = ARENA_HDR + size + ((alignment > ALIGN) ? alignment : 0);
+    if (len < arena->chunk_size) {
+        len = arena->chunk_size;
     }
-    
-    size += 4; //add header
-    //round up and add padding
-    int pad = size % 8;
-    if(pad != 0){
-      pad = 8 - pad;
+    arena_chunk *c = Alloc_Mem(len);
+    if (c == NULL) {
+        return NULL;
     }
-    size = size + pad;
-    if(size > mem_size){ //if request ends up larger than size after including pad and header
-      return NULL;
+    c->next = arena->chunks;
+    c->end = (char*)c + len;
+    arena->chunks = c;
+    char *ptr = (char*) (((uintptr_t)c + ARENA_HDR + alignment - 1) &
+                         ~(uintptr_t)(alignment - 1));
+    arena->top = ptr + size;
+    return ptr;
+}
+
+/*
+ * Function for taking a marker of everything allocated from an arena so far
+ * Returns the marker to pass to Arena_Restore
+ */
+arena_marker Arena_Save(mem_arena *arena) {
+    arena_marker marker = { NULL, NULL };
+
+    if (arena != NULL) {
+        marker.chunk = arena->chunks;
+        marker.top = arena->top;
     }
-    
-    //Looking for free blk
-    blk_hdr *best_fit = NULL;
-    blk_hdr *curr_hdr = first_blk;
-    int currSize = 0;
-    while (curr_hdr -> size_status != 1){
-      currSize = blksize(curr_hdr);//get current size
-      
-      if((bitmask(curr_hdr) == 2) || (bitmask(curr_hdr) == 0 )){ //If blk is free
-        if(size <= currSize){ //size fits
-         
-          if(best_fit == NULL){ //first comparison, best fit uninit
-            best_fit = curr_hdr;
-          }
-          
-          if(currSize < blksize(best_fit)){ //if current blk is bigger than best fit, just skip
-              best_fit = curr_hdr;
-          }
-        }
-      }
-    
-      curr_hdr = (blk_hdr*) ((char*)curr_hdr + currSize);//next blk
+    return marker;
+}
+
+/*
+ * Function for freeing everything allocated from an arena after a marker
+ * was taken with Arena_Save; markers taken after it are no longer valid
+ */
+void Arena_Restore(mem_arena *arena, arena_marker marker) {
+    if (arena == NULL) {
+        return;
     }
-    
-    //Allocating
-    curr_hdr = best_fit; //move to best fit blk or NULL if all blk full
-    currSize = blksize(best_fit);//-1 if Null
-    
-    if(size > currSize){ //No free space
-      return NULL;
-      
-    }else if(size == currSize) { //Exact fit
-      curr_hdr -> size_status += 1;//a-bit ON
-      blk_hdr *next = (blk_hdr*)((char*)curr_hdr + blksize(curr_hdr));
-      if(next -> size_status != 1){
-       next -> size_status += 2;//p-bit for next hdr ON
-      }
-      return (void*) ((char*)curr_hdr+4);//return payload
-      
-    }else if(size < currSize) { //Splitting
-      blk_hdr *newHeader = (blk_hdr*) ((char*)curr_hdr + size); //new free Header
-      int newSize = currSize - size;
-      newHeader -> size_status = newSize + 2; //newSize/10
-      blk_hdr *footer = (blk_hdr*) ((char*)newHeader + newSize - 4); //new Footer
-      footer -> size_status = newSize;
-      
-      curr_hdr -> size_status = size + bitmask(curr_hdr);//new alloc' header, bitmask for p-bit if any
-      curr_hdr -> size_status += 1;//a-bit ON
-      return (void*) ((char*)curr_hdr+4);//return payload
+    while (arena->chunks != NULL && arena->chunks != marker.chunk) {
+        arena_chunk *next = arena->chunks->next;
+        Free_Mem(arena->chunks);
+        arena->chunks = next;
     }
-    
-    return NULL;
+    arena->top = marker.top;
 }
 
-/* 
- * Function for freeing up a previously allocated block 
- * Argument - ptr: Address of the block to be freed up 
- * Returns 0 on success 
- * Returns -1 on failure 
- * Here is what this function should accomplish 
- * - Return -1 if ptr is NULL
- * - Return -1 if ptr is not 8 byte aligned or if the block is already freed
- * - Mark the block as free 
- * - Coalesce if one or both of the immediate neighbours are free 
- */                    
-int Free_Mem(void *ptr) {                        
-    //ptr checking
-    if(ptr == NULL){//NULL
-      return -1;
-    }else if(((int)ptr % 8) != 0){//8 byte aligned
-      return -1;
+/*
+ * Function for freeing everything allocated from an arena at once
+ * The oldest chunk is kept for the allocations that follow
+ */
+void Arena_Reset(mem_arena *arena) {
+    if (arena == NULL || arena->chunks == NULL) {
+        return;
     }
-    
-    //Compute header
-    blk_hdr *curr_hdr = (blk_hdr*) ((char*)ptr - 4);
-    blk_hdr *temp = NULL;
-    
-    //Freeing
-    if(bitmask(curr_hdr) == 2 || bitmask(curr_hdr) == 0){ 
-      //skip, block already free
-    } else {
-      //check next block
-      temp = (blk_hdr*) ((char*)curr_hdr + blksize(curr_hdr));
-      if(bitmask(temp) == 2 || bitmask(temp) == 0){//next block free
-        curr_hdr -> size_status += blksize(temp);
-      }else{
-        temp -> size_status -= 2; //turn p-bit off
-      }
-      
-      //check prev block
-      if(bitmask(curr_hdr) == 1 || bitmask(curr_hdr) == 0){//prev block free
-        temp = (blk_hdr*) ((char*)curr_hdr - 4);
-        int footer = temp->size_status;
-        temp = (blk_hdr*) ((char*)curr_hdr - footer); //temp at prev addr
-        temp -> size_status += blksize(curr_hdr);
-        curr_hdr = temp;
-      }
-      
-      //no coalesce or coalesce already set up
-      curr_hdr -> size_status = blksize(curr_hdr) + 2; //curr_hdr/10
-      temp = (blk_hdr*) ((char*)curr_hdr + blksize(curr_hdr) - 4);//footer addr
-      temp -> size_status = blksize(curr_hdr);//set footer
-     
-      return 0;
+    arena_chunk *c = arena->chunks;
+    while (c->next != NULL) {
+        arena_chunk *next = c->next;
+        Free_Mem(c);
+        c = next;
     }
-    
-    return -1;
+    arena->chunks = c;
+    arena->top = (char*)c + ARENA_HDR;
+}
+
+/*
+ * Function for releasing an arena and everything allocated from it
+ */
+void Arena_Destroy(mem_arena *arena) {
+    if (arena == NULL) {
+        return;
+    }
+    Arena_Restore(arena, (arena_marker) { NULL, NULL });
+    Free_Mem(arena);
 }
 
 /*
  * Function used to initialize the memory allocator
  * Not intended to be called more than once by a program
  * Argument - sizeOfRegion: Specifies the size of the chunk which needs to be allocated
+ * Argument - opts: Allocator options, NULL for the defaults
  * Returns 0 on success and -1 on failure 
  */                    
-int Init_Mem(int sizeOfRegion)
+int Init_Mem_Opts(size_t sizeOfRegion, const mem_opts *opts)
 {                         
-    int pagesize;
-    int padsize;
-    int fd;
-    int alloc_size;
+    size_t pagesize;
+    size_t padsize;
+    size_t alloc_size;
+    int map_flags;
     void* space_ptr;
-    blk_hdr* end_mark;
+    int nheaps;
     static int allocated_once = 0;
   
     if (0 != allocated_once) {
@@ -248,10 +3370,23 @@ int Init_Mem(int sizeOfRegion)
         "Error:mem.c: Init_Mem has allocated space during a previous call\n");
         return -1;
     }
-    if (sizeOfRegion <= 0) {
+    if (sizeOfRegion == 0) {
         fprintf(stderr, "Error:mem.c: Requested block size is not positive\n");
         return -1;
     }
+    if (sizeOfRegion > MAX_REGION_SIZE) { //also a negative int passed in
+        fprintf(stderr, "Error:mem.c: Requested block size is too big\n");
+        return -1;
+    }
+    if (opts_check(opts) != 0) {
+        return -1;
+    }
+    nheaps = (opts != NULL && opts->nheaps > 0) ? opts->nheaps : 1;
+    if (nheaps > MAX_HEAPS) {
+        fprintf(stderr, "Error:mem.c: At most %d heaps are supported\n",
+                MAX_HEAPS);
+        return -1;
+    }
 
     // Get the pagesize
     pagesize = getpagesize();
@@ -262,15 +3397,18 @@ int Init_Mem(int sizeOfRegion)
     padsize = (pagesize - padsize) % pagesize;
 
     alloc_size = sizeOfRegion + padsize;
+    map_flags = (opts != NULL) ? opts->map_flags : 0;
+    alloc_size = map_round(alloc_size, map_flags);
 
-    // Using mmap to allocate memory
-    fd = open("/dev/zero", O_RDWR);
-    if (-1 == fd) {
-        fprintf(stderr, "Error:mem.c: Cannot open /dev/zero\n");
+    // Every heap gets at least one page
+    if (alloc_size / pagesize < (size_t)nheaps) {
+        fprintf(stderr, "Error:mem.c: Region too small for %d heaps\n",
+                nheaps);
         return -1;
     }
-    space_ptr = mmap(NULL, alloc_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, 
-                    fd, 0);
+
+    // Using mmap to allocate memory
+    space_ptr = map_region(NULL, alloc_size, &map_flags);
     if (MAP_FAILED == space_ptr) {
         fprintf(stderr, "Error:mem.c: mmap cannot allocate space\n");
         allocated_once = 0;
@@ -279,31 +3417,377 @@ int Init_Mem(int sizeOfRegion)
   
      allocated_once = 1;
 
-    // for double word alignement and end mark
-    alloc_size -= 8;
-
-    // To begin with there is only one big free block
-    // initialize heap so that first block meets 
-    // double word alignement requirement
-    first_blk = (blk_hdr*) space_ptr + 1;
-    end_mark = (blk_hdr*)((void*)first_blk + alloc_size);
+    // Split the region into nheaps page aligned heaps, the last one also
+    // takes what is left over
+    heap_base = space_ptr;
+    heap_end = heap_base + alloc_size;
+    heap_span = alloc_size / pagesize / nheaps * pagesize;
+    for (int i = 0; i < nheaps; i++) {
+        size_t len = (i == nheaps - 1) ? alloc_size - heap_span * i
+                                       : heap_span;
+        heap_init(&heaps[i], heap_base + heap_span * i, len, opts, map_flags);
+    }
+    first_blk = heaps[0].first_chunk.first_blk;
+    num_heaps = nheaps;
   
-    // Setting up the header
-    first_blk->size_status = alloc_size;
+    return 0;
+}
 
-    // Marking the previous block as busy
-    first_blk->size_status += 2;
+/*
+ * Function used to initialize the memory allocator with the default options
+ * Argument - sizeOfRegion: Specifies the size of the chunk which needs to be allocated
+ * Returns 0 on success and -1 on failure 
+ */
+int Init_Mem(size_t sizeOfRegion)
+{
+    return Init_Mem_Opts(sizeOfRegion, NULL);
+}
 
-    // Setting up the end mark and marking it as busy
-    end_mark->size_status = 1;
+/*
+ * Returns the size of the largest free block of heap h, caller must hold
+ * h->lock
+ * Only the highest non-empty list of a segregated policy is walked, the
+ * single list of MEM_POLICY_ADDR and MEM_POLICY_LIFO is walked in full
+ */
+static size_t largest_free(mem_heap *h) {
+    blk_hdr *list = NULL;
+    size_t largest = 0;
 
-    // Setting up the footer
-    blk_hdr *footer = (blk_hdr*) ((char*)first_blk + alloc_size - 4);
-    footer->size_status = alloc_size;
-  
+    if (h->policy == MEM_POLICY_TLSF) {
+        if (h->fl_map != 0) {
+            int fl = SIZE_BITS - 1 - __builtin_clzl(h->fl_map);
+            list = h->tlsf_lists[fl][31 - __builtin_clz(h->sl_map[fl])];
+        }
+    } else if (h->policy == MEM_POLICY_ADDR || h->policy == MEM_POLICY_LIFO) {
+        list = h->free_list;
+    } else if (h->free_map != 0) {
+        list = h->free_lists[SIZE_BITS - 1 - __builtin_clzl(h->free_map)];
+    }
+    for (; list != NULL; list = links(list)->next) {
+        if (blksize(list) > largest) {
+            largest = blksize(list);
+        }
+    }
+    return largest;
+}
+
+/*
+ * Function for reading the statistics of the default heaps without walking
+ * their blocks, see mem_stats
+ * Returns 0 on success
+ * Returns -1 if stats is NULL or Init_Mem was not called
+ */
+int Get_Mem_Stats(mem_stats *stats) {
+    size_t heap_bytes = 0;
+
+    if (stats == NULL || num_heaps == 0) {
+        return -1;
+    }
+    memset(stats, 0, sizeof(*stats));
+    for (int i = 0; i < num_heaps; i++) {
+        mem_heap *h = &heaps[i];
+        pthread_mutex_lock(&h->lock);
+        for (mem_chunk *c = &h->first_chunk; c != NULL; c = c->next) {
+            heap_bytes += (char*)c->end_mark - (char*)c->first_blk;
+        }
+        heap_bytes += h->mapped_bytes;
+        stats->free_bytes += h->free_bytes;
+        stats->free_blocks += h->free_blocks;
+        size_t largest = largest_free(h);
+        if (largest > stats->largest_free) {
+            stats->largest_free = largest;
+        }
+        pthread_mutex_unlock(&h->lock);
+    }
+    stats->busy_bytes = heap_bytes - stats->free_bytes;
+
+    pthread_mutex_lock(&stats_lock);
+    size_t count[STAT_COUNT];
+    memcpy(count, stats_retired.count, sizeof(count));
+    for (thread_stats *t = stats_threads; t != NULL; t = t->next) {
+        for (int i = 0; i < STAT_COUNT; i++) {
+            count[i] += __atomic_load_n(&t->count[i], __ATOMIC_RELAXED);
+        }
+    }
+    pthread_mutex_unlock(&stats_lock);
+    stats->allocs = count[STAT_ALLOCS];
+    stats->frees = count[STAT_FREES];
+    stats->failed_allocs = count[STAT_FAILED];
+    stats->busy_blocks = stats->allocs - stats->frees;
+
+    if (stats->free_bytes > 0) {
+        stats->fragmentation = 1.0 - (double)stats->largest_free /
+                                     stats->free_bytes;
+    }
     return 0;
 }
 
+/*
+ * Output buffer of Snapshot_Mem, written out whenever it fills up
+ */
+#define SNAP_BUF_SIZE (1 << 20)
+
+typedef struct snap_out {
+    int fd;
+    int format;
+    char *buf;
+    size_t len;
+    int error;
+    int chunks; //written so far
+    int blocks; //written so far in the current chunk
+} snap_out;
+
+static void snap_flush(snap_out *out) {
+    size_t done = 0;
+
+    while (done < out->len && !out->error) {
+        ssize_t n = write(out->fd, out->buf + done, out->len - done);
+        if (n > 0) {
+            done += n;
+        } else if (n == 0 || errno != EINTR) {
+            out->error = 1;
+        }
+    }
+    out->len = 0;
+}
+
+static void snap_put(snap_out *out, const void *data, size_t len) {
+    if (out->len + len > SNAP_BUF_SIZE) {
+        snap_flush(out);
+    }
+    memcpy(out->buf + out->len, data, len);
+    out->len += len;
+}
+
+/*
+ * Writes one record, a chunk if flags has MEM_SNAPSHOT_CHUNK and a block
+ * of the chunk written last otherwise
+ */
+static void snap_record(snap_out *out, uint64_t offset, uint64_t size,
+                        int flags) {
+    char line[128];
+    int len;
+
+    if (out->format == MEM_SNAPSHOT_BINARY) {
+        mem_snapshot_rec rec = { offset, size | flags };
+        snap_put(out, &rec, sizeof(rec));
+        return;
+    }
+    if (flags & MEM_SNAPSHOT_CHUNK) {
+        len = snprintf(line, sizeof(line),
+                       "%s\n{\"heap\": %llu, \"size\": %llu, \"blocks\": [",
+                       (out->chunks > 0) ? "]}," : "",
+                       (unsigned long long)offset, (unsigned long long)size);
+        out->chunks++;
+        out->blocks = 0;
+    } else {
+        len = snprintf(line, sizeof(line), "%s\n{\"offset\": %llu, "
+                       "\"size\": %llu, \"busy\": %s, \"prev_busy\": %s}",
+                       (out->blocks > 0) ? "," : "",
+                       (unsigned long long)offset, (unsigned long long)size,
+                       (flags & MEM_SNAPSHOT_BUSY) ? "true" : "false",
+                       (flags & MEM_SNAPSHOT_PREV_BUSY) ? "true" : "false");
+        out->blocks++;
+    }
+    snap_put(out, line, len);
+}
+
+/*
+ * Function for writing every block of the default heaps to a file
+ * descriptor, see MEM_SNAPSHOT_BINARY and MEM_SNAPSHOT_JSON
+ * Argument - fd: File descriptor open for writing
+ * Argument - format: MEM_SNAPSHOT_BINARY or MEM_SNAPSHOT_JSON
+ * Returns 0 on success
+ * Returns -1 on a bad format, a failed write or if Init_Mem was not called
+ * Each heap stays locked while its blocks are written, so a slow fd holds
+ * up the threads allocating from it.
+ */
+int Snapshot_Mem(int fd, int format) {
+    snap_out out = { fd, format };
+    char line[64];
+
+    if (num_heaps == 0 ||
+        (format != MEM_SNAPSHOT_BINARY && format != MEM_SNAPSHOT_JSON)) {
+        return -1;
+    }
+    out.buf = mmap(NULL, SNAP_BUF_SIZE, PROT_READ | PROT_WRITE,
+                   MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (out.buf == MAP_FAILED) {
+        return -1;
+    }
+
+    if (format == MEM_SNAPSHOT_BINARY) {
+        mem_snapshot_hdr hdr = { MEM_SNAPSHOT_MAGIC, MEM_SNAPSHOT_VERSION,
+                                 ALIGN };
+        snap_put(&out, &hdr, sizeof(hdr));
+    } else {
+        int len = snprintf(line, sizeof(line),
+                           "{\"version\": %d, \"align\": %d, \"chunks\": [",
+                           MEM_SNAPSHOT_VERSION, ALIGN);
+        snap_put(&out, line, len);
+    }
+
+    for (int i = 0; i < num_heaps && !out.error; i++) {
+        mem_heap *h = &heaps[i];
+        pthread_mutex_lock(&h->lock);
+        for (mem_chunk *c = &h->first_chunk; c != NULL; c = c->next) {
+            char *first = (char*)c->first_blk;
+            snap_record(&out, i, (char*)c->end_mark - first,
+                        MEM_SNAPSHOT_CHUNK);
+            for (blk_hdr *b = c->first_blk; b != c->end_mark;
+                 b = (blk_hdr*) ((char*)b + blksize(b))) {
+                snap_record(&out, (char*)b - first, blksize(b),
+                            b->size_status & (MEM_SNAPSHOT_BUSY |
+                                              MEM_SNAPSHOT_PREV_BUSY));
+            }
+        }
+        for (mapped_blk *m = h->mapped; m != NULL; m = m->next) {
+            snap_record(&out, i, m->len, MEM_SNAPSHOT_CHUNK);
+            snap_record(&out, 0, m->len,
+                        MEM_SNAPSHOT_BUSY | MEM_SNAPSHOT_PREV_BUSY);
+        }
+        pthread_mutex_unlock(&h->lock);
+    }
+
+    if (format == MEM_SNAPSHOT_JSON) {
+        snap_put(&out, (out.chunks > 0) ? "]}\n]}\n" : "]}\n",
+                 (out.chunks > 0) ? 6 : 3);
+    }
+    snap_flush(&out);
+    munmap(out.buf, SNAP_BUF_SIZE);
+    return out.error ? -1 : 0;
+}
+
+/*
+ * Function for recording the calls on the default heaps to a file
+ * descriptor until Trace_Mem_Stop, see mem_trace_rec
+ * Argument - fd: File descriptor open for writing, the header is written
+ *            right away
+ * Returns 0 on success
+ * Returns -1 if a trace is running, Init_Mem was not called or the header
+ * could not be written
+ */
+int Trace_Mem_Start(int fd) {
+    mem_trace_hdr hdr = { MEM_TRACE_MAGIC, MEM_TRACE_VERSION, 0 };
+
+    if (num_heaps == 0 || fd < 0) {
+        return -1;
+    }
+    pthread_mutex_lock(&trace_lock);
+    if (trace_on) {
+        pthread_mutex_unlock(&trace_lock);
+        return -1;
+    }
+    trace_fd = fd;
+    trace_error = 0;
+    trace_write(&hdr, sizeof(hdr));
+    trace_start = trace_now();
+    if (!trace_error) {
+        __atomic_store_n(&trace_on, 1, __ATOMIC_SEQ_CST);
+    }
+    pthread_mutex_unlock(&trace_lock);
+    return trace_error ? -1 : 0;
+}
+
+/*
+ * Function for ending the trace started by Trace_Mem_Start, writing out
+ * the records every thread still holds
+ * Returns 0 on success
+ * Returns -1 if no trace was running or a write to its fd failed
+ */
+int Trace_Mem_Stop(void) {
+    pthread_mutex_lock(&trace_lock);
+    if (!trace_on) {
+        pthread_mutex_unlock(&trace_lock);
+        return -1;
+    }
+    __atomic_store_n(&trace_on, 0, __ATOMIC_SEQ_CST);
+    for (trace_buf *b = trace_bufs; b != NULL; b = b->next) {
+        while (__atomic_load_n(&b->busy, __ATOMIC_ACQUIRE)) {
+            sched_yield(); //the owner is appending or writing
+        }
+        if (b->len > 0) {
+            trace_write(b->recs, sizeof(mem_trace_rec) * b->len);
+            b->len = 0;
+        }
+    }
+    trace_fd = -1;
+    pthread_mutex_unlock(&trace_lock);
+    return trace_error ? -1 : 0;
+}
+
+/*
+ * Function for pthread_atfork to call before a fork, takes every lock of
+ * libmem in the order the allocator nests them: pools, slabs, heaps and
+ * then the ones that are never held across another
+ */
+void Fork_Mem_Prepare(void) {
+    pthread_mutex_lock(&pools_lock);
+    for (mem_pool *p = pools; p != NULL; p = p->next) {
+        pthread_mutex_lock(&p->lock);
+    }
+    for (int i = 0; i < num_heaps; i++) {
+        pthread_mutex_lock(&heaps[i].slab_lock);
+    }
+    for (int i = 0; i < num_heaps; i++) {
+        pthread_mutex_lock(&heaps[i].lock);
+    }
+    pthread_mutex_lock(&grown_lock);
+    pthread_mutex_lock(&stats_lock);
+    pthread_mutex_lock(&trace_lock);
+}
+
+/*
+ * Function for pthread_atfork to call in the parent after a fork, releases
+ * the locks Fork_Mem_Prepare took
+ */
+void Fork_Mem_Parent(void) {
+    pthread_mutex_unlock(&trace_lock);
+    pthread_mutex_unlock(&stats_lock);
+    pthread_mutex_unlock(&grown_lock);
+    for (int i = num_heaps - 1; i >= 0; i--) {
+        pthread_mutex_unlock(&heaps[i].lock);
+    }
+    for (int i = num_heaps - 1; i >= 0; i--) {
+        pthread_mutex_unlock(&heaps[i].slab_lock);
+    }
+    for (mem_pool *p = pools; p != NULL; p = p->next) {
+        pthread_mutex_unlock(&p->lock);
+    }
+    pthread_mutex_unlock(&pools_lock);
+}
+
+/*
+ * Function for pthread_atfork to call in the child after a fork, sets up
+ * the locks Fork_Mem_Prepare took anew. The records of a running trace
+ * are the parent's to write, so the child drops the trace.
+ */
+void Fork_Mem_Child(void) {
+    trace_buf *b = trace_bufs;
+
+    while (b != NULL) {
+        trace_buf *next = b->next;
+        munmap(b, sizeof(trace_buf));
+        b = next;
+    }
+    trace_bufs = NULL;
+    tbuf = NULL;
+    trace_on = 0;
+    trace_fd = -1;
+
+    pthread_mutex_init(&trace_lock, NULL);
+    pthread_mutex_init(&stats_lock, NULL);
+    pthread_mutex_init(&grown_lock, NULL);
+    for (int i = 0; i < num_heaps; i++) {
+        pthread_mutex_init(&heaps[i].lock, NULL);
+        pthread_mutex_init(&heaps[i].slab_lock, NULL);
+    }
+    for (mem_pool *p = pools; p != NULL; p = p->next) {
+        pthread_mutex_init(&p->lock, NULL);
+    }
+    pthread_mutex_init(&pools_lock, NULL);
+}
+
 /* 
  * Function to be used for debugging 
  * Prints out a list of all the blocks along with the following information i
@@ -321,13 +3805,13 @@ void Dump_Mem() {
     char p_status[5];
     char *t_begin = NULL;
     char *t_end = NULL;
-    int t_size;
+    size_t t_size;
 
-    blk_hdr *current = first_blk;
+    blk_hdr *current = NULL;
     counter = 1;
 
-    int busy_size = 0;
-    int free_size = 0;
+    size_t busy_size = 0;
+    size_t free_size = 0;
     int is_busy = -1;
 
     fprintf(stdout, "************************************Block list***\
@@ -336,48 +3820,56 @@ void Dump_Mem() {
     fprintf(stdout, "-------------------------------------------------\
                     --------------------------------\n");
   
-    while (current->size_status != 1) {
-        t_begin = (char*)current;
-        t_size = current->size_status;
-    
-        if (t_size & 1) {
-            // LSB = 1 => busy block
-            strcpy(status, "Busy");
-            is_busy = 1;
-            t_size = t_size - 1;
-        } else {
-            strcpy(status, "Free");
-            is_busy = 0;
-        }
+    for (int i = 0; i < num_heaps; i++) {
+        pthread_mutex_lock(&heaps[i].lock);
+        for (mem_chunk *c = &heaps[i].first_chunk; c != NULL; c = c->next) {
+            current = c->first_blk;
+            while (current != c->end_mark) {
+                t_begin = (char*)current;
+                t_size = current->size_status;
+            
+                if (t_size & 1) {
+                    // LSB = 1 => busy block
+                    strcpy(status, "Busy");
+                    is_busy = 1;
+                    t_size = t_size - 1;
+                } else {
+                    strcpy(status, "Free");
+                    is_busy = 0;
+                }
 
-        if (t_size & 2) {
-            strcpy(p_status, "Busy");
-            t_size = t_size - 2;
-        } else {
-            strcpy(p_status, "Free");
-        }
+                if (t_size & 2) {
+                    strcpy(p_status, "Busy");
+                    t_size = t_size - 2;
+                } else {
+                    strcpy(p_status, "Free");
+                }
+                t_size = t_size & ~(size_t)PURGED;
 
-        if (is_busy) 
-            busy_size += t_size;
-        else 
-            free_size += t_size;
+                if (is_busy) 
+                    busy_size += t_size;
+                else 
+                    free_size += t_size;
 
-        t_end = t_begin + t_size - 1;
-    
-        fprintf(stdout, "%d\t%s\t%s\t0x%08lx\t0x%08lx\t%d\n", counter, status, 
-        p_status, (unsigned long int)t_begin, (unsigned long int)t_end, t_size);
-    
-        current = (blk_hdr*)((char*)current + t_size);
-        counter = counter + 1;
+                t_end = t_begin + t_size - 1;
+            
+                fprintf(stdout, "%d\t%s\t%s\t0x%08lx\t0x%08lx\t%zu\n", counter, status, 
+                p_status, (unsigned long int)t_begin, (unsigned long int)t_end, t_size);
+            
+                current = (blk_hdr*)((char*)current + t_size);
+                counter = counter + 1;
+            }
+        }
+        pthread_mutex_unlock(&heaps[i].lock);
     }
 
     fprintf(stdout, "---------------------------------------------------\
                     ------------------------------\n");
     fprintf(stdout, "***************************************************\
                     ******************************\n");
-    fprintf(stdout, "Total busy size = %d\n", busy_size);
-    fprintf(stdout, "Total free size = %d\n", free_size);
-    fprintf(stdout, "Total size = %d\n", busy_size + free_size);
+    fprintf(stdout, "Total busy size = %zu\n", busy_size);
+    fprintf(stdout, "Total free size = %zu\n", free_size);
+    fprintf(stdout, "Total size = %zu\n", busy_size + free_size);
     fprintf(stdout, "***************************************************\
                     ******************************\n");
     fflush(stdout);
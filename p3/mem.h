@@ -1,15 +1,302 @@
 #ifndef __mem_h__
 #define __mem_h__
 
-int Init_Mem(int sizeOfRegion);
-void* Alloc_Mem(int size);
+#include <stddef.h>
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/*
+ * How free blocks are indexed, picked once in Init_Mem_Opts
+ * MEM_POLICY_SEGLIST - power of two size classes, best fit (the default)
+ * MEM_POLICY_TLSF    - two level segregated fit, constant time good fit
+ * MEM_POLICY_ADDR    - a single list in address order, first fit; keeps
+ *                      fragmentation low but frees can walk the list
+ * MEM_POLICY_LIFO    - a single list, the block freed last comes first,
+ *                      first fit; constant time frees
+ */
+#define MEM_POLICY_SEGLIST 0
+#define MEM_POLICY_TLSF    1
+#define MEM_POLICY_ADDR    2
+#define MEM_POLICY_LIFO    3
+
+/*
+ * How the pages of a purged free block are handed back to the OS
+ * MEM_PURGE_DONTNEED - madvise(MADV_DONTNEED), the pages are dropped at once
+ *                      and read back as zeros (the default)
+ * MEM_PURGE_FREE     - madvise(MADV_FREE), the kernel drops the pages only
+ *                      under memory pressure; falls back to MADV_DONTNEED
+ *                      where MADV_FREE is not supported
+ */
+#define MEM_PURGE_DONTNEED 0
+#define MEM_PURGE_FREE     1
+
+/*
+ * How the pages under a heap are mapped, flags that can be or'ed together
+ * MEM_MAP_HUGETLB  - map the region with MAP_HUGETLB so it is backed by the
+ *                    reserved huge pages of the system; falls back to
+ *                    MEM_MAP_THP where there are not enough of them
+ * MEM_MAP_THP      - madvise(MADV_HUGEPAGE) so the kernel backs the region
+ *                    with transparent huge pages where it can
+ * MEM_MAP_POPULATE - fault in every page up front with MAP_POPULATE, so the
+ *                    first touch of a block takes no page fault
+ * MEM_MAP_LOCK     - mlock the region so its pages are never swapped out;
+ *                    fails if RLIMIT_MEMLOCK is too low. Locked pages are
+ *                    never purged
+ */
+#define MEM_MAP_HUGETLB  1
+#define MEM_MAP_THP      2
+#define MEM_MAP_POPULATE 4
+#define MEM_MAP_LOCK     8
+
+/*
+ * Options for Init_Mem_Opts, zero means the default for every field
+ * policy - one of the MEM_POLICY_ values above
+ * nheaps - number of heaps the region is split into; threads are bound to
+ *          them round robin and a block freed by a thread bound to another
+ *          heap is handed to its owner without taking the owner's lock
+ * grow_chunk - when no free block fits, map another chunk of at least this
+ *          many bytes instead of failing; 0 keeps the heap at its first size
+ * grow_pct - each further chunk is this percentage of the one before
+ *          (200 by default, so chunk sizes double)
+ * purge_threshold - free blocks of at least this many bytes give the whole
+ *          pages inside them back to the OS once they have stayed free for
+ *          purge_decay_ms; 0 never purges on its own (see Heap_Purge)
+ * purge_decay_ms - how long a large free block must stay free before it is
+ *          purged (1000 by default), so blocks that are reused right away
+ *          are not purged and faulted back in
+ * purge_mode - one of the MEM_PURGE_ values above
+ * map_flags - MEM_MAP_ flags above for the region and every chunk mapped
+ *          when the heap grows
+ * mmap_threshold - requests of at least this many bytes get a mapping of
+ *          their own that is unmapped when they are freed and resized with
+ *          mremap; 0 carves every request out of the heap
+ * slab - nonzero serves requests of up to 64 bytes from slabs: pages cut
+ *          into slots of one size without a header per block. Such a slot
+ *          is aligned to the largest power of two (up to the usual
+ *          alignment) its size, rounded up to 8, is a multiple of
+ * quick_max - freed blocks of up to this many bytes (at most 1024) are not
+ *          coalesced at once but kept on a list per size, for the next
+ *          request of that size; they are coalesced in a batch when a
+ *          request finds no free block or 256 KiB of them pile up.
+ *          0 coalesces every block when it is freed
+ */
+typedef struct mem_opts {
+    int policy;
+    int nheaps;
+    size_t grow_chunk;
+    int grow_pct;
+    size_t purge_threshold;
+    int purge_decay_ms;
+    int purge_mode;
+    int map_flags;
+    size_t mmap_threshold;
+    int slab;
+    size_t quick_max;
+} mem_opts;
+
+/*
+ * Independent heaps, each with its own region of memory
+ * Heap_Alloc and Heap_Free take NULL for the default heap set up by Init_Mem
+ */
+typedef struct mem_heap mem_heap;
+
+mem_heap* Heap_Create(size_t sizeOfRegion, const mem_opts *opts);
+void* Heap_Alloc(mem_heap *heap, size_t size);
+void* Heap_Alloc_Aligned(mem_heap *heap, size_t size, size_t alignment);
+void* Heap_Calloc(mem_heap *heap, size_t nmemb, size_t size);
+void* Heap_Realloc(mem_heap *heap, void *ptr, size_t size);
+int Heap_Free(mem_heap *heap, void *ptr);
+size_t Heap_Usable_Size(mem_heap *heap, void *ptr);
+int Heap_Destroy(mem_heap *heap);
+
+/*
+ * Heap_Purge gives the whole pages inside every free block of heap back to
+ * the OS right away, whatever its age and size, and returns how many bytes
+ * that was. Heap_Purge_Stats reports the bytes purged so far and how many
+ * of them were handed out again by an allocation (and so will fault back
+ * in). Both take NULL for all the heaps set up by Init_Mem.
+ */
+long Heap_Purge(mem_heap *heap);
+void Heap_Purge_Stats(mem_heap *heap, long long *purged, long long *refaulted);
+
+int Init_Mem(size_t sizeOfRegion);
+int Init_Mem_Opts(size_t sizeOfRegion, const mem_opts *opts);
+void* Alloc_Mem(size_t size);
+void* Alloc_Mem_Aligned(size_t size, size_t alignment);
+void* Calloc_Mem(size_t nmemb, size_t size);
+void* Realloc_Mem(void *ptr, size_t size);
 int Free_Mem(void *ptr);
+size_t Usable_Size_Mem(void *ptr);
 void Dump_Mem();
 
-void* malloc(size_t size) {
-    return NULL;
-}
+/*
+ * Statistics of the default heaps, kept up to date by every call instead of
+ * walking the blocks like Dump_Mem; Get_Mem_Stats takes each heap's lock
+ * once, its cost grows with the number of heaps, chunks and threads only
+ * (and with the free list of MEM_POLICY_ADDR and MEM_POLICY_LIFO heaps)
+ * busy_bytes    - bytes in busy blocks, headers included. Blocks held by a
+ *                 thread cache, a quick list or a slab count as busy, so do
+ *                 blocks with a mapping of their own (the whole mapping)
+ * free_bytes    - bytes in free blocks, headers included
+ * busy_blocks   - blocks allocated and not freed yet (allocs - frees)
+ * free_blocks   - free blocks
+ * largest_free  - size of the largest free block, headers included
+ * allocs        - successful allocations so far, a moving Realloc_Mem is
+ *                 one allocation and one free
+ * frees         - successful frees so far
+ * failed_allocs - allocations that returned NULL
+ * fragmentation - 1 - largest_free / free_bytes: 0 when all free memory is
+ *                 one block, close to 1 when it is scattered in small ones
+ * Only calls made after Init_Mem are counted.
+ */
+typedef struct mem_stats {
+    size_t busy_bytes;
+    size_t free_bytes;
+    size_t busy_blocks;
+    size_t free_blocks;
+    size_t largest_free;
+    size_t allocs;
+    size_t frees;
+    size_t failed_allocs;
+    double fragmentation;
+} mem_stats;
 
-#endif // __mem_h__
+int Get_Mem_Stats(mem_stats *stats);
+
+/*
+ * Snapshot_Mem writes every block of the default heaps to the file
+ * descriptor fd, one heap at a time under its lock, in large writes.
+ * Returns 0 on success and -1 on failure. tools/snapstat reads the
+ * binary format and prints a size histogram and a fragmentation map.
+ *
+ * MEM_SNAPSHOT_BINARY - a mem_snapshot_hdr, then a mem_snapshot_rec per
+ *                       chunk followed by one per block in it, in address
+ *                       order; the fields are in the writer's byte order
+ * MEM_SNAPSHOT_JSON   - {"version": 1, "align": n, "chunks": [{"heap": i,
+ *                       "size": n, "blocks": [{"offset": n, "size": n,
+ *                       "busy": b, "prev_busy": b}, ...]}, ...]}
+ *
+ * A chunk is a run of blocks: the region of a heap, a chunk it grew by or
+ * the mapping of a block that has its own (one busy block). Offsets are
+ * from the start of the chunk's first block, sizes include the headers.
+ * Blocks held by a thread cache, a quick list or a slab are busy.
+ */
+#define MEM_SNAPSHOT_BINARY 0
+#define MEM_SNAPSHOT_JSON   1
+
+#define MEM_SNAPSHOT_MAGIC   "MEMSNAP"
+#define MEM_SNAPSHOT_VERSION 1
+
+#define MEM_SNAPSHOT_BUSY      1 //the block is busy
+#define MEM_SNAPSHOT_PREV_BUSY 2 //the block in front of it is busy
+#define MEM_SNAPSHOT_CHUNK     4 //a chunk record, offset is the heap index
+
+typedef struct mem_snapshot_hdr {
+    char magic[8]; //MEM_SNAPSHOT_MAGIC
+    uint32_t version;
+    uint32_t align; //every block size is a multiple of this
+} mem_snapshot_hdr;
 
+typedef struct mem_snapshot_rec {
+    uint64_t offset;
+    uint64_t size; //plus the MEM_SNAPSHOT_ flags in the low bits
+} mem_snapshot_rec;
 
+int Snapshot_Mem(int fd, int format);
+
+/*
+ * Trace_Mem_Start records every successful call on the default heaps
+ * (Alloc_Mem, Alloc_Mem_Aligned, Calloc_Mem, Realloc_Mem, Free_Mem and the
+ * Heap_ calls with a NULL heap) until Trace_Mem_Stop, and the allocations
+ * that failed. Each thread appends to a buffer of its own without a lock
+ * and writes it to fd when it is full; Trace_Mem_Stop writes out what is
+ * left. Both return 0 on success and -1 on failure, fd stays open.
+ * bench/replay runs a trace again.
+ *
+ * The file is a mem_trace_hdr followed by mem_trace_rec records, in time
+ * order per thread but not across threads. A free is stamped before the
+ * block is freed and an allocation once it has its block, so sorted by
+ * time a block is always freed before it is handed out again.
+ */
+#define MEM_TRACE_ALLOC   1 //size bytes
+#define MEM_TRACE_ALIGNED 2 //size bytes aligned to 1 << align
+#define MEM_TRACE_CALLOC  3 //size is nmemb * size
+#define MEM_TRACE_REALLOC 4 //old resized to size, ptr is the result
+#define MEM_TRACE_FREE    5 //ptr freed
+
+#define MEM_TRACE_MAGIC   "MEMTRAC"
+#define MEM_TRACE_VERSION 1
+
+typedef struct mem_trace_hdr {
+    char magic[8]; //MEM_TRACE_MAGIC
+    uint32_t version;
+    uint32_t reserved;
+} mem_trace_hdr;
+
+typedef struct mem_trace_rec {
+    uint64_t time; //ns since Trace_Mem_Start
+    uint64_t ptr; //block returned, 0 if the call failed, or block freed
+    uint64_t old; //block passed to Realloc_Mem, 0 for the other calls
+    uint32_t size; //bytes asked for, UINT32_MAX for 4 GiB and more
+    uint8_t op; //MEM_TRACE_ value
+    uint8_t align; //log2 of the alignment of MEM_TRACE_ALIGNED, else 0
+    uint16_t thread; //threads are numbered as they first trace a call
+} mem_trace_rec;
+
+int Trace_Mem_Start(int fd);
+int Trace_Mem_Stop(void);
+
+/*
+ * Pools of objects of one size, carved out of chunks of the default heap
+ * Pool_Alloc and Pool_Free take constant time, a chunk goes back to the
+ * heap once every object in it is freed
+ */
+typedef struct mem_pool mem_pool;
+
+mem_pool* Pool_Create(size_t obj_size, size_t align);
+void* Pool_Alloc(mem_pool *pool);
+int Pool_Free(mem_pool *pool, void *ptr);
+int Pool_Destroy(mem_pool *pool);
+
+/*
+ * Arenas for memory that is all freed at once: Arena_Alloc bumps a pointer
+ * through chunks taken from the default heap, nothing is freed on its own.
+ * Arena_Save returns a marker and Arena_Restore frees everything allocated
+ * after it; Arena_Reset frees everything, in time linear in the number of
+ * chunks. An arena must only be used by one thread at a time.
+ * See arena.hpp for a C++ wrapper.
+ */
+typedef struct mem_arena mem_arena;
+
+typedef struct arena_marker {
+    void *chunk; //current chunk when the marker was taken
+    char *top; //next free byte in it
+} arena_marker;
+
+mem_arena* Arena_Create(size_t chunk_size);
+void* Arena_Alloc(mem_arena *arena, size_t size);
+void* Arena_Alloc_Aligned(mem_arena *arena, size_t size, size_t alignment);
+arena_marker Arena_Save(mem_arena *arena);
+void Arena_Restore(mem_arena *arena, arena_marker marker);
+void Arena_Reset(mem_arena *arena);
+void Arena_Destroy(mem_arena *arena);
+
+/*
+ * For pthread_atfork, so the child of a multithreaded process can allocate:
+ * Fork_Mem_Prepare takes every lock of the default heaps, the pools and
+ * libmem's own, Fork_Mem_Parent releases them and Fork_Mem_Child sets them
+ * up anew. The child does not trace, and blocks cached by the threads it
+ * did not inherit stay busy. Locks of Heap_Create heaps are the caller's.
+ */
+void Fork_Mem_Prepare(void);
+void Fork_Mem_Parent(void);
+void Fork_Mem_Child(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif // __mem_h__
@@ -8,6 +8,6 @@ int main() {
    assert(Init_Mem(4096) == 0);
    int* ptr = (int*) Alloc_Mem(sizeof(int));
    assert(ptr != NULL);
-   assert(((int)ptr) % 8 == 0);
+   assert(((uintptr_t)ptr) % 8 == 0);
    exit(0);
 }
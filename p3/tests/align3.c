@@ -18,7 +18,7 @@ int main() {
     ptr[8] = (Alloc_Mem(55));
    
     for (int i = 0; i < 9; i++) {
-        assert(((int)ptr[i]) % 8 == 0);
+        assert(((uintptr_t)ptr[i]) % 8 == 0);
     }
     exit(0);
 }
@@ -0,0 +1,25 @@
+/* every payload is aligned to twice the size of a size_t (16 bytes in a 64-bit build) */
+#include <assert.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include "mem.h"
+
+int main() {
+    assert(Init_Mem(4096) == 0);
+    void* ptr[9];
+    int sizes[9] = { 1, 5, 14, 8, 1, 4, 9, 33, 55 };
+
+    for (int i = 0; i < 9; i++) {
+        ptr[i] = Alloc_Mem(sizes[i]);
+        assert(ptr[i] != NULL);
+        assert(((uintptr_t)ptr[i]) % (2 * sizeof(size_t)) == 0);
+    }
+    // freed and reused blocks keep the alignment
+    assert(Free_Mem(ptr[2]) == 0);
+    assert(Free_Mem(ptr[7]) == 0);
+    ptr[2] = Alloc_Mem(3);
+    ptr[7] = Alloc_Mem(17);
+    assert(((uintptr_t)ptr[2]) % (2 * sizeof(size_t)) == 0);
+    assert(((uintptr_t)ptr[7]) % (2 * sizeof(size_t)) == 0);
+    exit(0);
+}
@@ -0,0 +1,60 @@
+/* Alloc_Mem_Aligned returns aligned blocks that Free_Mem takes back */
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mem.h"
+
+int main() {
+   assert(Init_Mem(65536) == 0);
+   char * ptr[4];
+
+   ptr[0] = Alloc_Mem(24);
+   assert(ptr[0] != NULL);
+
+   ptr[1] = Alloc_Mem_Aligned(100, 64);
+   assert(ptr[1] != NULL);
+   assert((uintptr_t)ptr[1] % 64 == 0);
+
+   ptr[2] = Alloc_Mem_Aligned(5000, 4096);
+   assert(ptr[2] != NULL);
+   assert((uintptr_t)ptr[2] % 4096 == 0);
+   memset(ptr[2], 'a', 5000);
+
+   // the gap in front of ptr[2] is a free block a small request can use
+   ptr[3] = Alloc_Mem(200);
+   assert(ptr[3] != NULL);
+   assert(ptr[3] > ptr[1] && ptr[3] < ptr[2]);
+
+   // not a power of two
+   assert(Alloc_Mem_Aligned(100, 0) == NULL);
+   assert(Alloc_Mem_Aligned(100, 3) == NULL);
+   assert(Alloc_Mem_Aligned(100, 4097) == NULL);
+
+   // small alignments are plain allocations
+   char * small = Alloc_Mem_Aligned(10, 1);
+   assert(small != NULL);
+   assert(Free_Mem(small) == 0);
+
+   for (int i = 0; i < 4; i++) {
+      assert(Free_Mem(ptr[i]) == 0);
+   }
+
+   // every fragment coalesced back into one block
+   ptr[0] = Alloc_Mem(60000);
+   assert(ptr[0] != NULL);
+   assert(Free_Mem(ptr[0]) == 0);
+
+   // heaps of their own take the same path
+   mem_heap * heap = Heap_Create(32768, NULL);
+   assert(heap != NULL);
+   ptr[0] = Heap_Alloc_Aligned(heap, 1000, 1024);
+   assert(ptr[0] != NULL);
+   assert((uintptr_t)ptr[0] % 1024 == 0);
+   assert(Heap_Free(heap, ptr[0]) == 0);
+   assert(Heap_Alloc_Aligned(heap, 1000, 65536) == NULL);
+   assert(Heap_Alloc(heap, 30000) != NULL);
+   Heap_Destroy(heap);
+
+   exit(0);
+}
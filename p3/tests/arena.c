@@ -0,0 +1,54 @@
+/* Arena_Alloc bumps a pointer, Arena_Restore and Arena_Reset free in bulk */
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mem.h"
+
+#define REGION (1 << 20)
+
+int main() {
+   assert(Init_Mem(REGION) == 0);
+   mem_arena* arena = Arena_Create(4096);
+   assert(arena != NULL);
+
+   // allocations follow each other
+   char* a = Arena_Alloc(arena, 10);
+   char* b = Arena_Alloc(arena, 10);
+   assert(a != NULL && b != NULL);
+   assert((uintptr_t)a % 8 == 0 && (uintptr_t)b % 8 == 0);
+   assert(b > a && b - a <= 16);
+   char* c = Arena_Alloc_Aligned(arena, 100, 256);
+   assert(c != NULL && (uintptr_t)c % 256 == 0);
+   assert(Arena_Alloc_Aligned(arena, 10, 3) == NULL);
+
+   // everything after a marker goes away, even across chunks
+   arena_marker mark = Arena_Save(arena);
+   char* d = Arena_Alloc(arena, 16);
+   for (int i = 0; i < 100; i++) {
+      char* e = Arena_Alloc(arena, 1000);
+      assert(e != NULL);
+      memset(e, 'e', 1000);
+   }
+   char* big = Arena_Alloc(arena, 10000); // a chunk of its own
+   assert(big != NULL);
+   memset(big, 'f', 10000);
+   Arena_Restore(arena, mark);
+   assert(Arena_Alloc(arena, 16) == d);
+
+   // the chunks went back to the heap, all but one after a reset
+   for (int i = 0; i < 200; i++) {
+      assert(Arena_Alloc(arena, 1000) != NULL);
+   }
+   Arena_Reset(arena);
+   assert(Arena_Alloc(arena, 10) == a);
+   char* rest = Alloc_Mem(REGION / 4 * 3);
+   assert(rest != NULL);
+   assert(Free_Mem(rest) == 0);
+
+   Arena_Destroy(arena);
+   rest = Alloc_Mem(REGION - 4096);
+   assert(rest != NULL);
+
+   exit(0);
+}
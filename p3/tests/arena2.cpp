@@ -0,0 +1,45 @@
+/* mem::Arena and mem::ArenaScope free what a scope allocated */
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "../arena.hpp"
+
+struct Point {
+   Point(int x, int y) : x(x), y(y) {}
+   int x;
+   int y;
+};
+
+int main() {
+   assert(Init_Mem(1 << 20) == 0);
+   mem::Arena arena(4096);
+
+   Point* p = arena.make<Point>(1, 2);
+   assert(p->x == 1 && p->y == 2);
+   void* next = NULL;
+   {
+      mem::ArenaScope scope(arena);
+      next = arena.alloc(8);
+      int* numbers = arena.make_array<int>(5000);
+      assert(numbers[4999] == 0);
+      double* d = static_cast<double*>(arena.alloc(sizeof(double), 64));
+      assert((uintptr_t)d % 64 == 0);
+   }
+   // the scope freed everything it allocated
+   assert(arena.alloc(8) == next);
+   assert(p->x == 1);
+
+   mem::Arena moved(std::move(arena));
+   moved.reset();
+   assert(moved.make<Point>(3, 4) == p);
+
+   bool thrown = false;
+   try {
+      moved.alloc(8, 3);
+   } catch (std::bad_alloc&) {
+      thrown = true;
+   }
+   assert(thrown);
+
+   exit(0);
+}
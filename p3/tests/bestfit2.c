@@ -0,0 +1,50 @@
+/* check best fit within a size class and across size classes */
+#include <assert.h>
+#include <stdlib.h>
+#include "mem.h"
+
+int main() {
+   assert(Init_Mem(4096) == 0);
+   void* ptr[7];
+   void* test;
+
+   ptr[0] = Alloc_Mem(180);
+   assert(ptr[0] != NULL);
+
+   ptr[1] = Alloc_Mem(100);
+   assert(ptr[1] != NULL);
+
+   ptr[2] = Alloc_Mem(140);
+   assert(ptr[2] != NULL);
+
+   ptr[3] = Alloc_Mem(100);
+   assert(ptr[3] != NULL);
+
+   ptr[4] = Alloc_Mem(36);
+   assert(ptr[4] != NULL);
+
+   ptr[5] = Alloc_Mem(100);
+   assert(ptr[5] != NULL);
+
+   ptr[6] = Alloc_Mem(600);
+   assert(ptr[6] != NULL);
+
+   // free blocks of 184, 144 (same class) and 40 (lower class)
+   assert(Free_Mem(ptr[0]) == 0);
+   assert(Free_Mem(ptr[2]) == 0);
+   assert(Free_Mem(ptr[4]) == 0);
+
+   // best fit is in the same class as the request
+   test = Alloc_Mem(130);
+   assert(test == ptr[2]);
+
+   // own class has nothing big enough, next class up wins over the tail
+   test = Alloc_Mem(150);
+   assert(test == ptr[0]);
+
+   // the 24 byte remainder of that split is too small, 40 is the best fit
+   test = Alloc_Mem(30);
+   assert(test == ptr[4]);
+
+   exit(0);
+}
@@ -0,0 +1,35 @@
+/* a heap and a block larger than 2 GiB in a 64-bit build */
+#include <assert.h>
+#include <stdlib.h>
+#include "mem.h"
+
+#define GIB ((size_t)1 << 30)
+
+int main() {
+   if (sizeof(size_t) < 8) { // a 32-bit build can't address that much
+      exit(0);
+   }
+   assert(Init_Mem(3 * GIB) == 0);
+
+   // the pages are only touched at both ends of the block
+   char* big = Alloc_Mem(2 * GIB + GIB / 2);
+   assert(big != NULL);
+   big[0] = 1;
+   big[2 * GIB + GIB / 2 - 1] = 2;
+
+   char* small = Alloc_Mem(100);
+   assert(small != NULL);
+   assert(small > big + 2 * GIB);
+   assert(Alloc_Mem(GIB) == NULL);
+
+   assert(Free_Mem(big) == 0);
+   assert(Free_Mem(small) == 0);
+   // everything coalesced back into one block
+   big = Alloc_Mem(3 * GIB - 64);
+   assert(big != NULL);
+   assert(Free_Mem(big) == 0);
+
+   // a negative int is not taken for a huge size
+   assert(Alloc_Mem(-1) == NULL);
+   exit(0);
+}
@@ -0,0 +1,63 @@
+/* Calloc_Mem zeroes reused memory but leaves fresh and purged pages alone */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "mem.h"
+
+#define BIG (8 << 20)
+
+/* resident pages of the process */
+static long rss_pages() {
+   long size, resident;
+   FILE* f = fopen("/proc/self/statm", "r");
+   assert(f != NULL);
+   assert(fscanf(f, "%ld %ld", &size, &resident) == 2);
+   fclose(f);
+   return resident;
+}
+
+static void check_zero(char* ptr, size_t len) {
+   for (size_t i = 0; i < len; i++) {
+      assert(ptr[i] == 0);
+   }
+}
+
+int main() {
+   assert(Init_Mem(4 * BIG) == 0);
+   long pages = BIG / getpagesize();
+
+   // fresh memory is not touched
+   long before = rss_pages();
+   char* ptr = Calloc_Mem(BIG / 16, 16);
+   assert(ptr != NULL);
+   assert(rss_pages() - before < pages / 4);
+   check_zero(ptr, BIG);
+
+   // reused memory is cleared
+   char* small = Alloc_Mem(100);
+   memset(small, 0xff, 100);
+   memset(ptr, 0xff, BIG);
+   assert(Free_Mem(small) == 0);
+   assert(Free_Mem(ptr) == 0);
+   small = Calloc_Mem(10, 10);
+   check_zero(small, 100);
+   ptr = Calloc_Mem(1, BIG);
+   assert(ptr != NULL);
+   check_zero(ptr, BIG);
+
+   // pages given back with MADV_DONTNEED are zero without a memset
+   memset(ptr, 0xff, BIG);
+   assert(Free_Mem(ptr) == 0);
+   assert(Heap_Purge(NULL) >= BIG - 2 * getpagesize());
+   before = rss_pages();
+   ptr = Calloc_Mem(1, BIG);
+   assert(ptr != NULL);
+   assert(rss_pages() - before < pages / 4);
+   check_zero(ptr, BIG);
+
+   // overflow of nmemb * size
+   assert(Calloc_Mem((size_t)-1 / 2, 4) == NULL);
+   exit(0);
+}
@@ -0,0 +1,104 @@
+/* Frees after a thread's exit hook are still counted, traced and returned */
+#include <assert.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/stat.h>
+#include "mem.h"
+
+#define THREADS 4
+
+static pthread_key_t late_key, last_key;
+static int calls = 0; //of Alloc_Mem and Free_Mem, all threads
+static __thread int rounds;
+
+// registered after libmem's own key, so it runs after the exit hook in
+// every round, the last one included
+static void late_free(void* ptr) {
+   assert(Free_Mem(ptr) == 0);
+   __atomic_fetch_add(&calls, 1, __ATOMIC_RELAXED);
+   if (++rounds < PTHREAD_DESTRUCTOR_ITERATIONS) {
+      ptr = Alloc_Mem(32);
+      assert(ptr != NULL);
+      __atomic_fetch_add(&calls, 1, __ATOMIC_RELAXED);
+      assert(pthread_setspecific(late_key, ptr) == 0);
+   }
+}
+
+// frees only in the last round, when nothing runs the exit hook any more,
+// as the C library does when it tears a thread down
+static void last_free(void* ptr) {
+   if (++rounds < PTHREAD_DESTRUCTOR_ITERATIONS) {
+      assert(pthread_setspecific(last_key, ptr) == 0);
+      return;
+   }
+   assert(Free_Mem(ptr) == 0);
+   __atomic_fetch_add(&calls, 1, __ATOMIC_RELAXED);
+}
+
+static void* worker(void* arg) {
+   void* ptr = Alloc_Mem(32);
+   (void)arg;
+   assert(ptr != NULL);
+   __atomic_fetch_add(&calls, 1, __ATOMIC_RELAXED);
+   assert(pthread_setspecific(late_key, ptr) == 0);
+   return NULL;
+}
+
+static void* idle(void* arg) {
+   assert(pthread_setspecific(last_key, arg) == 0);
+   return NULL;
+}
+
+int main() {
+   mem_stats before, after;
+   struct stat st;
+   FILE* f = tmpfile();
+   assert(f != NULL);
+
+   assert(Init_Mem(1 << 20) == 0);
+   void* ptr = Alloc_Mem(100); //makes libmem's key first, too big to cache
+   assert(ptr != NULL);
+   assert(Free_Mem(ptr) == 0);
+   assert(pthread_key_create(&late_key, late_free) == 0);
+   assert(pthread_key_create(&last_key, last_free) == 0);
+   assert(Get_Mem_Stats(&before) == 0);
+   assert(Trace_Mem_Start(fileno(f)) == 0);
+
+   // one after the other, so each reuses the last one's stack and TLS
+   for (int i = 0; i < THREADS; i++) {
+      pthread_t t;
+      assert(pthread_create(&t, NULL, worker, NULL) == 0);
+      assert(pthread_join(t, NULL) == 0);
+   }
+   // these never allocate, their first call comes after the exit hook
+   for (int i = 0; i < THREADS; i++) {
+      pthread_t t;
+      ptr = Alloc_Mem(32);
+      assert(ptr != NULL);
+      calls++;
+      assert(pthread_create(&t, NULL, idle, ptr) == 0);
+      assert(pthread_join(t, NULL) == 0);
+   }
+   assert(Trace_Mem_Stop() == 0);
+   assert(Get_Mem_Stats(&after) == 0);
+
+   assert(calls > 3 * THREADS);
+   assert(after.allocs + after.frees == before.allocs + before.frees + calls);
+   assert(after.allocs - before.allocs == after.frees - before.frees);
+   assert(after.free_bytes == before.free_bytes); //no block left cached
+   assert(fstat(fileno(f), &st) == 0);
+   assert(st.st_size ==
+          (off_t)(sizeof(mem_trace_hdr) + calls * sizeof(mem_trace_rec)));
+
+   // a thread keeps its id after the exit hook, main and each thread have one
+   mem_trace_rec rec;
+   int threads = 0;
+   assert(fseek(f, sizeof(mem_trace_hdr), SEEK_SET) == 0);
+   while (fread(&rec, sizeof(rec), 1, f) == 1) {
+      threads = (rec.thread >= threads) ? rec.thread + 1 : threads;
+   }
+   assert(threads == 2 * THREADS + 1);
+   exit(0);
+}
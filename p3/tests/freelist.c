@@ -0,0 +1,56 @@
+/* check first fit on one free list in address order and in LIFO order */
+#include <assert.h>
+#include <stdlib.h>
+#include "mem.h"
+
+/* Runs the same frees and allocations on a heap with the given policy */
+static void check(int policy) {
+   mem_opts opts = { policy };
+   mem_heap* h = Heap_Create(4096, &opts);
+   assert(h != NULL);
+   void * ptr[7];
+   void * test;
+
+   for (int i = 0; i < 7; i++) {
+      ptr[i] = Heap_Alloc(h, 200);
+      assert(ptr[i] != NULL);
+   }
+
+   // holes at 1, 3 and 5, freed out of address order
+   assert(Heap_Free(h, ptr[3]) == 0);
+   assert(Heap_Free(h, ptr[1]) == 0);
+   assert(Heap_Free(h, ptr[5]) == 0);
+
+   // first fit takes the lowest hole, or the one freed last
+   test = Heap_Alloc(h, 100);
+   assert(test == ((policy == MEM_POLICY_ADDR) ? ptr[1] : ptr[5]));
+   assert(Heap_Free(h, test) == 0);
+
+   // a hole too small is skipped, the big free block at the end fits
+   test = Heap_Alloc(h, 1000);
+   assert(test != NULL && test > ptr[6]);
+   assert(Heap_Free(h, test) == 0);
+
+   // freeing 2 merges 1, 2 and 3 into one hole in place of 1
+   assert(Heap_Free(h, ptr[2]) == 0);
+   test = Heap_Alloc(h, 600);
+   assert(test == ptr[1]);
+
+   // everything coalesces back into one block
+   assert(Heap_Free(h, test) == 0);
+   assert(Heap_Free(h, ptr[0]) == 0);
+   assert(Heap_Free(h, ptr[4]) == 0);
+   assert(Heap_Free(h, ptr[6]) == 0);
+   assert(Heap_Alloc(h, 4000) == ptr[0]);
+   assert(Heap_Destroy(h) == 0);
+}
+
+int main() {
+   mem_opts bad = { 4 };
+   assert(Heap_Create(4096, &bad) == NULL);
+
+   check(MEM_POLICY_ADDR);
+   check(MEM_POLICY_LIFO);
+
+   exit(0);
+}
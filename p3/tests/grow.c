@@ -0,0 +1,42 @@
+/* a growable heap maps more chunks instead of running out */
+#include <assert.h>
+#include <stdlib.h>
+#include "mem.h"
+
+#define BLOCKS 500
+
+int main() {
+   mem_opts opts = { 0 };
+   opts.grow_chunk = 8192;
+   opts.grow_pct = 150;
+   assert(Init_Mem_Opts(4096, &opts) == 0);
+   int* ptr[BLOCKS];
+
+   // far more than the first 4096 bytes
+   for (int i = 0; i < BLOCKS; i++) {
+      ptr[i] = (int*) Alloc_Mem(1000);
+      assert(ptr[i] != NULL);
+      *ptr[i] = i;
+   }
+   // a request bigger than any chunk so far gets a chunk of its own size
+   void* big = Alloc_Mem(1 << 20);
+   assert(big != NULL);
+
+   for (int i = 0; i < BLOCKS; i++) {
+      assert(*ptr[i] == i);
+      assert(Free_Mem(ptr[i]) == 0);
+   }
+   assert(Free_Mem(big) == 0);
+
+   // a Heap_Create heap grows the same way and drops all chunks at once
+   mem_heap* h = Heap_Create(4096, &opts);
+   assert(h != NULL);
+   for (int i = 0; i < BLOCKS; i++) {
+      ptr[i] = (int*) Heap_Alloc(h, 1000);
+      assert(ptr[i] != NULL);
+   }
+   assert(Heap_Free(h, ptr[BLOCKS - 1]) == 0);
+   assert(Heap_Destroy(h) == 0);
+
+   exit(0);
+}
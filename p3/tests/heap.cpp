@@ -0,0 +1,84 @@
+/* mem::Heap picks blocks and coalesces as its policies say */
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include "../heap.hpp"
+
+/* Leaves holes of 300 and 150 bytes, the 300 one first on the free list */
+template <class H>
+static void holes(H& heap, void* ptr[5]) {
+   int sizes[5] = { 100, 300, 100, 150, 100 };
+   for (int i = 0; i < 5; i++) {
+      ptr[i] = heap.alloc(sizes[i]);
+      assert(ptr[i] != NULL);
+      assert((uintptr_t)ptr[i] % (2 * sizeof(size_t)) == 0);
+   }
+   assert(heap.free(ptr[3]) == 0);
+   assert(heap.free(ptr[1]) == 0);
+}
+
+template <class Layout>
+static void check_fit() {
+   void* ptr[5];
+   {
+      mem::Heap<mem::FirstFit, mem::Immediate, Layout> heap(1 << 16);
+      holes(heap, ptr);
+      assert(heap.alloc(120) == ptr[1]);
+   }
+   {
+      mem::Heap<mem::BestFit, mem::Immediate, Layout> heap(1 << 16);
+      holes(heap, ptr);
+      assert(heap.alloc(120) == ptr[3]);
+   }
+   {
+      // the rest of the 300 byte hole goes to the head of the list, but the
+      // search goes on after where the last one stopped
+      mem::Heap<mem::NextFit, mem::Immediate, Layout> heap(1 << 16);
+      holes(heap, ptr);
+      assert(heap.alloc(120) == ptr[1]);
+      assert(heap.alloc(120) == ptr[3]);
+   }
+   {
+      mem::Heap<mem::FirstFit, mem::Immediate, Layout> heap(1 << 16);
+      holes(heap, ptr);
+      assert(heap.alloc(120) == ptr[1]);
+      assert(heap.alloc(120) != ptr[3]);
+   }
+}
+
+template <class Coalesce, class Layout>
+static void check_coalesce(bool eager) {
+   static void* ptr[1024];
+   int n = 0;
+   mem::Heap<mem::FirstFit, Coalesce, Layout> heap(8192);
+
+   while ((ptr[n] = heap.alloc(100)) != NULL) { //fill the heap
+      n++;
+   }
+   assert(heap.free(ptr[0]) == 0);
+   assert(heap.free(ptr[0]) == -1);
+   assert(heap.free((char*)ptr[1] + 1) == -1);
+   assert(heap.free(NULL) == -1);
+   for (int i = n - 1; i > 0; i -= 2) { //every other block first
+      assert(heap.free(ptr[i]) == 0);
+   }
+   for (int i = n - 2; i > 0; i -= 2) {
+      assert(heap.free(ptr[i]) == 0);
+   }
+
+   // merged right away, or only when a request finds nothing
+   size_t free_bytes = heap.free_bytes();
+   assert((heap.largest_free() > 4096) == eager);
+   assert(heap.alloc(4096) == ptr[0]);
+   assert(heap.free_bytes() <= free_bytes - 4096);
+}
+
+int main() {
+   check_fit<mem::BoundaryTag>();
+   check_fit<mem::FullTag>();
+   check_coalesce<mem::Immediate, mem::BoundaryTag>(true);
+   check_coalesce<mem::Immediate, mem::FullTag>(true);
+   check_coalesce<mem::Deferred, mem::BoundaryTag>(false);
+   check_coalesce<mem::Deferred, mem::FullTag>(false);
+   exit(0);
+}
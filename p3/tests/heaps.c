@@ -0,0 +1,45 @@
+/* independent heaps next to the default heap */
+#include <assert.h>
+#include <stdlib.h>
+#include "mem.h"
+
+int main() {
+   assert(Init_Mem(4096) == 0);
+   mem_heap* a = Heap_Create(4096, NULL);
+   mem_heap* b = Heap_Create(4096, NULL);
+   assert(a != NULL && b != NULL && a != b);
+
+   // each heap has room for a block of nearly its whole region
+   void* pa = Heap_Alloc(a, 4000);
+   void* pb = Heap_Alloc(b, 4000);
+   void* pd = Alloc_Mem(4000);
+   assert(pa != NULL && pb != NULL && pd != NULL);
+
+   // a block can only be freed in the heap it came from
+   assert(Heap_Free(b, pa) == -1);
+   assert(Free_Mem(pa) == -1);
+   assert(Heap_Free(a, pd) == -1);
+   assert(Heap_Free(a, pa) == 0);
+   assert(Heap_Free(a, pa) == -1);
+   assert(Heap_Free(NULL, pd) == 0);
+
+   // dropping a heap releases everything in it at once
+   assert(Heap_Destroy(a) == 0);
+   assert(Heap_Destroy(NULL) == -1);
+   for (int i = 0; i < 1000; i++) {
+      a = Heap_Create(65536, NULL);
+      assert(a != NULL);
+      for (int j = 0; j < 100; j++) {
+         assert(Heap_Alloc(a, 100) != NULL);
+      }
+      assert(Heap_Destroy(a) == 0);
+   }
+
+   // the other heaps are untouched
+   assert(Heap_Free(b, pb) == 0);
+   assert(Heap_Alloc(b, 4000) == pb);
+   assert(Alloc_Mem(4000) == pd);
+   assert(Heap_Destroy(b) == 0);
+
+   exit(0);
+}
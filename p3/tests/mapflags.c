@@ -0,0 +1,63 @@
+/* Init_Mem_Opts maps the region prefaulted, locked or with huge pages */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "mem.h"
+
+#define REGION (8 << 20)
+
+/* resident pages of the process */
+static long rss_pages() {
+   long size, resident;
+   FILE* f = fopen("/proc/self/statm", "r");
+   assert(f != NULL);
+   assert(fscanf(f, "%ld %ld", &size, &resident) == 2);
+   fclose(f);
+   return resident;
+}
+
+int main() {
+   mem_opts opts = { 0 };
+   long pages = REGION / getpagesize();
+
+   // unknown flags
+   opts.map_flags = 16;
+   assert(Init_Mem_Opts(REGION, &opts) == -1);
+
+   // every page is resident before anything is allocated
+   opts.map_flags = MEM_MAP_POPULATE;
+   long before = rss_pages();
+   assert(Init_Mem_Opts(REGION, &opts) == 0);
+   assert(rss_pages() - before >= pages);
+   char* ptr = Alloc_Mem(REGION / 2);
+   assert(ptr != NULL);
+   memset(ptr, 'a', REGION / 2);
+   assert(Free_Mem(ptr) == 0);
+
+   // huge pages fall back to transparent ones where none are reserved
+   opts.map_flags = MEM_MAP_HUGETLB | MEM_MAP_POPULATE;
+   mem_heap* heap = Heap_Create(REGION, &opts);
+   assert(heap != NULL);
+   ptr = Heap_Alloc(heap, REGION - 4096);
+   assert(ptr != NULL);
+   memset(ptr, 'b', REGION - 4096);
+   assert(Heap_Free(heap, ptr) == 0);
+   assert(Heap_Destroy(heap) == 0);
+
+   // locked pages are not purged, a growing heap locks its new chunks too
+   opts.map_flags = MEM_MAP_LOCK;
+   opts.purge_threshold = 4096;
+   opts.grow_chunk = 65536;
+   heap = Heap_Create(65536, &opts);
+   assert(heap != NULL);
+   ptr = Heap_Alloc(heap, 100000);
+   assert(ptr != NULL);
+   memset(ptr, 'c', 100000);
+   assert(Heap_Free(heap, ptr) == 0);
+   assert(Heap_Purge(heap) == 0);
+   assert(Heap_Destroy(heap) == 0);
+
+   exit(0);
+}
@@ -0,0 +1,75 @@
+/* Requests above mmap_threshold get a mapping of their own */
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mem.h"
+
+#define REGION (1 << 20)
+
+int main() {
+   mem_opts opts = { 0 };
+   opts.mmap_threshold = 128 << 10;
+   assert(Init_Mem_Opts(REGION, &opts) == 0);
+   char * ptr[3];
+
+   // none of the region is used, all of it is still there
+   ptr[0] = Alloc_Mem(600 << 10);
+   assert(ptr[0] != NULL);
+   memset(ptr[0], 'a', 600 << 10);
+   ptr[1] = Alloc_Mem(REGION - 4096);
+   assert(ptr[1] != NULL);
+   assert(ptr[0] < ptr[1] || ptr[0] >= ptr[1] + REGION);
+   assert(Free_Mem(ptr[1]) == 0);
+
+   // growing moves the pages, not the data
+   ptr[0] = Realloc_Mem(ptr[0], 8 << 20);
+   assert(ptr[0] != NULL);
+   assert(ptr[0][0] == 'a' && ptr[0][(600 << 10) - 1] == 'a');
+   memset(ptr[0], 'b', 8 << 20);
+   ptr[0] = Realloc_Mem(ptr[0], 1000);
+   assert(ptr[0] != NULL);
+   assert(ptr[0][999] == 'b');
+   assert(Free_Mem(ptr[0]) == 0);
+
+   // a small block grown past the threshold moves to a mapping of its own
+   ptr[0] = Alloc_Mem(100);
+   memset(ptr[0], 'c', 100);
+   ptr[0] = Realloc_Mem(ptr[0], REGION * 2);
+   assert(ptr[0] != NULL);
+   assert(ptr[0][99] == 'c');
+   assert(Free_Mem(ptr[0]) == 0);
+
+   // zeroed and aligned
+   ptr[0] = Calloc_Mem(1, 256 << 10);
+   assert(ptr[0] != NULL);
+   for (int i = 0; i < (256 << 10); i++) {
+      assert(ptr[0][i] == 0);
+   }
+   ptr[1] = Alloc_Mem_Aligned(256 << 10, 65536);
+   assert(ptr[1] != NULL);
+   assert((uintptr_t)ptr[1] % 65536 == 0);
+   ptr[1][0] = 1;
+   assert(Free_Mem(ptr[1]) == 0);
+   assert(Free_Mem(ptr[0]) == 0);
+
+   // freed twice, the second time the pages are gone
+   assert(Free_Mem(ptr[0]) == -1);
+   assert(Usable_Size_Mem(ptr[0]) == 0);
+   assert(Realloc_Mem(ptr[0], 1 << 20) == NULL);
+
+   // a heap of its own unmaps its mapped blocks when destroyed
+   mem_heap * heap = Heap_Create(65536, &opts);
+   assert(heap != NULL);
+   ptr[0] = Heap_Alloc(heap, 1 << 20);
+   ptr[1] = Heap_Alloc(heap, 2 << 20);
+   ptr[2] = Heap_Alloc(heap, 3 << 20);
+   assert(ptr[0] != NULL && ptr[1] != NULL && ptr[2] != NULL);
+   assert(Heap_Free(heap, ptr[1]) == 0);
+   assert(Heap_Free(heap, ptr[1]) == -1);
+   ptr[2] = Heap_Realloc(heap, ptr[2], 4 << 20);
+   assert(ptr[2] != NULL);
+   assert(Heap_Destroy(heap) == 0);
+
+   exit(0);
+}
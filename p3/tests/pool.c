@@ -0,0 +1,59 @@
+/* Pool_Alloc and Pool_Free hand out objects of one size from chunks */
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mem.h"
+
+#define REGION (1 << 20)
+#define COUNT 5000
+
+static char* obj[COUNT];
+
+int main() {
+   assert(Init_Mem(REGION) == 0);
+   assert(Pool_Create(0, 8) == NULL);
+   assert(Pool_Create(24, 3) == NULL);
+
+   mem_pool* pool = Pool_Create(24, 0);
+   assert(pool != NULL);
+   for (int i = 0; i < COUNT; i++) {
+      obj[i] = Pool_Alloc(pool);
+      assert(obj[i] != NULL);
+      memset(obj[i], i, 24);
+   }
+   for (int i = 0; i < COUNT; i++) {
+      assert(obj[i][0] == (char)i && obj[i][23] == (char)i);
+   }
+   assert(obj[1] - obj[0] == 32); // rounded up to the alignment
+
+   // a freed object is the next one handed out
+   assert(Pool_Free(pool, obj[10]) == 0);
+   assert(Pool_Alloc(pool) == obj[10]);
+   assert(Pool_Free(pool, obj[10] + 1) == -1);
+   assert(Pool_Free(NULL, obj[10]) == -1);
+
+   // chunks go back to the heap once they are empty
+   for (int i = 0; i < COUNT; i++) {
+      assert(Pool_Free(pool, obj[i]) == 0);
+   }
+   char* big = Alloc_Mem(REGION / 4 * 3);
+   assert(big != NULL);
+   assert(Free_Mem(big) == 0);
+
+   // aligned objects, and a pool freed with objects still in it
+   mem_pool* aligned = Pool_Create(100, 256);
+   assert(aligned != NULL);
+   for (int i = 0; i < 100; i++) {
+      obj[i] = Pool_Alloc(aligned);
+      assert(obj[i] != NULL && (uintptr_t)obj[i] % 256 == 0);
+   }
+   assert(Pool_Free(pool, obj[0]) == -1); // not from this pool
+   assert(Pool_Destroy(aligned) == 0);
+   assert(Pool_Destroy(pool) == 0);
+
+   big = Alloc_Mem(REGION - 4096);
+   assert(big != NULL);
+
+   exit(0);
+}
@@ -0,0 +1,113 @@
+/* libmemmalloc.so stands in for malloc and friends with LD_PRELOAD */
+#define _GNU_SOURCE // aligned_alloc
+#include <assert.h>
+#include <errno.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+static int stop = 0;
+
+/* keeps the heap lock busy while main forks */
+static void* churn(void* arg) {
+   (void)arg;
+   while (!__atomic_load_n(&stop, __ATOMIC_RELAXED)) {
+      free(malloc(1000));
+   }
+   return NULL;
+}
+
+/* returns 1 if libmemmalloc.so is mapped into the process */
+static int preloaded() {
+   char line[512];
+   int found = 0;
+   FILE* f = fopen("/proc/self/maps", "r");
+   assert(f != NULL);
+   while (!found && fgets(line, sizeof(line), f) != NULL) {
+      found = strstr(line, "libmemmalloc.so") != NULL;
+   }
+   fclose(f);
+   return found;
+}
+
+int main(int argc, char* argv[]) {
+   if (getenv("LD_PRELOAD") == NULL) { // run again on top of libmem
+      setenv("LD_PRELOAD", "../libmemmalloc.so", 1);
+      execv(argv[0], argv);
+      assert(0);
+   }
+   assert(preloaded());
+
+   char* ptr = malloc(100);
+   assert(ptr != NULL && (uintptr_t)ptr % sizeof(void*) == 0);
+   assert(malloc_usable_size(ptr) >= 100);
+   memset(ptr, 'a', 100);
+   ptr = realloc(ptr, 100000);
+   assert(ptr != NULL && ptr[99] == 'a');
+   free(ptr);
+
+   ptr = malloc(0);
+   assert(ptr != NULL);
+   free(ptr);
+   free(NULL);
+
+   int* array = calloc(1000, sizeof(int));
+   assert(array != NULL);
+   for (int i = 0; i < 1000; i++) {
+      assert(array[i] == 0);
+   }
+   free(array);
+   volatile size_t huge = SIZE_MAX / 2;
+   assert(calloc(huge, 4) == NULL);
+
+   void* aligned;
+   assert(posix_memalign(&aligned, 4096, 5000) == 0);
+   assert((uintptr_t)aligned % 4096 == 0);
+   free(aligned);
+   assert(posix_memalign(&aligned, 3, 10) == EINVAL);
+   aligned = aligned_alloc(64, 640);
+   assert(aligned != NULL && (uintptr_t)aligned % 64 == 0);
+   free(aligned);
+   aligned = pvalloc(100);
+   assert(aligned != NULL && (uintptr_t)aligned % getpagesize() == 0);
+   assert(malloc_usable_size(aligned) >= (size_t)getpagesize());
+   free(aligned);
+
+   // large blocks get a mapping of their own and are resized in place
+   ptr = malloc(1 << 20);
+   assert(ptr != NULL);
+   ptr[0] = 'b';
+   ptr = realloc(ptr, 16 << 20);
+   assert(ptr != NULL && ptr[0] == 'b');
+   free(ptr);
+
+   // stdio allocates its buffers with malloc
+   char buf[64];
+   snprintf(buf, sizeof(buf), "%d", 354);
+   assert(strcmp(buf, "354") == 0);
+
+   // the child of a fork can allocate whatever the other threads were doing
+   pthread_t tid;
+   assert(pthread_create(&tid, NULL, churn, NULL) == 0);
+   for (int i = 0; i < 200; i++) {
+      int status;
+      pid_t pid = fork();
+      assert(pid >= 0);
+      if (pid == 0) {
+         alarm(5); //a lock left held would hang the child
+         free(malloc(1000));
+         _exit(0);
+      }
+      assert(waitpid(pid, &status, 0) == pid);
+      assert(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+   }
+   __atomic_store_n(&stop, 1, __ATOMIC_RELAXED);
+   assert(pthread_join(tid, NULL) == 0);
+
+   exit(0);
+}
@@ -0,0 +1,67 @@
+/* large free blocks give their pages back to the OS after a while */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "mem.h"
+
+#define BIG (1 << 20)
+
+int main() {
+   mem_opts opts = { 0 };
+   opts.purge_threshold = 64 * 1024;
+   opts.purge_decay_ms = 50;
+   mem_heap* h = Heap_Create(4 * BIG, &opts);
+   assert(h != NULL);
+   long long purged, refaulted;
+
+   char* guard = Heap_Alloc(h, 100);
+   char* big = Heap_Alloc(h, BIG);
+   char* guard2 = Heap_Alloc(h, 100);
+   assert(guard != NULL && big != NULL && guard2 != NULL);
+   memset(big, 0xab, BIG);
+   assert(Heap_Free(h, big) == 0);
+
+   // still young, nothing is purged yet
+   assert(Heap_Free(h, Heap_Alloc(h, 100)) == 0);
+   Heap_Purge_Stats(h, &purged, &refaulted);
+   assert(purged == 0 && refaulted == 0);
+
+   // once it has decayed the next lock purges it, the pages read back as zero
+   usleep(200 * 1000);
+   assert(Heap_Free(h, Heap_Alloc(h, 100)) == 0);
+   Heap_Purge_Stats(h, &purged, &refaulted);
+   assert(purged >= BIG - 2 * getpagesize());
+   assert(big[BIG / 2] == 0);
+
+   // allocating it again faults the pages back in
+   big = Heap_Alloc(h, BIG);
+   assert(big != NULL);
+   Heap_Purge_Stats(h, NULL, &refaulted);
+   assert(refaulted > 0 && refaulted <= purged);
+   memset(big, 0xcd, BIG);
+   assert(Heap_Free(h, big) == 0);
+
+   // Heap_Purge does not wait for the decay
+   long now = Heap_Purge(h);
+   assert(now > 0);
+   Heap_Purge_Stats(h, &purged, NULL);
+   assert(purged >= now);
+   assert(Heap_Free(h, guard) == 0);
+   assert(Heap_Free(h, guard2) == 0);
+   assert(Heap_Destroy(h) == 0);
+
+   // the default heap purges with MADV_FREE too
+   opts.purge_mode = MEM_PURGE_FREE;
+   assert(Init_Mem_Opts(4 * BIG, &opts) == 0);
+   big = Alloc_Mem(BIG);
+   assert(big != NULL);
+   memset(big, 0xab, BIG);
+   assert(Free_Mem(big) == 0);
+   assert(Heap_Purge(NULL) > 0);
+   assert(Alloc_Mem(BIG) != NULL);
+   Heap_Purge_Stats(NULL, &purged, &refaulted);
+   assert(purged > 0 && refaulted > 0);
+
+   exit(0);
+}
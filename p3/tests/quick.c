@@ -0,0 +1,78 @@
+/* check that small frees wait on quick lists and are coalesced in batches */
+#include <assert.h>
+#include <stdlib.h>
+#include "mem.h"
+
+#define MANY 3000
+
+int main() {
+   mem_opts opts = { 0 };
+   opts.quick_max = 256;
+   mem_heap* h = Heap_Create(8192, &opts);
+   mem_heap* eager = Heap_Create(8192, NULL);
+   assert(h != NULL && eager != NULL);
+   void * ptr[4];
+   void * test;
+
+   for (int i = 0; i < 4; i++) {
+      ptr[i] = Heap_Alloc(h, 100);
+      assert(ptr[i] != NULL);
+   }
+
+   // a request of the same size takes the block freed last right back
+   assert(Heap_Free(h, ptr[2]) == 0);
+   assert(Heap_Free(h, ptr[1]) == 0);
+   assert(Heap_Alloc(h, 100) == ptr[1]);
+   assert(Heap_Alloc(h, 100) == ptr[2]);
+
+   // neighbours freed one after the other are not merged
+   assert(Heap_Free(h, ptr[0]) == 0);
+   assert(Heap_Free(h, ptr[1]) == 0);
+   assert(Heap_Free(h, ptr[1]) == -1);
+   test = Heap_Alloc(h, 200);
+   assert(test > ptr[3]);
+   assert(Heap_Free(h, test) == 0);
+
+   // while a heap without quick lists merges them at once
+   void * e0 = Heap_Alloc(eager, 100);
+   void * e1 = Heap_Alloc(eager, 100);
+   assert(Heap_Alloc(eager, 100) != NULL);
+   assert(Heap_Free(eager, e0) == 0);
+   assert(Heap_Free(eager, e1) == 0);
+   assert(Heap_Alloc(eager, 200) == e0);
+
+   assert(Heap_Destroy(h) == 0);
+   assert(Heap_Destroy(eager) == 0);
+
+   // a request nothing fits coalesces everything that waits
+   static void * many[MANY];
+   int n = 0;
+   h = Heap_Create(8192, &opts);
+   assert(h != NULL);
+   while ((many[n] = Heap_Alloc(h, 100)) != NULL) { //fill the heap
+      n++;
+   }
+   for (int i = 0; i < n; i++) {
+      assert(Heap_Free(h, many[i]) == 0);
+   }
+   test = Heap_Alloc(h, 1000);
+   assert(test == many[0]);
+   assert(Heap_Free(h, test) == 0);
+   assert(Heap_Destroy(h) == 0);
+
+   // past 256 KiB the waiting blocks are coalesced, the big hole they
+   // leave is a better fit than the rest of the heap
+   h = Heap_Create(1 << 20, &opts);
+   assert(h != NULL);
+   for (int i = 0; i < MANY; i++) {
+      many[i] = Heap_Alloc(h, 100);
+      assert(many[i] != NULL);
+   }
+   for (int i = 0; i < MANY; i++) {
+      assert(Heap_Free(h, many[i]) == 0);
+   }
+   assert(Heap_Alloc(h, 200) == many[0]);
+   assert(Heap_Destroy(h) == 0);
+
+   exit(0);
+}
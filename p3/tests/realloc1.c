@@ -0,0 +1,41 @@
+/* Realloc_Mem grows a block in place into the free block after it */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mem.h"
+
+int main() {
+   assert(Init_Mem(4096) == 0);
+   char * ptr[3];
+   char * test;
+
+   ptr[0] = Alloc_Mem(100);
+   assert(ptr[0] != NULL);
+
+   ptr[1] = Alloc_Mem(300);
+   assert(ptr[1] != NULL);
+
+   ptr[2] = Alloc_Mem(100);
+   assert(ptr[2] != NULL);
+
+   while (Alloc_Mem(800) != NULL)
+     ;
+
+   memset(ptr[0], 'a', 100);
+   assert(Free_Mem(ptr[1]) == 0);
+
+   // the free block after ptr[0] is big enough, so it stays put
+   test = Realloc_Mem(ptr[0], 300);
+   assert(test == ptr[0]);
+   assert(test[0] == 'a' && test[99] == 'a');
+
+   // what was left of the free block is still there
+   test = Alloc_Mem(50);
+   assert(test > ptr[0] && test < ptr[2]);
+
+   // now the next block is busy and there is no room anywhere else
+   assert(Realloc_Mem(ptr[0], 2000) == NULL);
+   assert(ptr[0][99] == 'a');
+
+   exit(0);
+}
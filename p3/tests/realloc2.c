@@ -0,0 +1,43 @@
+/* Realloc_Mem shrinks a block in place and the tail coalesces with the next free block */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mem.h"
+
+int main() {
+   assert(Init_Mem(4096) == 0);
+   char * ptr[4];
+   char * test;
+
+   ptr[0] = Alloc_Mem(800);
+   assert(ptr[0] != NULL);
+
+   ptr[1] = Alloc_Mem(800);
+   assert(ptr[1] != NULL);
+
+   ptr[2] = Alloc_Mem(800);
+   assert(ptr[2] != NULL);
+
+   ptr[3] = Alloc_Mem(800);
+   assert(ptr[3] != NULL);
+
+   while (Alloc_Mem(800) != NULL)
+     ;
+
+   // shrinking with a busy next block leaves a free tail behind
+   memset(ptr[0], 'a', 800);
+   test = Realloc_Mem(ptr[0], 100);
+   assert(test == ptr[0]);
+   assert(test[0] == 'a' && test[99] == 'a');
+   test = Alloc_Mem(600);
+   assert(test > ptr[0] && test < ptr[1]);
+
+   // the tail of ptr[1] coalesces with the free ptr[2]
+   assert(Free_Mem(ptr[2]) == 0);
+   test = Realloc_Mem(ptr[1], 100);
+   assert(test == ptr[1]);
+   test = Alloc_Mem(1400);
+   assert(test > ptr[1] && test < ptr[3]);
+
+   exit(0);
+}
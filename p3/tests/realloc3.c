@@ -0,0 +1,48 @@
+/* Realloc_Mem moves a block it can't grow in place, and its corner cases */
+#include <assert.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mem.h"
+
+int main() {
+   assert(Init_Mem(4096) == 0);
+   char * ptr[3];
+   char * test;
+
+   // NULL allocates
+   ptr[0] = Realloc_Mem(NULL, 100);
+   assert(ptr[0] != NULL);
+
+   ptr[1] = Alloc_Mem(100);
+   assert(ptr[1] != NULL);
+
+   // the next block is busy, so the data moves
+   memset(ptr[0], 'a', 100);
+   test = Realloc_Mem(ptr[0], 500);
+   assert(test != NULL && test != ptr[0]);
+   assert(test[0] == 'a' && test[99] == 'a');
+   ptr[0] = test;
+
+   // too big for the heap, the block stays as it was
+   assert(Realloc_Mem(ptr[0], 8192) == NULL);
+   assert(ptr[0][99] == 'a');
+
+   // size 0 frees
+   assert(Realloc_Mem(ptr[1], 0) == NULL);
+
+   // not a block of ours
+   assert(Realloc_Mem(ptr[0] + 1, 10) == NULL);
+   assert(Realloc_Mem((char*)&test, 10) == NULL);
+
+   // the same for a heap of its own
+   mem_heap* h = Heap_Create(4096, NULL);
+   assert(h != NULL);
+   ptr[2] = Heap_Realloc(h, NULL, 100);
+   assert(ptr[2] != NULL);
+   assert(Heap_Realloc(h, ptr[2], 1000) == ptr[2]);
+   assert(Heap_Realloc(NULL, ptr[2], 10) == NULL);
+   assert(Heap_Realloc(h, ptr[2], 0) == NULL);
+   assert(Heap_Destroy(h) == 0);
+
+   exit(0);
+}
@@ -0,0 +1,52 @@
+/* blocks freed by a thread bound to another heap go back to their owner */
+#include <assert.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "mem.h"
+
+static void* ptr[3];
+static void* cached;
+
+static void* consumer(void* arg) {
+   // this thread is bound to the second heap, so these are remote frees
+   for (int i = 0; i < 3; i++) {
+      assert(Free_Mem(ptr[i]) == 0);
+   }
+   // still busy until the owner drains its queue, but freed all the same
+   assert(Free_Mem(ptr[1]) == -1);
+   // in the owner's cache, freed as well
+   assert(Free_Mem(cached) == -1);
+   return NULL;
+}
+
+int main() {
+   mem_opts opts = { MEM_POLICY_SEGLIST, 2 };
+   assert(Init_Mem_Opts(8192, &opts) == 0);
+   pthread_t tid;
+
+   // the first thread to allocate is bound to the first heap
+   for (int i = 0; i < 3; i++) {
+      ptr[i] = Alloc_Mem(1000);
+      assert(ptr[i] != NULL);
+   }
+
+   cached = Alloc_Mem(32);
+   assert(cached != NULL);
+   assert(Free_Mem(cached) == 0);
+
+   assert(pthread_create(&tid, NULL, consumer, NULL) == 0);
+   assert(pthread_join(tid, NULL) == 0);
+   assert(Free_Mem(ptr[2]) == -1); //the owner frees a queued block again
+
+   // handed out once only, though freed by both threads: the second
+   // allocation drains the queue
+   void* again[2] = { Alloc_Mem(32), Alloc_Mem(32) };
+   assert(again[0] == cached && again[1] != NULL && again[1] != cached);
+   assert(Free_Mem(again[0]) == 0 && Free_Mem(again[1]) == 0);
+
+   // the next allocation drains the queue and the blocks coalesce again
+   void* test = Alloc_Mem(4000);
+   assert(test == ptr[0]);
+
+   exit(0);
+}
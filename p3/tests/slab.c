@@ -0,0 +1,92 @@
+/* Small requests come from slabs, without a header per block */
+#include <assert.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include "mem.h"
+
+#define REGION (1 << 20)
+#define COUNT 40000
+
+static char* ptr[COUNT];
+
+int main() {
+   mem_opts opts = { 0 };
+   opts.slab = 1;
+   assert(Init_Mem_Opts(REGION, &opts) == 0);
+
+   // about eight bytes each, a block would take several times that
+   for (int i = 0; i < COUNT; i++) {
+      ptr[i] = Alloc_Mem(8);
+      assert(ptr[i] != NULL);
+      assert((uintptr_t)ptr[i] % 8 == 0);
+      memset(ptr[i], i, 8);
+   }
+   assert(ptr[1] - ptr[0] == 8);
+   for (int i = 0; i < COUNT; i++) {
+      assert(ptr[i][0] == (char)i && ptr[i][7] == (char)i);
+   }
+   assert(Usable_Size_Mem(ptr[0]) == 8);
+   for (int i = 0; i < COUNT; i++) {
+      assert(Free_Mem(ptr[i]) == 0);
+   }
+
+   // emptied slabs went back to the heap, but for one kept for reuse
+   char* big = Alloc_Mem(REGION / 2);
+   assert(big != NULL);
+   assert(Free_Mem(big) == 0);
+
+   // slots keep objects of their size aligned
+   ptr[0] = Alloc_Mem(48);
+   assert((uintptr_t)ptr[0] % 16 == 0);
+   assert(Usable_Size_Mem(ptr[0]) == 48);
+   ptr[1] = Alloc_Mem(20);
+   assert((uintptr_t)ptr[1] % 8 == 0);
+   assert(Usable_Size_Mem(ptr[1]) == 24);
+   ptr[2] = Alloc_Mem_Aligned(8, 64);
+   assert((uintptr_t)ptr[2] % 64 == 0);
+
+   // a slot stays put while the new size fits, then moves
+   memset(ptr[1], 'a', 20);
+   assert(Realloc_Mem(ptr[1], 24) == ptr[1]);
+   ptr[1] = Realloc_Mem(ptr[1], 1000);
+   assert(ptr[1] != NULL && ptr[1][19] == 'a');
+
+   // a reused slot is cleared
+   memset(ptr[0], 'b', 48);
+   assert(Free_Mem(ptr[0]) == 0);
+   ptr[0] = Calloc_Mem(6, 8);
+   for (int i = 0; i < 48; i++) {
+      assert(ptr[0][i] == 0);
+   }
+   for (int i = 0; i < 3; i++) {
+      assert(Free_Mem(ptr[i]) == 0);
+   }
+
+   // a slot freed twice or an address inside a slot is refused
+   ptr[0] = Alloc_Mem(16);
+   ptr[1] = Alloc_Mem(16);
+   assert(Free_Mem(ptr[0]) == 0);
+   assert(Free_Mem(ptr[0]) == -1);
+   assert(Free_Mem(ptr[1] + 8) == -1);
+   assert(Realloc_Mem(ptr[0], 1000) == NULL);
+   ptr[2] = Alloc_Mem(16);
+   ptr[3] = Alloc_Mem(16);
+   assert(ptr[2] == ptr[0] && ptr[3] != ptr[2]);
+   for (int i = 1; i < 4; i++) {
+      assert(Free_Mem(ptr[i]) == 0);
+   }
+
+   // heaps of their own have slabs too
+   mem_heap* heap = Heap_Create(65536, &opts);
+   assert(heap != NULL);
+   ptr[0] = Heap_Alloc(heap, 16);
+   ptr[1] = Heap_Alloc(heap, 16);
+   assert(ptr[1] - ptr[0] == 16);
+   assert(Heap_Free(heap, ptr[0]) == 0);
+   assert(Heap_Free(heap, ptr[0]) == -1);
+   assert(Heap_Free(heap, ptr[1]) == 0);
+   assert(Heap_Destroy(heap) == 0);
+
+   exit(0);
+}
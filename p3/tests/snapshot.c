@@ -0,0 +1,93 @@
+/* Snapshot_Mem writes every block once, in binary and in JSON */
+#include <assert.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "mem.h"
+
+int main() {
+   mem_stats s;
+   mem_snapshot_hdr hdr;
+   mem_snapshot_rec rec;
+   FILE* f = tmpfile();
+   assert(f != NULL);
+   int fd = fileno(f);
+
+   assert(Snapshot_Mem(fd, MEM_SNAPSHOT_BINARY) == -1); //before Init_Mem
+   assert(Init_Mem(1 << 20) == 0);
+   assert(Snapshot_Mem(fd, 2) == -1);
+   assert(Snapshot_Mem(-1, MEM_SNAPSHOT_BINARY) == -1);
+
+   void* ptr[8];
+   for (int i = 0; i < 8; i++) {
+      ptr[i] = Alloc_Mem(1000 * (i + 1));
+      assert(ptr[i] != NULL);
+   }
+   for (int i = 0; i < 8; i += 2) {
+      assert(Free_Mem(ptr[i]) == 0);
+   }
+   assert(Get_Mem_Stats(&s) == 0);
+
+   // the binary records add up to what Get_Mem_Stats counts
+   assert(Snapshot_Mem(fd, MEM_SNAPSHOT_BINARY) == 0);
+   rewind(f);
+   assert(fread(&hdr, sizeof(hdr), 1, f) == 1);
+   assert(strcmp(hdr.magic, MEM_SNAPSHOT_MAGIC) == 0);
+   assert(hdr.version == MEM_SNAPSHOT_VERSION);
+   assert(hdr.align == 2 * sizeof(size_t));
+
+   int chunks = 0, busy = 0, free_blocks = 0;
+   uint64_t chunk_size = 0, end = 0, free_bytes = 0, largest = 0;
+   while (fread(&rec, sizeof(rec), 1, f) == 1) {
+      uint64_t size = rec.size & ~(uint64_t)7;
+      if (rec.size & MEM_SNAPSHOT_CHUNK) {
+         assert(rec.offset == 0); //heap index
+         assert(end == chunk_size); //the blocks covered the last chunk
+         chunks++;
+         chunk_size = size;
+         end = 0;
+         continue;
+      }
+      assert(rec.offset == end);
+      assert(size % hdr.align == 0);
+      end += size;
+      if (rec.size & MEM_SNAPSHOT_BUSY) {
+         busy++;
+      } else {
+         free_blocks++;
+         free_bytes += size;
+         largest = (size > largest) ? size : largest;
+         assert(rec.size & MEM_SNAPSHOT_PREV_BUSY); //coalesced
+      }
+   }
+   assert(end == chunk_size);
+   assert(chunks == 1 && busy == 4);
+   assert(free_blocks == (int)s.free_blocks);
+   assert(free_bytes == s.free_bytes);
+   assert(largest == s.largest_free);
+
+   // JSON names the same blocks
+   assert(ftruncate(fd, 0) == 0);
+   assert(lseek(fd, 0, SEEK_SET) == 0);
+   assert(Snapshot_Mem(fd, MEM_SNAPSHOT_JSON) == 0);
+   long len = lseek(fd, 0, SEEK_END);
+   char* json = malloc(len + 1);
+   assert(json != NULL);
+   assert(pread(fd, json, len, 0) == len);
+   json[len] = '\0';
+   assert(strncmp(json, "{\"version\": 1", 13) == 0);
+   assert(strcmp(json + len - 6, "]}\n]}\n") == 0);
+   int n = 0;
+   for (char* p = json; (p = strstr(p, "\"busy\": false")) != NULL; p++) {
+      n++;
+   }
+   assert(n == free_blocks);
+   n = 0;
+   for (char* p = json; (p = strstr(p, "\"busy\": true")) != NULL; p++) {
+      n++;
+   }
+   assert(n == busy);
+
+   exit(0);
+}
@@ -0,0 +1,94 @@
+/* Get_Mem_Stats counts what Alloc_Mem and Free_Mem did, on every thread */
+#include <assert.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include "mem.h"
+
+#define THREADS 4
+#define ROUNDS 1000
+
+static void* churn(void* arg) {
+   (void)arg;
+   for (int i = 0; i < ROUNDS; i++) {
+      void* ptr = Alloc_Mem(100);
+      assert(ptr != NULL);
+      assert(Free_Mem(ptr) == 0);
+   }
+   return NULL;
+}
+
+int main() {
+   mem_stats s, before;
+   mem_opts opts = { 0 };
+   void* ptr[3];
+
+   assert(Get_Mem_Stats(&s) == -1);
+   assert(Alloc_Mem(100) == NULL); //not counted before Init_Mem
+   opts.slab = 1; //only requests of up to 64 bytes, the last ones here
+   assert(Init_Mem_Opts(1 << 20, &opts) == 0);
+   assert(Get_Mem_Stats(NULL) == -1);
+
+   // one free block over the whole heap
+   assert(Get_Mem_Stats(&before) == 0);
+   assert(before.busy_bytes == 0 && before.busy_blocks == 0);
+   assert(before.free_blocks == 1);
+   assert(before.largest_free == before.free_bytes);
+   assert(before.fragmentation == 0.0);
+   assert(before.allocs == 0 && before.frees == 0);
+   assert(before.failed_allocs == 0);
+
+   for (int i = 0; i < 3; i++) {
+      ptr[i] = Alloc_Mem(1000);
+      assert(ptr[i] != NULL);
+   }
+   assert(Get_Mem_Stats(&s) == 0);
+   assert(s.allocs == 3 && s.busy_blocks == 3);
+   assert(s.busy_bytes >= 3000);
+   assert(s.busy_bytes + s.free_bytes == before.free_bytes);
+   assert(s.free_blocks == 1);
+
+   // a hole in the middle fragments the free memory
+   assert(Free_Mem(ptr[1]) == 0);
+   assert(Free_Mem(ptr[1]) == -1);
+   assert(Get_Mem_Stats(&s) == 0);
+   assert(s.frees == 1 && s.busy_blocks == 2);
+   assert(s.free_blocks == 2);
+   assert(s.largest_free < s.free_bytes);
+   assert(s.fragmentation > 0.0 && s.fragmentation < 1.0);
+
+   assert(Alloc_Mem(2 << 20) == NULL);
+   assert(Get_Mem_Stats(&s) == 0);
+   assert(s.failed_allocs == 1 && s.allocs == 3);
+
+   assert(Free_Mem(ptr[0]) == 0);
+   assert(Free_Mem(ptr[2]) == 0);
+   assert(Get_Mem_Stats(&s) == 0);
+   assert(s.busy_bytes == 0 && s.free_blocks == 1);
+   assert(s.fragmentation == 0.0);
+
+   // threads that exited still count
+   pthread_t t[THREADS];
+   for (int i = 0; i < THREADS; i++) {
+      assert(pthread_create(&t[i], NULL, churn, NULL) == 0);
+   }
+   for (int i = 0; i < THREADS; i++) {
+      assert(pthread_join(t[i], NULL) == 0);
+   }
+   assert(Get_Mem_Stats(&s) == 0);
+   assert(s.allocs == 3 + THREADS * ROUNDS);
+   assert(s.frees == 3 + THREADS * ROUNDS);
+   assert(s.busy_blocks == 0);
+
+   // a slot that moves to a block on realloc is freed once
+   ptr[0] = Alloc_Mem(16);
+   assert(ptr[0] != NULL);
+   ptr[0] = Realloc_Mem(ptr[0], 1000);
+   assert(ptr[0] != NULL);
+   assert(Get_Mem_Stats(&s) == 0);
+   assert(s.allocs == s.frees + 1 && s.busy_blocks == 1);
+   assert(Free_Mem(ptr[0]) == 0);
+   assert(Get_Mem_Stats(&s) == 0);
+   assert(s.busy_blocks == 0);
+
+   exit(0);
+}
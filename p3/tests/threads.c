@@ -0,0 +1,58 @@
+/* allocations and frees from several threads, cached blocks return on exit */
+#include <assert.h>
+#include <stdlib.h>
+#include <pthread.h>
+#include "mem.h"
+
+#define THREADS 4
+#define BLOCKS 64
+
+static void* worker(void* arg) {
+   int* ptr[BLOCKS];
+   int id = (int)(long)arg;
+
+   for (int round = 0; round < 100; round++) {
+      for (int i = 0; i < BLOCKS; i++) {
+         ptr[i] = (int*) Alloc_Mem(8 + (i % 5) * 8);
+         assert(ptr[i] != NULL);
+         *ptr[i] = id * BLOCKS + i;
+      }
+      for (int i = 0; i < BLOCKS; i++) {
+         assert(*ptr[i] == id * BLOCKS + i);
+         assert(Free_Mem(ptr[i]) == 0);
+      }
+   }
+   return NULL;
+}
+
+// frees a block another thread already freed into its cache
+static void* refree(void* arg) {
+   assert(Free_Mem(arg) == -1);
+   return NULL;
+}
+
+int main() {
+   assert(Init_Mem(65536) == 0);
+   pthread_t tid[THREADS];
+
+   for (long t = 0; t < THREADS; t++) {
+      assert(pthread_create(&tid[t], NULL, worker, (void*)t) == 0);
+   }
+   for (int t = 0; t < THREADS; t++) {
+      assert(pthread_join(tid[t], NULL) == 0);
+   }
+
+   // a block in one thread's cache can't be freed again by another one
+   void* ptr = Alloc_Mem(40);
+   assert(ptr != NULL);
+   assert(Free_Mem(ptr) == 0);
+   assert(pthread_create(&tid[0], NULL, refree, ptr) == 0);
+   assert(pthread_join(tid[0], NULL) == 0);
+   void* again[2] = { Alloc_Mem(40), Alloc_Mem(40) };
+   assert(again[0] == ptr && again[1] != NULL && again[1] != ptr);
+   assert(Free_Mem(again[0]) == 0 && Free_Mem(again[1]) == 0);
+
+   // every cached block went back and coalesced into one free block
+   assert(Alloc_Mem(65536 - 64) != NULL);
+   exit(0);
+}
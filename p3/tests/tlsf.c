@@ -0,0 +1,51 @@
+/* check allocation, free and coalesce with the TLSF policy */
+#include <assert.h>
+#include <stdlib.h>
+#include "mem.h"
+
+int main() {
+   mem_opts opts = { MEM_POLICY_TLSF };
+   assert(Init_Mem_Opts(4096, &opts) == 0);
+   void * ptr[6];
+   void * test;
+
+   ptr[0] = Alloc_Mem(800);
+   assert(ptr[0] != NULL);
+
+   ptr[1] = Alloc_Mem(100);
+   assert(ptr[1] != NULL);
+
+   ptr[2] = Alloc_Mem(800);
+   assert(ptr[2] != NULL);
+
+   ptr[3] = Alloc_Mem(800);
+   assert(ptr[3] != NULL);
+
+   ptr[4] = Alloc_Mem(100);
+   assert(ptr[4] != NULL);
+
+   ptr[5] = Alloc_Mem(100);
+   assert(ptr[5] != NULL);
+
+   assert(Free_Mem(ptr[0]) == 0);
+   assert(Free_Mem(ptr[2]) == 0);
+
+   // small request comes from a small list, not the 800 byte holes
+   assert(Free_Mem(ptr[4]) == 0);
+   test = Alloc_Mem(60);
+   assert(test == ptr[4]);
+
+   // freeing the block in between merges both 800 byte holes
+   assert(Free_Mem(ptr[1]) == 0);
+   test = Alloc_Mem(1700);
+   assert(test == ptr[0]);
+
+   // everything coalesces back into one block
+   assert(Free_Mem(test) == 0);
+   assert(Free_Mem(ptr[3]) == 0);
+   assert(Free_Mem(ptr[4]) == 0);
+   assert(Free_Mem(ptr[5]) == 0);
+   assert(Alloc_Mem(4000) != NULL);
+
+   exit(0);
+}
@@ -0,0 +1,93 @@
+/* Trace_Mem_Start records each call once, in order on every thread */
+#include <assert.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include "mem.h"
+
+#define PAIRS 5000 //more records than fit in one thread's buffer
+
+static void* churn(void* arg) {
+   (void)arg;
+   for (int i = 0; i < PAIRS; i++) {
+      void* ptr = Alloc_Mem(100);
+      assert(ptr != NULL);
+      assert(Free_Mem(ptr) == 0);
+   }
+   return NULL;
+}
+
+int main() {
+   mem_trace_hdr hdr;
+   mem_trace_rec rec[6];
+   struct stat st;
+   FILE* f = tmpfile();
+   assert(f != NULL);
+   int fd = fileno(f);
+
+   assert(Trace_Mem_Start(fd) == -1); //before Init_Mem
+   assert(Init_Mem(1 << 20) == 0);
+   assert(Trace_Mem_Stop() == -1);
+   assert(Trace_Mem_Start(fd) == 0);
+   assert(Trace_Mem_Start(fd) == -1);
+
+   void* a = Alloc_Mem(100);
+   void* b = Alloc_Mem_Aligned(200, 64);
+   void* c = Calloc_Mem(10, 30);
+   void* d = Realloc_Mem(a, 5000);
+   assert(a != NULL && b != NULL && c != NULL && d != NULL);
+   assert(Free_Mem(b) == 0);
+   assert(Free_Mem(&hdr) == -1); //not recorded
+   assert(Alloc_Mem(2 << 20) == NULL);
+
+   pthread_t t;
+   assert(pthread_create(&t, NULL, churn, NULL) == 0);
+   assert(pthread_join(t, NULL) == 0);
+   assert(Trace_Mem_Stop() == 0);
+   assert(fstat(fd, &st) == 0);
+   assert(Free_Mem(c) == 0); //after the trace
+   assert(Trace_Mem_Stop() == -1);
+   assert(st.st_size ==
+          (off_t)(sizeof(hdr) + (6 + 2 * PAIRS) * sizeof(rec[0])));
+
+   rewind(f);
+   assert(fread(&hdr, sizeof(hdr), 1, f) == 1);
+   assert(strcmp(hdr.magic, MEM_TRACE_MAGIC) == 0);
+   assert(hdr.version == MEM_TRACE_VERSION);
+
+   // sorted out by thread, the other one wrote first: when its buffer
+   // filled up and when it exited
+   static mem_trace_rec all[6 + 2 * PAIRS];
+   assert(fread(all, sizeof(all[0]), 6 + 2 * PAIRS, f) == 6 + 2 * PAIRS);
+   uint16_t self = all[2 * PAIRS].thread;
+   int n = 0, other = 0;
+   uint64_t last = 0;
+   for (int i = 0; i < 6 + 2 * PAIRS; i++) {
+      if (all[i].thread == self) {
+         assert(n == 0 || all[i].time >= rec[n - 1].time);
+         rec[n++] = all[i];
+         continue;
+      }
+      assert(all[i].op == ((other % 2 == 0) ? MEM_TRACE_ALLOC
+                                            : MEM_TRACE_FREE));
+      assert(all[i].time >= last);
+      last = all[i].time;
+      other++;
+   }
+   assert(n == 6 && other == 2 * PAIRS);
+
+   // nested calls are not recorded again
+   assert(rec[0].op == MEM_TRACE_ALLOC && rec[0].size == 100);
+   assert(rec[0].ptr == (uintptr_t)a && rec[0].old == 0);
+   assert(rec[1].op == MEM_TRACE_ALIGNED && rec[1].size == 200);
+   assert(rec[1].ptr == (uintptr_t)b && rec[1].align == 6);
+   assert(rec[2].op == MEM_TRACE_CALLOC && rec[2].size == 300);
+   assert(rec[2].ptr == (uintptr_t)c);
+   assert(rec[3].op == MEM_TRACE_REALLOC && rec[3].size == 5000);
+   assert(rec[3].ptr == (uintptr_t)d && rec[3].old == (uintptr_t)a);
+   assert(rec[4].op == MEM_TRACE_FREE && rec[4].ptr == (uintptr_t)b);
+   assert(rec[5].op == MEM_TRACE_ALLOC && rec[5].ptr == 0);
+   exit(0);
+}
@@ -0,0 +1,181 @@
+/*
+ * Size histogram and fragmentation map of a binary heap snapshot
+ *
+ * Reads what Snapshot_Mem(fd, MEM_SNAPSHOT_BINARY) wrote and prints:
+ * - a map of every chunk cut into cells of equal size, one character per
+ *   cell: '#' no free bytes, '.' all free, '1' to '9' the free tenths
+ * - the totals: blocks, busy and free bytes, the largest free block and
+ *   the fragmentation ratio (1 - largest free / free bytes)
+ * - a histogram of block sizes in power of two classes, busy and free
+ *
+ * The output only depends on the heap's shape, not on its addresses, so
+ * the output of two snapshots can be diffed.
+ *
+ * Usage: snapstat [-c cells] [snapshot]   (stdin without a file)
+ */
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include "mem.h"
+
+#define CLASSES 64
+#define MAP_WIDTH 64 //cells per line
+
+static struct {
+    uint64_t busy;
+    uint64_t busy_bytes;
+    uint64_t free;
+    uint64_t free_bytes;
+} hist[CLASSES];
+
+static uint64_t largest_free = 0;
+
+/* Chunk being read */
+static struct {
+    int open;
+    uint64_t heap;
+    uint64_t size;
+    double *free; //bytes per cell
+} chunk;
+
+static int cells = 256;
+static int chunks = 0;
+
+static int size_class(uint64_t size) {
+    int cls = 0;
+    while (cls < CLASSES - 1 && (size >> (cls + 1)) != 0) {
+        cls++;
+    }
+    return cls;
+}
+
+/* Adds a free block to the cells of the chunk it overlaps */
+static void map_free(uint64_t offset, uint64_t size) {
+    double cell = (double)chunk.size / cells;
+    int first = (int)(offset / cell);
+    int last = (int)((offset + size - 1) / cell);
+
+    for (int i = first; i <= last && i < cells; i++) {
+        double lo = (offset > i * cell) ? offset : i * cell;
+        double hi = (offset + size < (i + 1) * cell) ? offset + size
+                                                     : (i + 1) * cell;
+        chunk.free[i] += hi - lo;
+    }
+}
+
+/* Prints the map of the chunk read last */
+static void map_print(void) {
+    double cell = (double)chunk.size / cells;
+    char line[MAP_WIDTH + 1];
+
+    if (!chunk.open) {
+        return;
+    }
+    printf("\nchunk %d of heap %llu, %llu bytes, %.0f per cell\n", chunks,
+           (unsigned long long)chunk.heap, (unsigned long long)chunk.size,
+           cell);
+    for (int i = 0; i < cells; i += MAP_WIDTH) {
+        int n = 0;
+        for (; n < MAP_WIDTH && i + n < cells; n++) {
+            double share = chunk.free[i + n] / cell;
+            if (share <= 0.0) {
+                line[n] = '#';
+            } else if (share >= 1.0) {
+                line[n] = '.';
+            } else {
+                int tenths = (int)(share * 10) + 1;
+                line[n] = '0' + ((tenths < 9) ? tenths : 9);
+            }
+        }
+        line[n] = '\0';
+        printf("  %s\n", line);
+    }
+    chunks++;
+    chunk.open = 0;
+}
+
+int main(int argc, char *argv[]) {
+    FILE *in = stdin;
+    mem_snapshot_hdr hdr;
+    mem_snapshot_rec rec;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "c:")) != -1) {
+        if (opt != 'c' || (cells = atoi(optarg)) <= 0) {
+            fprintf(stderr, "usage: snapstat [-c cells] [snapshot]\n");
+            return 2;
+        }
+    }
+    if (optind < argc && (in = fopen(argv[optind], "rb")) == NULL) {
+        perror(argv[optind]);
+        return 1;
+    }
+    if (fread(&hdr, sizeof(hdr), 1, in) != 1 ||
+        memcmp(hdr.magic, MEM_SNAPSHOT_MAGIC, sizeof(hdr.magic)) != 0 ||
+        hdr.version != MEM_SNAPSHOT_VERSION) {
+        fprintf(stderr, "snapstat: not a binary heap snapshot\n");
+        return 1;
+    }
+    if ((chunk.free = malloc(sizeof(double) * cells)) == NULL) {
+        return 1;
+    }
+
+    while (fread(&rec, sizeof(rec), 1, in) == 1) {
+        int flags = rec.size & 7;
+        uint64_t size = rec.size & ~(uint64_t)7;
+
+        if (flags & MEM_SNAPSHOT_CHUNK) {
+            map_print();
+            chunk.open = 1;
+            chunk.heap = rec.offset;
+            chunk.size = size;
+            memset(chunk.free, 0, sizeof(double) * cells);
+            continue;
+        }
+        if (!chunk.open || size == 0 || rec.offset + size > chunk.size) {
+            fprintf(stderr, "snapstat: block outside of a chunk\n");
+            return 1;
+        }
+        int cls = size_class(size);
+        if (flags & MEM_SNAPSHOT_BUSY) {
+            hist[cls].busy++;
+            hist[cls].busy_bytes += size;
+        } else {
+            hist[cls].free++;
+            hist[cls].free_bytes += size;
+            largest_free = (size > largest_free) ? size : largest_free;
+            map_free(rec.offset, size);
+        }
+    }
+    map_print();
+
+    uint64_t busy = 0, busy_bytes = 0, nfree = 0, free_bytes = 0;
+    for (int i = 0; i < CLASSES; i++) {
+        busy += hist[i].busy;
+        busy_bytes += hist[i].busy_bytes;
+        nfree += hist[i].free;
+        free_bytes += hist[i].free_bytes;
+    }
+    printf("\n%d chunks, %llu busy blocks with %llu bytes, %llu free blocks "
+           "with %llu bytes\n", chunks, (unsigned long long)busy,
+           (unsigned long long)busy_bytes, (unsigned long long)nfree,
+           (unsigned long long)free_bytes);
+    printf("largest free block %llu bytes, fragmentation %.3f\n",
+           (unsigned long long)largest_free,
+           (free_bytes > 0) ? 1.0 - (double)largest_free / free_bytes : 0.0);
+
+    printf("\n%-12s %10s %14s %10s %14s\n", "size >=", "busy", "busy bytes",
+           "free", "free bytes");
+    for (int i = 0; i < CLASSES; i++) {
+        if (hist[i].busy + hist[i].free > 0) {
+            printf("%-12llu %10llu %14llu %10llu %14llu\n", 1ull << i,
+                   (unsigned long long)hist[i].busy,
+                   (unsigned long long)hist[i].busy_bytes,
+                   (unsigned long long)hist[i].free,
+                   (unsigned long long)hist[i].free_bytes);
+        }
+    }
+    return 0;
+}